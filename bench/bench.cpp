@@ -0,0 +1,146 @@
+// Host benchmark suite for the portable modules: config parse time, alarm
+// evaluation cost and uplink encode throughput. Build and run with
+//   pio run -e native && .pio/build/native/program [scale]
+// Numbers are host numbers; compare them run to run, not against the board.
+#include <chrono>
+#include "hal_native.h"
+#include "flashfs.h"
+#include "config.h"
+#include "alarms.h"
+#include "fields.h"
+#include "aggregate.h"
+#include "snapshot.h"
+#include "lora.h"
+#include "tasks.h"
+#include "txqueue.h"
+#include "scenario.h"
+
+#define BENCH_FS_ROOT ".bench_fs"
+
+typedef std::chrono::steady_clock BenchClock;
+
+static double usSince(BenchClock::time_point start) {
+  return std::chrono::duration<double, std::micro>(BenchClock::now() - start).count();
+}
+
+static void report(const char* name, long iterations, double totalUs, const char* unit, double perUnit) {
+  printf("  %-28s %8ld runs  %10.2f us/run  %12.1f %s\n", name, iterations, totalUs / iterations, perUnit, unit);
+}
+
+// ----- Config parsing -----
+
+static void benchConfig(long iterations) {
+  writeScenarioConfig();
+
+  auto start = BenchClock::now();
+  for (long i = 0; i < iterations; i++) readFileFS("/modbus.json");
+  double readUs = usSince(start);
+
+  start = BenchClock::now();
+  for (long i = 0; i < iterations; i++) {
+    loadModbusConfigFromFlash();
+    loadInputsConfig();
+  }
+  double loadUs = usSince(start);
+
+  printf("Config parse (4 JSON files, %d requests, %d rules / %d terms, %d fields)\n",
+         requestCount, alarmRuleCount, alarmTermCount, fieldCount);
+  report("read modbus.json only", iterations, readUs, "bytes", (double)strlen(benchModbusJson));
+  report("full load + compile + plan", iterations, loadUs, "loads/s", iterations / (loadUs / 1e6));
+}
+
+// ----- Alarm evaluation -----
+
+static void benchAlarms(long iterations) {
+  AlarmEvent ev;
+
+  fillScan(false);
+  decodeFields();
+  evaluateAlarmRules();
+  while (nextAlarm(ev)) {}
+
+  // Steady state: nothing crosses a threshold
+  auto start = BenchClock::now();
+  for (long i = 0; i < iterations; i++) evaluateAlarmRules();
+  double quietUs = usSince(start);
+
+  // Every 64th scan trips and then clears the rules
+  long raised = 0;
+  start = BenchClock::now();
+  for (long i = 0; i < iterations; i++) {
+    bool spike = (i & 63) == 0;
+    if (spike || (i & 63) == 1) {
+      fillScan(spike);
+      decodeFields();
+    }
+    evaluateAlarmRules();
+    while (nextAlarm(ev)) raised++;
+  }
+  double busyUs = usSince(start);
+
+  printf("Alarm evaluation (%d rules, %d terms)\n", alarmRuleCount, alarmTermCount);
+  report("quiet scan", iterations, quietUs, "ns/term", quietUs * 1000 / iterations / max(alarmTermCount, 1));
+  report("1 in 64 scans alarming", iterations, busyUs, "events", (double)raised);
+}
+
+// ----- Uplink encoding -----
+
+static uint32_t uplinkFrames = 0;
+static uint32_t uplinkBytes = 0;
+
+static void countUplink(uint8_t port, const uint8_t* data, uint8_t len, bool confirmed) {
+  uplinkFrames++;
+  uplinkBytes += len;
+}
+
+static void drainRadio() {
+  while (txQueueDepth() > 0) {
+    serviceTxQueue();
+    halRadioRunOnce();
+  }
+}
+
+static void benchEncoding(const char* name, PayloadEncoding encoding, long iterations) {
+  LORA_ENCODING = encoding;
+  fillScan(false);
+  publishSnapshot();
+  sendLoRaUplink();  // schema announcement and first keyframe stay out of the timing
+  drainRadio();
+
+  uplinkFrames = 0;
+  uplinkBytes = 0;
+  auto start = BenchClock::now();
+  for (long i = 0; i < iterations; i++) {
+    fillScan(false);
+    decodeFields();
+    accumulateScan();
+    publishSnapshot();
+    sendLoRaUplink();
+    drainRadio();
+  }
+  double totalUs = usSince(start);
+
+  char label[48];
+  snprintf(label, sizeof(label), "%s (%.1f frames, %.0f B)", name, (double)uplinkFrames / iterations,
+           (double)uplinkBytes / iterations);
+  report(label, iterations, totalUs, "kB/s", uplinkBytes / (totalUs / 1e6) / 1000);
+}
+
+int main(int argc, char** argv) {
+  long scale = argc > 1 ? max(atol(argv[1]), 1L) : 1;
+
+  halNativeSetFsRoot(getenv("FYP_FS_ROOT") ? getenv("FYP_FS_ROOT") : BENCH_FS_ROOT);
+  halNativeOnUplink(countUplink);
+  Serial.setQuiet(true);  // the firmware's own logging would dominate every timing
+  initFlashFS();
+
+  benchConfig(500 * scale);
+  initLoRa();
+  benchAlarms(200000 * scale);
+
+  printf("Uplink encoding, SF%u (build + queue + loopback radio per uplink)\n", getCurrentSF());
+  benchEncoding("full", ENCODING_FULL, 20000 * scale);
+  benchEncoding("schema", ENCODING_SCHEMA, 20000 * scale);
+  benchEncoding("delta", ENCODING_DELTA, 20000 * scale);
+  return 0;
+}
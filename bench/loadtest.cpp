@@ -0,0 +1,219 @@
+// Scan-throughput load test: drives the real poll engine (planner, timing
+// wheel, slave connections, pollDueModbus) over host sockets against
+// tools/modbus_sim and reports poll duration and per-request latency
+// percentiles.
+//   .pio/build/modbus_sim/program --slaves 8 --latency 5 --jitter 5 &
+//   pio run -e native_loadtest && .pio/build/native_loadtest/program --slaves 8 --requests 16
+//
+// Options (times in ms):
+//   --slaves N     slaves to spread the requests over (default 8)
+//   --units N      unit IDs per slave (default 1)
+//   --requests N   requests in the table, up to MAX_REQUESTS (default 16)
+//   --regs N       registers per request (default 16)
+//   --function F   Modbus function for every request (default 3)
+//   --scans N      scheduled polls to time (default 200)
+//   --interval MS  scan interval of every request (default 200)
+//   --phase MS     phase of every request, so all reads fall due together
+//                  (default: spread by the schedule)
+//   --timeout MS   per-request reply timeout (default 1000)
+//   --port N       simulator port (default 1502)
+//   --base N       last octet of the first simulator slave (default 10)
+#include <chrono>
+#include <vector>
+#include "hal_native.h"
+#include "config.h"
+#include "modbus.h"
+#include "planner.h"
+#include "schedule.h"
+#include "slaves.h"
+#include "table.h"
+
+struct LoadTestOptions {
+  int slaves = 8;
+  int units = 1;
+  int requests = MAX_REQUESTS;
+  int regs = 16;
+  int function = READ_HREG;
+  long scans = 200;
+  unsigned long intervalMs = 200;
+  long phaseMs = -1;
+  unsigned long timeoutMs = 1000;
+  uint16_t port = 1502;
+  int base = 10;
+};
+
+// Per-block result of the scan in progress, filled in by the reply hook
+struct BlockSample {
+  bool replied;
+  uint8_t result;
+  uint32_t latencyUs;
+};
+
+struct RequestLatency {
+  std::vector<uint32_t> latencyUs;
+  long polls = 0;     // scheduled polls that read this request
+  long timeouts = 0;
+  long exceptions = 0;
+  long skipped = 0;  // slave not connected when the scan started
+};
+
+static BlockSample samples[MAX_BLOCKS];
+static RequestLatency stats[MAX_REQUESTS];
+
+static void onReply(IPAddress ip, uint8_t unit, uint16_t start, uint8_t result, uint32_t latencyUs) {
+  for (int b = 0; b < blockCount; b++) {
+    if (blocks[b].slaveIP == ip && blocks[b].unitID == unit && blocks[b].startReg == start) {
+      samples[b] = { true, result, latencyUs };
+      return;
+    }
+  }
+}
+
+// Nearest-rank percentile of an ascending sample set
+static double percentile(const std::vector<uint32_t>& sorted, double p) {
+  if (sorted.empty()) return 0;
+  size_t rank = (size_t)(p / 100.0 * sorted.size() + 0.999999);
+  return sorted[min(max(rank, (size_t)1), sorted.size()) - 1];
+}
+
+// Requests round-robin over slaves, then units, so each slave carries an
+// even share and none of them coalesce unless they really are adjacent
+static void buildLoadTable(const LoadTestOptions& opt) {
+  beginRequestTable();
+  requestCount = opt.requests;
+  for (int i = 0; i < requestCount; i++) {
+    int slave = i % opt.slaves;
+    int unit = 1 + (i / opt.slaves) % opt.units;
+    uint16_t start = (i / (opt.slaves * opt.units)) * (opt.regs + MODBUS_MAX_GAP + 1);
+    requests[i] = ModbusRequest(IPAddress(127, 0, 0, opt.base + slave), unit, start, opt.regs,
+                                (ModbusFunction)opt.function);
+    requests[i].intervalMs = opt.intervalMs;
+    requests[i].phaseMs = opt.phaseMs;
+  }
+  buildRequestTable();
+}
+
+static bool waitForSlaves(uint32_t timeoutMs) {
+  unsigned long start = millis();
+  while (millis() - start < timeoutMs) {
+    serviceModbusConnections();
+    int connected = 0;
+    for (int s = 0; s < slaveCount; s++) {
+      if (slaves[s].state == SLAVE_CONNECTED) connected++;
+    }
+    if (connected == slaveCount) return true;
+    delay(10);
+  }
+  return false;
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: loadtest [--slaves N] [--units N] [--requests N] [--regs N] [--function F] [--scans N]\n"
+          "                [--interval MS] [--phase MS] [--timeout MS] [--port N] [--base N]\n");
+  exit(2);
+}
+
+static LoadTestOptions parseOptions(int argc, char** argv) {
+  LoadTestOptions opt;
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 >= argc) usage();
+    const char* name = argv[i];
+    long value = atol(argv[++i]);
+    if (!strcmp(name, "--slaves")) opt.slaves = constrain(value, 1L, (long)MAX_SLAVES);
+    else if (!strcmp(name, "--units")) opt.units = constrain(value, 1L, 247L);
+    else if (!strcmp(name, "--requests")) opt.requests = constrain(value, 1L, (long)MAX_REQUESTS);
+    else if (!strcmp(name, "--regs")) opt.regs = constrain(value, 1L, (long)MAX_PDU_REGS);
+    else if (!strcmp(name, "--function")) opt.function = constrain(value, 1L, 4L);
+    else if (!strcmp(name, "--scans")) opt.scans = max(value, 1L);
+    else if (!strcmp(name, "--interval")) opt.intervalMs = max(value, (long)WHEEL_TICK_MS);
+    else if (!strcmp(name, "--phase")) opt.phaseMs = max(value, 0L);
+    else if (!strcmp(name, "--timeout")) opt.timeoutMs = max(value, 1L);
+    else if (!strcmp(name, "--port")) opt.port = value;
+    else if (!strcmp(name, "--base")) opt.base = constrain(value, 1L, 254L);
+    else usage();
+  }
+  return opt;
+}
+
+int main(int argc, char** argv) {
+  LoadTestOptions opt = parseOptions(argc, argv);
+
+  halNativeSetModbusPort(opt.port);
+  halNativeOnModbusReply(onReply);
+  Serial.setQuiet(true);  // pollDueModbus() logs every block
+
+  enableEthernet = true;
+  useDHCP = false;
+  MODBUS_REQUEST_TIMEOUT = opt.timeoutMs;
+  initEthernet();
+  buildLoadTable(opt);
+
+  if (!waitForSlaves(5000)) {
+    int connected = 0;
+    for (int s = 0; s < slaveCount; s++) {
+      if (slaves[s].state == SLAVE_CONNECTED) connected++;
+    }
+    printf("warning: only %d/%d slaves connected, is modbus_sim running on port %u?\n", connected, slaveCount,
+           opt.port);
+  }
+
+  printf("Load test: %d requests as %d reads over %d slaves x %d units, %d regs, function %d, every %lu ms, %ld polls\n",
+         requestCount, blockCount, slaveCount, opt.units, opt.regs, opt.function, opt.intervalMs, opt.scans);
+
+  std::vector<uint32_t> scanUs;
+  scanUs.reserve(opt.scans);
+  auto testStart = std::chrono::steady_clock::now();
+
+  // The same loop as the modbus task, on a wheel restarted now that the
+  // slaves are up so the first reads are not counted late
+  planSchedule();
+  for (long s = 0; s < opt.scans;) {
+    serviceModbusConnections();
+    memset(samples, 0, sizeof(samples));
+
+    auto start = std::chrono::steady_clock::now();
+    if (!pollDueModbus()) {
+      delay(1);
+      continue;
+    }
+    scanUs.push_back(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start)
+                         .count());
+    s++;
+
+    for (int i = 0; i < requestCount; i++) {
+      if (!requests[i].fresh) continue;  // its block was not due
+      stats[i].polls++;
+      const BlockSample& sample = samples[requestBlock[i]];
+      if (requests[i].success) {
+        stats[i].latencyUs.push_back(sample.latencyUs);
+      } else if (sample.replied) {
+        stats[i].exceptions++;
+      } else if (slaveReady(requests[i].slaveIP)) {
+        stats[i].timeouts++;
+      } else {
+        stats[i].skipped++;
+      }
+    }
+  }
+
+  double totalS = std::chrono::duration<double>(std::chrono::steady_clock::now() - testStart).count();
+
+  std::sort(scanUs.begin(), scanUs.end());
+  printf("\nPoll duration (ms)   p50 %8.2f  p90 %8.2f  p99 %8.2f  max %8.2f   %.1f polls/s\n",
+         percentile(scanUs, 50) / 1000, percentile(scanUs, 90) / 1000, percentile(scanUs, 99) / 1000,
+         scanUs.back() / 1000.0, opt.scans / totalS);
+
+  printf("\n  req  slave            unit  start  read     ok%%   p50 ms   p90 ms   p99 ms   max ms  timeout  exc  skip\n");
+  for (int i = 0; i < requestCount; i++) {
+    RequestLatency& st = stats[i];
+    std::sort(st.latencyUs.begin(), st.latencyUs.end());
+    double okPct = st.polls ? 100.0 * st.latencyUs.size() / st.polls : 0;
+    double maxMs = st.latencyUs.empty() ? 0 : st.latencyUs.back() / 1000.0;
+    printf("  %3d  %-15s  %4u  %5u  %4u  %6.1f  %7.2f  %7.2f  %7.2f  %7.2f  %7ld  %3ld  %4ld\n", i,
+           requests[i].slaveIP.toString().c_str(), requests[i].unitID, requests[i].startReg, requestBlock[i], okPct,
+           percentile(st.latencyUs, 50) / 1000, percentile(st.latencyUs, 90) / 1000,
+           percentile(st.latencyUs, 99) / 1000, maxMs, st.timeouts, st.exceptions, st.skipped);
+  }
+  return 0;
+}
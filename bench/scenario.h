@@ -0,0 +1,78 @@
+#pragma once
+// Configuration and synthetic scans shared by the host programs in bench/
+#include "flashfs.h"
+#include "config.h"
+
+// Four requests, the size of the shipped table, with every feature the
+// encoders and the rule evaluator have a path for
+static const char* benchModbusJson = R"json({
+  "interval": 5000,
+  "maxGap": 4,
+  "requests": [
+    { "ip": [10, 0, 0, 2], "unitID": 1, "start": 0, "count": 16, "function": 3,
+      "stats": ["last", "min", "max", "mean", "count"],
+      "alarms": [
+        { "index": 0, "op": ">", "threshold": 1000, "hysteresis": 20, "debounce": 0 },
+        { "index": 1, "op": "rate", "threshold": 50 },
+        { "all": [ { "index": 2, "op": ">", "threshold": 500 }, { "index": 3, "op": "<", "threshold": 100 } ] },
+        { "any": [ { "index": 4, "op": "=", "threshold": 7 }, { "request": 1, "index": 0, "op": ">", "threshold": 20 } ] }
+      ] },
+    { "ip": [10, 0, 0, 2], "unitID": 1, "start": 100, "count": 8, "function": 4,
+      "fields": [
+        { "index": 0, "type": "float32", "wordSwap": true, "uplink": "int16", "scale": 10 },
+        { "index": 2, "type": "int32" },
+        { "index": 4, "type": "int16", "uplink": "int8" }
+      ],
+      "alarms": [ { "index": 0, "op": ">", "threshold": 30.5, "hysteresis": 0.5 } ] },
+    { "ip": [10, 0, 0, 3], "unitID": 2, "start": 0, "count": 16, "function": 1 },
+    { "ip": [10, 0, 0, 3], "unitID": 2, "start": 0, "count": 8, "function": 2 }
+  ]
+})json";
+
+static const char* benchLoraJson = R"json({
+  "lora": { "join": "abp", "interval": 10000, "adr": false, "sf": 7,
+            "devaddr": "26011BA0", "nwkskey": "E2A3D6B2C3457899AABBCCDDEEFF0011",
+            "appskey": "112233445566778899AABBCCDDEEFF00" }
+})json";
+
+static const char* benchInputsJson = R"json({
+  "inputs": [ { "pin": 14, "type": "digital", "alarm": { "active": false } },
+              { "pin": 15, "type": "counter", "alarm": { "active": false } } ]
+})json";
+
+static void writeScenarioConfig() {
+  writeFileFS("/modbus.json", benchModbusJson);
+  writeFileFS("/lora.json", benchLoraJson);
+  writeFileFS("/inputs.json", benchInputsJson);
+  writeFileFS("/ethernet.json", R"json({ "enableEthernet": true, "ethernet": { "dhcp": true,
+    "ip": [10, 0, 0, 1], "gateway": [10, 0, 0, 254], "subnet": [255, 255, 255, 0], "dns": [10, 0, 0, 254] } })json");
+}
+
+static uint32_t lcg = 12345;
+
+static uint16_t nextRandom() {
+  lcg = lcg * 1103515245 + 12345;
+  return lcg >> 16;
+}
+
+// Registers drift a little per scan, like real process values do
+static void fillScan(bool spike) {
+  for (int i = 0; i < requestCount; i++) {
+    ModbusRequest& req = requests[i];
+    req.fresh = true;
+    req.success = true;
+    for (int r = 0; r < req.numRegs; r++) {
+      if (isBitFunction(req.function)) {
+        if ((nextRandom() & 15) == 0) setRequestValue(requestValues, req, r, requestValue(requestValues, req, r) ^ 1);
+      } else {
+        setRequestValue(requestValues, req, r, 400 + (r * 37) + (nextRandom() & 7));
+      }
+    }
+  }
+  if (spike) {
+    setRequestValue(requestValues, requests[0], 0, 1200);
+    setRequestValue(requestValues, requests[0], 2, 600);
+    setRequestValue(requestValues, requests[0], 3, 50);
+  }
+}
+
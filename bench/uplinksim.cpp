@@ -0,0 +1,301 @@
+// End-to-end uplink simulation: the firmware's scan, alarm and uplink path
+// (sendLoRaUplink, checkAlarmUplink, the TX queue and the radio events) runs
+// on the virtual clock against the native radio's LoRa timing and the
+// network-server stand-in in native/src/netserver.cpp, which decodes every
+// frame. Reports frames, bytes, airtime and TX-blocked time per uplink
+// interval, and checks the decoded values against what was sent.
+//   pio run -e native_uplinksim
+//   for e in full schema delta; do .pio/build/native_uplinksim/program --encoding $e; done
+//
+// Options:
+//   --encoding E   full | schema | delta (default delta)
+//   --hours H      simulated time (default 6)
+//   --interval MS  uplink interval (default from the scenario, 10000)
+//   --sf N         starting spreading factor (default 7)
+//   --adr 0|1      device ADR (default 0)
+//   --snr DB       mean link SNR, with --snr-jitter DB spread (default 5, 3)
+//   --loss PCT     uplinks lost (default 0)
+//   --ack-loss PCT downlinks lost (default 0)
+//   --no-ack       the network never acks
+//   --alarm-every N  scans between alarm spikes, 0 = none (default 64)
+//   --diag MS      diagnostic uplink interval, 0 = off (default 0)
+//   --seed N       network randomness (default 1)
+//   --trace        one line per uplink interval
+#include <vector>
+#include "hal_native.h"
+#include "netserver.h"
+#include "flashfs.h"
+#include "config.h"
+#include "alarms.h"
+#include "fields.h"
+#include "aggregate.h"
+#include "snapshot.h"
+#include "airtime.h"
+#include "lora.h"
+#include "txqueue.h"
+#include "payload.h"
+#include "delta.h"
+#include "scenario.h"
+#include "metrics.h"
+
+#define SIM_FS_ROOT ".bench_fs"
+#define SIM_STEP_MS 5  // radio task pass; the board runs one per tick
+
+struct SimOptions {
+  uint8_t encoding = ENCODING_DELTA;
+  double hours = 6;
+  unsigned long intervalMs = 0;
+  uint8_t sf = 7;
+  bool adr = false;
+  long alarmEvery = 64;
+  unsigned long diagMs = 0;
+  bool trace = false;
+  NetServerConfig net;
+};
+
+struct IntervalSample {
+  uint32_t frames;
+  uint32_t bytes;
+  uint32_t airtimeMs;
+  uint32_t blockedMs;
+};
+
+static std::vector<IntervalSample> samples;
+static HalNativeRadioStats lastRadio = {};
+// The last few intervals: queued frames and LMIC's retransmissions of
+// unacked confirmed ones can lag several behind. Each keeps its own copy of
+// the values: a snapshot's only last until the next readSnapshot().
+#define SENT_HISTORY 8
+struct SentInterval {
+  RegisterSnapshot snap;
+  std::vector<uint16_t> values;
+};
+static SentInterval sent[SENT_HISTORY];
+static uint32_t mismatches = 0;
+static uint32_t checkedRequests = 0;
+static uint32_t checkedFields = 0;
+
+static void keepSent() {
+  for (int k = SENT_HISTORY - 1; k > 0; k--) sent[k] = sent[k - 1];
+  readSnapshot(sent[0].snap);
+  size_t slots = 0;
+  for (int i = 0; i < sent[0].snap.count; i++) slots += requestValueSlots(sent[0].snap.requests[i]);
+  sent[0].values.assign(sent[0].snap.values, sent[0].snap.values + slots);
+}
+
+// A narrowed field as the server should read it: the sent int16/int8 with
+// the announced scale and offset undone
+static float expectedFieldValue(const FieldDesc& f, float value) {
+  uint8_t out[2];
+  encodeFieldUplink(f, value, out);
+  int32_t narrow = f.uplink == FIELD_UPLINK_INT8 ? (int8_t)out[0] : (int16_t)((out[0] << 8) | out[1]);
+  return (narrow - f.offset) / f.scale;
+}
+
+static bool valuesMatch(const NetServerRequest& got, const SentInterval& interval, uint32_t& fields) {
+  const RegisterSnapshot& snap = interval.snap;
+  for (int i = 0; i < snap.count; i++) {
+    const ModbusRequest& req = snap.requests[i];
+    if (req.slaveIP != got.ip || req.unitID != got.unit || req.startReg != got.start || req.numRegs != got.numRegs) {
+      continue;
+    }
+    for (int r = 0; r < req.numRegs; r++) {
+      if (!got.rawValue[r]) continue;
+      if (got.values[r] != requestValue(interval.values.data(), req, r)) return false;
+    }
+    fields = 0;
+    for (int f = 0; f < snap.fieldCount; f++) {
+      const FieldDesc& field = snap.fields[f];
+      if (field.request != i || !got.narrowed[field.index]) continue;
+      float expected = expectedFieldValue(field, snap.fieldValues[f]);
+      if (fabsf(got.fieldValues[field.index] - expected) > 1e-4f * max(1.0f, fabsf(expected))) return false;
+      fields++;
+    }
+    return true;
+  }
+  return false;
+}
+
+// Everything the network decoded since the last interval must equal what
+// the device sent in one of the last SENT_HISTORY intervals
+static void checkDecoded() {
+  for (int i = 0; i < netServerRequestCount(); i++) {
+    const NetServerRequest& got = netServerRequest(i);
+    if (!got.updated) continue;
+    checkedRequests++;
+    uint32_t fields = 0;
+    int k = 0;
+    while (k < SENT_HISTORY && !valuesMatch(got, sent[k], fields)) k++;
+    if (k == SENT_HISTORY) mismatches++;
+    checkedFields += fields;
+  }
+  netServerTakeUpdates();
+}
+
+static void closeInterval(bool trace) {
+  HalNativeRadioStats now;
+  halNativeRadioStats(now);
+  IntervalSample s = { now.frames - lastRadio.frames, now.bytes - lastRadio.bytes,
+                       now.airtimeMs - lastRadio.airtimeMs, now.blockedMs - lastRadio.blockedMs };
+  lastRadio = now;
+  samples.push_back(s);
+  checkDecoded();
+
+  if (trace) {
+    printf("  %8.1f s  SF%-2u  %2u frames  %4u B  %6u ms on air  %6u ms blocked  queue %d\n", millis() / 1000.0,
+           getCurrentSF(), s.frames, s.bytes, s.airtimeMs, s.blockedMs, txQueueDepth());
+  }
+}
+
+static void scan(long index, long alarmEvery) {
+  fillScan(alarmEvery > 0 && index % alarmEvery == 0);
+  decodeFields();
+  evaluateAlarmRules();
+  accumulateScan();
+  publishSnapshot();
+}
+
+static void summarize(const char* label, uint32_t IntervalSample::*field) {
+  if (samples.empty()) return;
+  std::vector<uint32_t> v;
+  for (auto& s : samples) v.push_back(s.*field);
+  std::sort(v.begin(), v.end());
+  double sum = 0;
+  for (uint32_t x : v) sum += x;
+  printf("  %-22s mean %9.1f   p50 %7u   p95 %7u   max %7u\n", label, sum / v.size(), v[v.size() / 2],
+         v[(v.size() * 95) / 100], v.back());
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: uplinksim [--encoding full|schema|delta] [--hours H] [--interval MS] [--sf N] [--adr 0|1]\n"
+          "                 [--snr DB] [--snr-jitter DB] [--loss PCT] [--ack-loss PCT] [--no-ack]\n"
+          "                 [--alarm-every N] [--diag MS] [--seed N] [--trace]\n");
+  exit(2);
+}
+
+static SimOptions parseOptions(int argc, char** argv) {
+  SimOptions opt;
+  opt.net.adr = true;
+  for (int i = 1; i < argc; i++) {
+    const char* name = argv[i];
+    if (!strcmp(name, "--trace")) {
+      opt.trace = true;
+      continue;
+    }
+    if (!strcmp(name, "--no-ack")) {
+      opt.net.ack = false;
+      continue;
+    }
+    if (i + 1 >= argc) usage();
+    const char* value = argv[++i];
+    if (!strcmp(name, "--encoding")) {
+      if (!strcmp(value, "full")) opt.encoding = ENCODING_FULL;
+      else if (!strcmp(value, "schema")) opt.encoding = ENCODING_SCHEMA;
+      else if (!strcmp(value, "delta")) opt.encoding = ENCODING_DELTA;
+      else usage();
+    } else if (!strcmp(name, "--hours")) opt.hours = max(atof(value), 0.01);
+    else if (!strcmp(name, "--interval")) opt.intervalMs = max(atol(value), 1000L);
+    else if (!strcmp(name, "--sf")) opt.sf = constrain(atoi(value), 7, 12);
+    else if (!strcmp(name, "--adr")) opt.adr = atoi(value) != 0;
+    else if (!strcmp(name, "--snr")) opt.net.snrDb = atof(value);
+    else if (!strcmp(name, "--snr-jitter")) opt.net.snrJitterDb = max(atof(value), 0.0);
+    else if (!strcmp(name, "--loss")) opt.net.lossPct = constrain(atoi(value), 0, 100);
+    else if (!strcmp(name, "--ack-loss")) opt.net.ackLossPct = constrain(atoi(value), 0, 100);
+    else if (!strcmp(name, "--alarm-every")) opt.alarmEvery = max(atol(value), 0L);
+    else if (!strcmp(name, "--diag")) opt.diagMs = max(atol(value), 0L);
+    else if (!strcmp(name, "--seed")) opt.net.seed = atol(value);
+    else usage();
+  }
+  return opt;
+}
+
+int main(int argc, char** argv) {
+  SimOptions opt = parseOptions(argc, argv);
+  static const char* encodingNames[] = { "full", "schema", "delta" };
+
+  halNativeSetFsRoot(getenv("FYP_FS_ROOT") ? getenv("FYP_FS_ROOT") : SIM_FS_ROOT);
+  halNativeUseVirtualClock(true);
+  Serial.setQuiet(true);
+  initFlashFS();
+  writeScenarioConfig();
+  loadModbusConfigFromFlash();
+  loadInputsConfig();
+
+  LORA_ENCODING = opt.encoding;
+  LORA_SF = opt.sf;
+  LORA_ADR = opt.adr;
+  if (opt.intervalMs) LORA_UPLINK_INTERVAL = opt.intervalMs;
+  LORA_DIAG_INTERVAL = opt.diagMs;
+
+  netServerBegin(opt.net);
+  initLoRa();
+  if (opt.adr) halNativeSetDataRate(opt.sf, 125000);  // ADR leaves the rate alone, start it where asked
+
+  printf("Uplink simulation: %s encoding, %d requests, %.1f h, SF%u, ADR %s, uplink every %lu ms\n",
+         encodingNames[opt.encoding], requestCount, opt.hours, opt.sf, opt.adr ? "on" : "off", LORA_UPLINK_INTERVAL);
+  printf("Network: loss %u%%, ACK loss %u%%, %s, SNR %.1f +/- %.1f dB\n", opt.net.lossPct, opt.net.ackLossPct,
+         opt.net.ack ? "acks confirmed uplinks" : "never acks", opt.net.snrDb, opt.net.snrJitterDb);
+
+  unsigned long start = millis();
+  unsigned long duration = (unsigned long)(opt.hours * 3600000);
+  unsigned long lastScan = start - MODBUS_SCAN_INTERVAL;
+  lastUplink = start - effectiveUplinkInterval();
+  long scans = 0;
+  bool first = true;
+
+  // The radio task's loop from tasks.cpp, with the Modbus scan folded in
+  while (millis() - start < duration) {
+    unsigned long now = millis();
+    if (now - lastScan >= MODBUS_SCAN_INTERVAL) {
+      lastScan = now;
+      scan(scans++, opt.alarmEvery);
+    }
+
+    halRadioRunOnce();
+    serviceTxQueue();
+    checkAlarmUplink();
+    checkDiagnosticUplink();
+
+    if (now - lastUplink >= effectiveUplinkInterval()) {
+      if (!first) closeInterval(opt.trace);
+      first = false;
+      lastUplink = now;
+      keepSent();
+      sendLoRaUplink();
+    }
+    delay(SIM_STEP_MS);
+  }
+  closeInterval(opt.trace);
+
+  HalNativeRadioStats radio;
+  halNativeRadioStats(radio);
+  const NetServerStats& net = netServerStats();
+
+  printf("\nPer uplink interval (%zu intervals, %ld scans)\n", samples.size(), scans);
+  summarize("frames", &IntervalSample::frames);
+  summarize("payload bytes", &IntervalSample::bytes);
+  summarize("airtime ms", &IntervalSample::airtimeMs);
+  summarize("TX blocked ms", &IntervalSample::blockedMs);
+
+  double hours = (millis() - start) / 3600000.0;
+  printf("\nRadio: %u frames (%u retransmissions), %u B, %.1f s on air (%.2f%% duty), %.1f s blocked, %u acked, final SF%u\n",
+         radio.frames, radio.retransmissions, radio.bytes, radio.airtimeMs / 1000.0, radio.airtimeMs / (hours * 36000.0),
+         radio.blockedMs / 1000.0, radio.acked, getCurrentSF());
+  printf("Network: %u received, %u repeated, %u lost, %u B, %u acks, %u downlinks, %u ADR commands, %u SF changes\n",
+         net.received, net.duplicates, net.lost, net.bytes, net.acksSent, radio.downlinks, net.adrCommands, radio.adrChanges);
+  printf("Frames by fPort: legacy %u, alarm %u, delta %u, schema %u, schema data %u, diag %u\n",
+         net.framesByPort[LEGACY_FPORT], net.framesByPort[ALARM_FPORT], net.framesByPort[DELTA_FPORT],
+         net.framesByPort[SCHEMA_ANNOUNCE_FPORT], net.framesByPort[SCHEMA_DATA_FPORT], net.framesByPort[DIAG_FPORT]);
+  if (net.diagnostics > 0) {
+    const NetServerDiagnostic& d = netServerLastDiagnostic();
+    printf("Last diagnostic: uptime %u min, %u scans, %u tx, %u acked, %u uplinks, tx p50 bucket %u, SF%u, queue %u\n",
+           d.uptimeMin, d.counters[METRIC_SCANS], d.counters[METRIC_TX], d.counters[METRIC_TX_ACKED],
+           d.counters[METRIC_UPLINKS], d.p50[METRIC_TX_MS], d.sf, d.queueDepth);
+  }
+  printf("Decoder: %u request blocks, %u registers, %u alarms, %u undecodable frames, %u keyframe requests\n",
+         net.requests, net.registers, net.alarms, net.undecodable, net.keyframeRequests);
+  printf("Check: %u/%u decoded requests match what was sent, %u narrowed field values among them\n",
+         checkedRequests - mismatches, checkedRequests, checkedFields);
+  return mismatches == 0 ? 0 : 1;
+}
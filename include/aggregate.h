@@ -0,0 +1,28 @@
+#pragma once
+#include <Arduino.h>
+#include "config.h"
+#include "arena.h"
+
+struct RegisterStats {
+  uint16_t min;
+  uint16_t max;
+  uint32_t sum;
+};
+
+// Running statistics of one request over the current uplink window. Fixed
+// size per register, so the window can be as long as it likes; only
+// requests with "stats" get registers, in the request table arena.
+struct RequestStats {
+  uint16_t count;  // successful scans in the window
+  RegisterStats* regs;
+};
+
+size_t aggregateArenaBytes();
+void bindAggregates(Arena& arena);
+void accumulateScan();
+void takeAggregates();
+const RequestStats& windowStats(int requestIndex);
+
+bool requestReportable(const ModbusRequest& req, int requestIndex);
+uint16_t statsLength(const ModbusRequest& req);
+uint16_t encodeRequestStats(const ModbusRequest& req, int requestIndex, uint8_t* out);
@@ -0,0 +1,21 @@
+#pragma once
+#include <Arduino.h>
+#include "txqueue.h"
+
+#define LORAWAN_OVERHEAD 13    // MHDR + FHDR + FPort + MIC around the app payload
+#define JOIN_REQUEST_LEN 23    // whole PHY payload of a join request
+#define AIRTIME_BUCKETS 24     // resolution of the rolling window
+
+uint32_t timeOnAirMs(uint8_t sf, uint32_t bandwidthHz, uint8_t phyPayloadLen);
+uint32_t currentTimeOnAirMs(uint8_t appPayloadLen);
+
+void recordAirtime(uint32_t ms);
+uint32_t airtimeUsedMs();
+bool airtimeAllows(TxPriority priority, uint8_t appPayloadLen);
+
+void startIntervalEstimate();
+void addIntervalFrame(uint8_t appPayloadLen);
+void finishIntervalEstimate();
+unsigned long effectiveUplinkInterval();
+
+void printAirtimeStatus();
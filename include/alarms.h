@@ -0,0 +1,58 @@
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "config.h"
+#include "fields.h"
+#include "arena.h"
+
+#define MAX_ALARM_RULES (MAX_REQUESTS * MAX_ALARMS_PER_REQUEST)
+#define MAX_ALARM_TERMS (MAX_ALARM_RULES * 2)
+#define MAX_TERMS_PER_RULE 4
+
+enum AlarmOp : uint8_t {
+  ALARM_OP_GT,
+  ALARM_OP_LT,
+  ALARM_OP_EQ,
+  ALARM_OP_RATE  // |change| per second
+};
+
+// One comparison against a single register, or against the decoded value of
+// the typed field starting there. Its latched state carries the hysteresis:
+// a term only clears once the value is back past the deadband.
+struct AlarmTerm {
+  uint8_t request;     // requests[] index
+  uint8_t index;       // register of the request, see requestValue()
+  int8_t field;        // fields[] index, -1 = raw register
+  AlarmOp op;
+  float threshold;
+  float hysteresis;
+  bool active;
+  bool hasLast;        // rate terms need one earlier sample
+  float lastValue;
+  unsigned long lastAt;
+  float measured;      // value (or rate) seen by the last evaluation
+};
+
+// A rule fires once when its terms (all of them, or any one) have held for
+// debounceMs, and re-arms as soon as they stop holding.
+struct AlarmRule {
+  uint8_t firstTerm;
+  uint8_t termCount;
+  bool any;
+  bool active;
+  uint32_t debounceMs;
+  unsigned long holdingSince;  // 0 = not holding
+};
+
+// Sized to what compiled, in the request table arena
+extern AlarmRule* alarmRules;
+extern int alarmRuleCount;
+extern AlarmTerm* alarmTerms;
+extern int alarmTermCount;
+
+void clearAlarmRules();  // back to full-size scratch tables for a loader to fill
+size_t alarmArenaBytes();
+void bindAlarmRules(Arena& arena);
+int compileAlarmRules(uint8_t requestIndex, JsonArray rules);
+void validateAlarmRules();
+void evaluateAlarmRules();
@@ -0,0 +1,29 @@
+#pragma once
+#include <Arduino.h>
+#include <cstddef>
+
+// One heap block carved up by bumping a pointer. Nothing is freed on its
+// own: the whole block goes at the next arenaReset(), so a config reload
+// leaves no fragments behind.
+struct Arena {
+  uint8_t* base;
+  size_t size;
+  size_t used;
+};
+
+bool arenaReset(Arena& arena, size_t bytes);  // drops everything, then reserves bytes
+void* arenaAlloc(Arena& arena, size_t bytes);  // aligned for any type, nullptr once full
+
+// Every allocation keeps the alignment malloc() gave the block, so structs
+// holding pointers or 64-bit members stay aligned on the native build too
+#define ARENA_ALIGN alignof(std::max_align_t)
+
+// What arenaAlloc() will take for an object of this size
+inline size_t arenaSize(size_t bytes) {
+  return (bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+}
+
+template <typename T>
+T* arenaArray(Arena& arena, size_t count) {
+  return static_cast<T*>(arenaAlloc(arena, count * sizeof(T)));
+}
@@ -0,0 +1,10 @@
+#pragma once
+#include <Arduino.h>
+
+#define BOOT_MAX_MARKS 16
+
+// Boot phase timestamps, in µs since the app started. Each phase name is
+// recorded the first time it is marked; later marks are ignored, so hot
+// paths can mark "first ..." phases unconditionally.
+void bootMark(const char* phase);
+void printBootProfile();
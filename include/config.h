@@ -13,8 +13,9 @@
 #define LORA_DIO0_PIN 11
 #define LORA_DIO1_PIN 8
 
-#define MAX_REQUESTS 16
-#define MAX_ALARMS_PER_REQUEST 4
+#define MAX_REQUESTS 16           // entries in modbus.json; storage is sized to the table, see table.h
+#define MAX_REQUEST_REGS 125      // one read PDU per request
+#define MAX_ALARMS_PER_REQUEST 4  // alarm rules, see alarms.h
 
 enum ModbusFunction {
   READ_HREG = 3,
@@ -23,13 +24,32 @@ enum ModbusFunction {
   READ_DISCRETE_INPUTS = 2
 };
 
-struct AlarmCondition {
-    uint8_t index;        // result[] index
-    char op;              // '>', '<', '='
-    uint16_t threshold;
-    bool active = false;  // track edge triggering
-    bool pending;
-  };
+// Per-request statistics sent for each uplink window ("stats" in modbus.json)
+#define STAT_LAST  0x01
+#define STAT_MIN   0x02
+#define STAT_MAX   0x04
+#define STAT_MEAN  0x08
+#define STAT_COUNT 0x10
+
+// Periodic uplink formats, selected by "encoding" in lora.json
+enum PayloadEncoding { ENCODING_FULL, ENCODING_SCHEMA, ENCODING_DELTA };
+
+enum AlarmSource { ALARM_SOURCE_MODBUS, ALARM_SOURCE_INPUT };
+
+// Everything the radio task needs to build an alarm uplink, so it never has
+// to look back into the request table
+struct AlarmEvent {
+  AlarmSource source;
+  IPAddress slaveIP;
+  uint8_t unitID;
+  uint16_t reg;
+  char op;
+  uint16_t threshold;
+  uint16_t value;
+  uint8_t inputIndex;
+  uint8_t expected;
+  uint8_t actual;
+};
   
   
   struct ModbusRequest {
@@ -37,11 +57,13 @@ struct AlarmCondition {
     uint8_t unitID;
     uint16_t startReg;
     uint8_t numRegs;
-    uint16_t result[16];
+    uint16_t valueOffset;  // first slot in a value store, see requestValue()
+    uint32_t intervalMs;   // 0 = every MODBUS_SCAN_INTERVAL
+    int32_t phaseMs;       // offset into the interval, -1 = placed by the scheduler
+    bool fresh;            // read in the poll that just finished
     bool success;
     ModbusFunction function;
-    AlarmCondition alarms[4];
-    uint8_t alarmCount;
+    uint8_t stats;  // STAT_* mask
   
     ModbusRequest(
       IPAddress ip = IPAddress(0, 0, 0, 0),
@@ -54,19 +76,48 @@ struct AlarmCondition {
       unitID(unit),
       startReg(start),
       numRegs(count),
+      valueOffset(0),
+      intervalMs(0),
+      phaseMs(-1),
+      fresh(false),
       success(false),
       function(func),
-      alarmCount(0)
+      stats(STAT_LAST)
     {
-      memset(result, 0, sizeof(result));
-      memset(alarms, 0, sizeof(alarms));
     }
   };
-  
-
 
-extern ModbusRequest requests[MAX_REQUESTS];
+inline bool isBitFunction(ModbusFunction f) {
+  return f == READ_COILS || f == READ_DISCRETE_INPUTS;
+}
+
+// A value store holds every request's values back to back: one slot per
+// register, or the coils/inputs of a bit request packed 16 to a slot
+inline uint16_t requestValueSlots(const ModbusRequest& req) {
+  return isBitFunction(req.function) ? (req.numRegs + 15) / 16 : req.numRegs;
+}
+
+inline uint16_t requestValue(const uint16_t* store, const ModbusRequest& req, int r) {
+  const uint16_t* v = store + req.valueOffset;
+  return isBitFunction(req.function) ? (v[r >> 4] >> (r & 15)) & 1 : v[r];
+}
+
+inline void setRequestValue(uint16_t* store, const ModbusRequest& req, int r, uint16_t value) {
+  uint16_t* v = store + req.valueOffset;
+  if (!isBitFunction(req.function)) {
+    v[r] = value;
+  } else if (value) {
+    v[r >> 4] |= 1 << (r & 15);
+  } else {
+    v[r >> 4] &= ~(1 << (r & 15));
+  }
+}
+
+// Built from modbus.json (or the config image) inside the request table
+// arena, see table.h
+extern ModbusRequest* requests;
 extern int requestCount;
+extern uint16_t* requestValues;  // live values, written as blocks complete
 
 extern IPAddress ETH_IP, ETH_GATEWAY, ETH_SUBNET, ETH_DNS;
 extern bool useDHCP;
@@ -75,6 +126,8 @@ extern bool enableEthernet;
 
 
 extern unsigned long MODBUS_SCAN_INTERVAL;
+extern unsigned long MODBUS_REQUEST_TIMEOUT;  // per-request reply timeout (ms)
+extern uint16_t MODBUS_MAX_GAP;               // registers the planner may read through
 extern unsigned long LORA_UPLINK_INTERVAL;
 
 
@@ -102,4 +155,9 @@ extern uint8_t MAC_ADDR[6];
 extern uint8_t LORA_SF;  // e.g., 7–12 for SF7 to SF12
 extern bool LORA_ADR; // Yes please
 extern uint8_t LORA_SUBBAND; // 4 for australia
+extern uint8_t LORA_ENCODING; // PayloadEncoding used for periodic uplinks
+extern uint16_t LORA_KEYFRAME_EVERY;
+extern unsigned long LORA_AIRTIME_BUDGET;  // ms on air allowed per window, 0 = unlimited
+extern unsigned long LORA_AIRTIME_WINDOW;  // ms
+extern unsigned long LORA_DIAG_INTERVAL;   // ms between diagnostic uplinks, 0 = off
 
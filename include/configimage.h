@@ -0,0 +1,78 @@
+#pragma once
+#include <Arduino.h>
+#include "config.h"
+#include "alarms.h"
+#include "fields.h"
+
+// Compiled form of ethernet.json, lora.json, modbus.json and inputs.json,
+// written to the "cfgimg" partition after a JSON load and memory-mapped at
+// the next boot. The header records a CRC-32 of each JSON source, so editing
+// any of them sends the next boot back through the JSON parsers.
+#define CONFIG_IMAGE_PARTITION "cfgimg"
+#define CONFIG_IMAGE_MAGIC 0x49474643  // "CFGI"
+#define CONFIG_IMAGE_VERSION 1
+#define CONFIG_SOURCE_COUNT 4
+
+struct ConfigImageHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t layout;     // sizeof(ConfigImageBody), rejects images from other builds
+  uint32_t length;
+  uint32_t crc;        // CRC-32 of the body
+  uint32_t sources[CONFIG_SOURCE_COUNT];
+};
+
+struct ImageRequest {
+  uint32_t ip;
+  uint16_t startReg;
+  uint8_t unitID;
+  uint8_t numRegs;
+  uint8_t function;
+  uint8_t stats;
+  uint32_t intervalMs;
+  int32_t phaseMs;
+};
+
+struct ConfigImageBody {
+  // ethernet.json
+  uint8_t mac[6];
+  bool enableEthernet;
+  bool useDHCP;
+  uint32_t ip, gateway, subnet, dns;
+
+  // lora.json
+  bool joinABP;
+  bool adr;
+  uint8_t subband;
+  uint8_t sf;
+  uint8_t encoding;
+  uint8_t devEui[8], appEui[8], appKey[16];
+  uint8_t nwkSKey[16], appSKey[16];
+  uint32_t devAddr;
+  uint32_t uplinkInterval;
+  uint16_t keyframeEvery;
+  uint32_t airtimeBudget;
+  uint32_t airtimeWindow;
+  uint32_t diagInterval;
+
+  // modbus.json, with alarm rules and fields already compiled
+  uint32_t scanInterval;
+  uint32_t requestTimeout;
+  uint16_t maxGap;
+  uint8_t requestCount;
+  uint8_t fieldCount;
+  uint16_t ruleCount;
+  uint16_t termCount;
+  ImageRequest requests[MAX_REQUESTS];
+  FieldDesc fields[MAX_FIELDS];
+  AlarmRule rules[MAX_ALARM_RULES];
+  AlarmTerm terms[MAX_ALARM_TERMS];
+
+  // inputs.json
+  uint8_t inputCount;
+  InputConfig inputs[MAX_INPUTS];
+};
+
+void loadConfig(bool allowImage);
+bool loadConfigImage();
+void compileConfigImage();
@@ -0,0 +1,25 @@
+#pragma once
+#include <Arduino.h>
+#include "snapshot.h"
+#include "arena.h"
+
+#define DELTA_FPORT 3
+#define DELTA_CMD_KEYFRAME 0x01  // downlink on DELTA_FPORT asking for a keyframe
+
+// Delta frame layout (fPort 3), one or more frames per uplink interval:
+//   [seq][base][firstReq][reqCount | 0x80 on the final frame]
+//   [success bitmap][raw bitmap]            ceil(reqCount/8) bytes each
+//   per successful request, in table order:
+//     raw   -> numRegs big-endian words
+//     delta -> changed-register bitmap + zigzag varint (value - base value)
+//   final frame only: the usual 0xFF input section
+// base == seq marks a keyframe, where every successful request is raw.
+// Deltas are always taken against the last interval whose frames were all
+// acknowledged; a request missing from that base counts as all zeros. A
+// request whose piece does not fit a frame on its own is marked failed.
+
+uint16_t deltaFrameLength(const ModbusRequest& req);  // a frame carrying only this request, raw
+size_t deltaArenaBytes(uint16_t valueSlots);
+void bindDelta(Arena& arena, uint16_t valueSlots);
+void sendDeltaUplink(const RegisterSnapshot& snap, const uint8_t* inputSection, uint8_t inputLen, uint16_t mtu);
+void requestKeyframe();
@@ -0,0 +1,17 @@
+#pragma once
+#include <Arduino.h>
+
+// Uplink frame counter kept in NVS. NVS appends each write to a journal page
+// and wear-levels across the partition; on top of that the counter is only
+// committed every FCNT_COMMIT_EVERY frames. A reboot resumes
+// FCNT_SKIP_AHEAD past the last commit, which is always beyond any counter
+// the previous session could have used.
+#define FCNT_NAMESPACE "lorawan"
+#define FCNT_KEY "fcntUp"
+#define FCNT_LEGACY_FILE "/fcnt.txt"
+#define FCNT_COMMIT_EVERY 16
+#define FCNT_SKIP_AHEAD (2 * FCNT_COMMIT_EVERY)
+
+void restoreFrameCounter();                // after the ABP session is set up
+void noteFrameCounter(uint32_t seqnoUp);   // EV_TXCOMPLETE, no flash I/O
+void serviceFrameCounter();                // radio task, outside the LMIC callback
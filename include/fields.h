@@ -0,0 +1,51 @@
+#pragma once
+#include <Arduino.h>
+#include <ArduinoJson.h>
+#include "config.h"
+
+#define MAX_FIELDS 32
+
+#define FIELD_WORD_SWAP 0x01  // low word first
+#define FIELD_BYTE_SWAP 0x02  // bytes swapped inside each word
+
+enum FieldType : uint8_t {
+  FIELD_UINT16,
+  FIELD_INT16,
+  FIELD_UINT32,
+  FIELD_INT32,
+  FIELD_FLOAT32
+};
+
+// How a field travels in schema data frames. RAW keeps the register words,
+// the narrow forms carry round(value) clamped to the type's range.
+enum FieldUplink : uint8_t {
+  FIELD_UPLINK_RAW,
+  FIELD_UPLINK_INT16,
+  FIELD_UPLINK_INT8
+};
+
+// A typed value spanning one or two registers of a request, declared in the
+// request's "fields" array in modbus.json. value = decoded * scale + offset.
+struct FieldDesc {
+  uint8_t request;   // requests[] index
+  uint8_t index;     // first register of the request
+  FieldType type;
+  uint8_t flags;
+  FieldUplink uplink;
+  float scale;
+  float offset;
+};
+
+extern FieldDesc fields[MAX_FIELDS];
+extern int fieldCount;
+extern float fieldValues[MAX_FIELDS];  // typed cache, refreshed by decodeFields()
+
+void clearFields();
+int compileFields(uint8_t requestIndex, JsonArray arr);
+void validateFields();
+void decodeFields();
+int findField(const FieldDesc* table, int count, uint8_t request, uint8_t index);
+
+uint8_t fieldWords(FieldType type);
+uint8_t fieldUplinkLength(const FieldDesc& f);
+uint8_t encodeFieldUplink(const FieldDesc& f, float value, uint8_t* out);
@@ -30,5 +30,3 @@ void loadModbusConfigFromFlash(const char* configPath = "/modbus.json");
 void writeDefaultConfigs();
 
 void loadInputsConfig(const char* path = "/inputs.json");
-void loadFrameCounter();
-void saveFrameCounter();
\ No newline at end of file
@@ -0,0 +1,84 @@
+#pragma once
+#include <Arduino.h>
+#include "config.h"
+
+// Thin seams between the application and the hardware under it. The board
+// build implements them in src/hal_esp32.cpp on top of LittleFS,
+// ModbusEthernet/W5500 and LMIC; the host build (env:native) implements them
+// in native/src/hal_native.cpp. Nothing outside those two files may include
+// a driver header.
+
+// ----- Clock -----
+// Application code keeps calling millis()/micros(); on the host the Arduino
+// shim forwards those here so simulations can run on a virtual clock.
+uint32_t halMillis();
+uint32_t halMicros();
+
+// ----- GPIO -----
+void halPinInput(uint8_t pin);
+bool halPinRead(uint8_t pin);
+uint64_t halPinReadMask(uint64_t mask);  // levels of GPIO 0..63 in one go, bit n = GPIO n
+
+// ----- Pulse counters -----
+// Rising edges counted in hardware, however late the tasks run. Pulses
+// shorter than filterNs are ignored (the board clamps it to what the filter
+// can do); totals are 64-bit and never wrap.
+#define HAL_PULSE_CHANNELS 4
+bool halPulseCounterBegin(uint8_t channel, uint8_t pin, uint32_t filterNs);
+void halPulseCounterEnd(uint8_t channel);
+uint64_t halPulseCounterTotal(uint8_t channel);
+
+// ----- Filesystem -----
+bool halFsMount();             // formats once if the mount fails
+bool halFileExists(const char* path);
+bool halFileRead(const char* path, String& out);
+bool halFileWrite(const char* path, const String& content, bool append);
+bool halFileRemove(const char* path);
+
+// ----- Network and Modbus TCP client -----
+// Result codes keep the Modbus::ResultCode values, so logs read the same
+#define HAL_MODBUS_OK              0x00
+#define HAL_MODBUS_TIMEOUT         0xE4
+#define HAL_MODBUS_CONNECTION_LOST 0xE5
+
+// One completion handler for every transaction. It fires from
+// halModbusTask() only, never from inside halModbusRead().
+typedef void (*HalModbusCallback)(uint8_t result, uint16_t transactionId);
+
+void halNetworkInit();         // bus and controller, needs no config
+bool halNetworkLinkUp();
+bool halNetworkBeginDhcp(const uint8_t* mac);
+bool halNetworkBeginStatic(const uint8_t* mac, IPAddress ip, IPAddress dns, IPAddress gateway, IPAddress subnet);
+IPAddress halNetworkLocalIP();
+
+void halModbusBegin(uint16_t connectTimeoutMs, HalModbusCallback onReply);
+bool halModbusConnected(IPAddress ip);
+bool halModbusConnect(IPAddress ip);
+void halModbusDisconnect(IPAddress ip);
+// Queues a read; words for registers, bits for coils and discrete inputs.
+// Returns the transaction ID, 0 if the request could not be queued.
+uint16_t halModbusRead(IPAddress ip, uint8_t unit, ModbusFunction function, uint16_t start, uint16_t count,
+                       uint16_t* words, bool* bits);
+void halModbusTask();
+void halModbusDropTransactions();
+
+// ----- LoRaWAN radio -----
+void halRadioInit();           // pins and MAC reset, needs no config
+void halRadioReset();          // pulses the transceiver reset line
+void halRadioConfigure(bool adr, uint8_t subband, uint8_t sf);
+void halRadioStartAbp(uint32_t devAddr, const uint8_t* nwkSKey, const uint8_t* appSKey);
+void halRadioStartJoin();
+void halRadioRunOnce();        // radio task, every pass
+bool halRadioBusy();           // a TX/RX cycle is still pending
+bool halRadioSend(uint8_t port, const uint8_t* data, uint8_t len, bool confirmed);
+void halRadioCancel();
+uint8_t halRadioSF();
+uint32_t halRadioBandwidth();
+uint32_t halRadioFrameCounter();
+void halRadioSetFrameCounter(uint32_t seqnoUp);
+
+// Radio events, implemented by the application (lora.cpp) and called from
+// halRadioRunOnce() on the radio task
+void onRadioTxStart(uint32_t freqHz);
+void onRadioJoined();
+void onRadioTxComplete(bool acked, uint32_t seqnoUp, uint8_t port, const uint8_t* data, uint8_t len);
@@ -2,19 +2,49 @@
 #include <Arduino.h>
 #include "config.h"
 
+#define MAX_INPUTS 32                  // channels in inputs.json, one bit each
+#define MAX_COUNTER_INPUTS 7           // counters whose input section still fits a schema frame at SF10+
+#define INPUT_DEFAULT_FILTER_NS 10000  // counters ignore pulses shorter than this
+#define INPUT_MAX_PIN 63               // GPIOs one batched read can cover
+#define INPUT_SECTION_MAX (3 + MAX_INPUTS / 8 + MAX_COUNTER_INPUTS * 5)
+
 enum InputType { DIGITAL, COUNTER };
 
+// Counters are counted by a hardware pulse counter channel while channels
+// last, so no pulse depends on when the inputs task runs; any further
+// counters fall back to edges seen by the inputs task.
 struct InputConfig {
   uint8_t pin;
   InputType type;
   bool alarmActive;
   uint8_t alarmExpected;
-  uint32_t counterValue = 0;
-  bool lastState = false;
+  uint32_t filterNs = INPUT_DEFAULT_FILTER_NS;
+  int8_t pulseChannel = -1;   // -1 = sampled by the inputs task
+  uint32_t counterValue = 0;  // pulses since the last uplink
+  uint64_t counterTotal = 0;  // pulses since the counter was set up
+  uint64_t counterBase = 0;   // counterTotal at the last uplink
+  uint64_t channelBase = 0;   // counterTotal when its pulse counter channel started
+};
+
+// What one uplink reports: every level as a bitmap, and the counters
+struct InputSnapshot {
+  uint8_t count;
+  uint32_t levels;  // bit i = input i
+  uint8_t counterCount;
+  uint8_t counterIndex[MAX_COUNTER_INPUTS];
+  uint32_t counterValue[MAX_COUNTER_INPUTS];
 };
 
-extern InputConfig inputConfigs[2];  // <-- This is the actual definition
+// The live table, replaced only by applyInputs(); the inputs task reads it
+// under the inputs lock
+extern InputConfig inputConfigs[MAX_INPUTS];
+extern uint8_t inputCount;
 
+// Loaders parse into a table of their own and hand it over here, from any
+// task; only the configuration fields of each entry are used. A counter on
+// the same pin as before keeps its total and the pulses not yet uplinked.
+void applyInputs(const InputConfig* table, uint8_t count);
 void resetCounters();
+void snapshotInputs(InputSnapshot& out, bool clearCounters);
 void handleDigitalInputs();
-void checkInputAlarms();
\ No newline at end of file
+void checkInputAlarms();
@@ -1,18 +1,30 @@
 #pragma once
-#include <lmic.h>
-#include <hal/hal.h>
 #include "inputs.h"
+#include "txqueue.h"
+
+#define ALARM_FPORT 2
+#define ALARM_TX_POLICY (TxPolicy{ 3, 600000, true })  // 10 min in the queue, then the flash store
+#define ALARM_BATCH_WINDOW_MS 200  // lets every alarm tripped by one scan share a frame
+
+// Alarm records, see encodeAlarmRecord(): a Modbus one is the slave IP,
+// unit, register, op, threshold and value; an input one is 0xFF, index,
+// expected and actual
+#define ALARM_MODBUS_RECORD_LEN (4 + sizeof(AlarmEvent::unitID) + sizeof(AlarmEvent::reg) + sizeof(AlarmEvent::op) + \
+                                 sizeof(AlarmEvent::threshold) + sizeof(AlarmEvent::value))
+#define ALARM_INPUT_RECORD_LEN 4
+#define ALARM_RECORD_MAX ALARM_MODBUS_RECORD_LEN
+static_assert(ALARM_INPUT_RECORD_LEN <= ALARM_RECORD_MAX, "alarm record buffer too small for an input record");
 
 void initLoRa();
-void resetLoRaChip();
 void sendLoRaUplink();
-void onEvent(ev_t ev);
 void applyLoRaConfig();
 void checkAlarmUplink();
-void sendAlarmUplink(const ModbusRequest& req, const AlarmCondition& alarm, uint16_t value); //For Modbus
-void sendAlarmUplink(uint8_t inputIndex, uint8_t expected, uint8_t actual); //For Digital inputs
+uint8_t encodeAlarmRecord(const AlarmEvent& ev, uint8_t* out);
 
 uint8_t getCurrentSF();
+uint32_t getCurrentBandwidth();
 uint16_t getMaxMTU(uint8_t sf);
-void sendLoRaPayloadChunk(uint8_t* payload, uint8_t len);
+#define LORA_MIN_MTU 51  // getMaxMTU() at SF10-12
+bool sendLoRaPayloadChunk(uint8_t* payload, uint8_t len, uint8_t port = 1,
+                          TxDoneCallback onDone = nullptr, uint32_t tag = 0);  // true once queued
 
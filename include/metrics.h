@@ -0,0 +1,57 @@
+#pragma once
+#include <Arduino.h>
+#include "config.h"
+
+#define DIAG_FPORT 6
+#define DIAG_FORMAT_VERSION 1
+#define METRIC_BUCKETS 16  // bucket 0 holds 0, bucket k holds [2^(k-1), 2^k), the last one everything above
+
+// Event counts since boot (or the last "stats reset")
+enum MetricCounter {
+  METRIC_SCANS = 0,
+  METRIC_READ_OK,          // block reads answered with data
+  METRIC_READ_TIMEOUT,
+  METRIC_READ_ERROR,       // exception replies and lost connections
+  METRIC_READ_SKIPPED,     // slave not connected, or the client had no room
+  METRIC_UPLINKS,          // uplink intervals built
+  METRIC_FRAMES_QUEUED,
+  METRIC_QUEUE_REJECTED,   // sendLoRaPayloadChunk() found the TX queue full
+  METRIC_TX,               // transmissions started, joins and retries included
+  METRIC_TX_ACKED,
+  METRIC_TX_UNACKED,
+  METRIC_DOWNLINKS,
+  METRIC_ALARMS_SENT,
+  METRIC_INPUT_PULSES,
+  METRIC_INPUT_ALARMS,
+  METRIC_COUNTER_COUNT
+};
+
+// Power-of-two histograms; the unit is part of the name
+enum MetricHistogram {
+  METRIC_READ_MS = 0,      // issue to reply or timeout, per block
+  METRIC_SCAN_MS,
+  METRIC_SCAN_LATE_MS,     // poll start past the due time of its earliest block
+  METRIC_ENQUEUE_US,       // time spent in sendLoRaPayloadChunk()
+  METRIC_UPLINK_BUILD_US,  // time spent in sendLoRaUplink()
+  METRIC_TX_MS,            // TX start to TX complete, RX windows included
+  METRIC_RADIO_GAP_MS,     // between radio task passes
+  METRIC_INPUT_LATE_MS,    // input sample past INPUT_SAMPLE_MS
+  METRIC_HISTOGRAM_COUNT
+};
+
+// Counters and histograms are updated under one spinlock from any task; each
+// update is a few adds, cheap enough for the scan and radio paths
+void metricCount(MetricCounter counter, uint32_t n = 1);
+void metricRecord(MetricHistogram histogram, uint32_t value);
+void metricRequest(int request, bool ok, uint32_t latencyMs);  // once per request per scan
+
+void resetMetrics();
+void resetRequestMetrics();  // request indices change when the table is reloaded
+void printMetrics();
+
+// Condensed window since the previous diagnostic frame, on DIAG_FPORT:
+//   version, uptime min[3], counters u16[METRIC_COUNTER_COUNT] (saturating),
+//   per histogram p50 << 4 | p95 bucket, failed request mask[2], SF, TX queue depth
+#define DIAG_FRAME_LEN (4 + 2 * METRIC_COUNTER_COUNT + METRIC_HISTOGRAM_COUNT + 4)
+uint8_t buildDiagnosticFrame(uint8_t* out);
+void checkDiagnosticUplink();  // radio task; sends every LORA_DIAG_INTERVAL ms when set
@@ -2,5 +2,6 @@
 #include <Arduino.h>
 
 void initEthernet();
-void pollModbus();
+bool pollDueModbus();  // the blocks the schedule says are due, false if none were
+void serviceModbusConnections();
 void printIP();
\ No newline at end of file
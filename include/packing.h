@@ -0,0 +1,20 @@
+#pragma once
+#include <Arduino.h>
+#include "config.h"
+
+#define MAX_PACK_ITEMS (MAX_REQUESTS + 1)  // every request block plus the input section
+#define PACK_REJECTED 0xFF                 // frameOf an item larger than a whole frame
+
+// Assignment of encoded blocks to uplink frames. Blocks keep their table
+// order inside a frame; only the frame they land in is decided here. A block
+// larger than the capacity is not placed at all, so no frame ever exceeds it.
+struct PackingPlan {
+  uint16_t capacity;
+  uint8_t itemCount;
+  uint8_t frameCount;
+  uint16_t sizes[MAX_PACK_ITEMS];
+  uint8_t frameOf[MAX_PACK_ITEMS];
+};
+
+bool packingPlanValid(const PackingPlan& plan, const uint16_t* sizes, uint8_t count, uint16_t capacity);
+void planPacking(PackingPlan& plan, const uint16_t* sizes, uint8_t count, uint16_t capacity);
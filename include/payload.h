@@ -0,0 +1,43 @@
+#pragma once
+#include <Arduino.h>
+#include "snapshot.h"
+#include "txqueue.h"
+
+#define LEGACY_FPORT 1
+#define SCHEMA_ANNOUNCE_FPORT 4
+#define SCHEMA_DATA_FPORT 5
+
+#define SCHEMA_ENTRY_LEN 9  // ip[4], unit, start[2], count, function
+#define LEGACY_HEADER_LEN 10
+#define FIELD_ENTRY_LEN 12  // request, index, type | flags << 4, uplink, scale[4], offset[4]
+#define SCHEMA_FIELD_FLAG 0x80  // firstField shares the byte, so it stays below this
+#define SCHEMA_TX_POLICY (TxPolicy{ 3, 0, false })
+static_assert(MAX_FIELDS <= SCHEMA_FIELD_FLAG, "field index would overlap SCHEMA_FIELD_FLAG");
+
+// Requests with window statistics ("stats" in modbus.json) report the
+// STAT_* mask in bits 3..7 of their function byte, and their values are the
+// last values (if selected), then min, max and mean words per register
+// (each if selected), then a 2-byte count of successful scans in the window.
+//
+// Schema announcement (fPort 4), repeated until every frame is acked and
+// again whenever the request table changes:
+//   [schemaId hi][schemaId lo][firstReq][total requests] + 9-byte entries
+// followed, when modbus.json declares typed fields, by
+//   [schemaId hi][schemaId lo][0x80 | firstField][total fields] + 12-byte entries
+// whose scale and offset (big-endian float32) let the server turn a narrowed
+// value back into the decoded one: decoded = (value - offset) / scale
+// Schema data frame (fPort 5), frames filled by first-fit-decreasing:
+//   [schemaId hi][schemaId lo][included bitmap][success bitmap]
+//   values of each included, successful request in table order, with
+//   narrowed fields as big-endian int16/int8 in place of their registers
+//   then the usual 0xFF input section in whichever frame it was packed
+
+uint8_t buildInputSection(uint8_t* inputSection);
+uint16_t requestValuesLength(const ModbusRequest& req);
+uint16_t legacyBlockLength(const ModbusRequest& req);  // header and values, the most a request needs in any encoding
+uint16_t encodeRequestValues(const RegisterSnapshot& snap, int i, uint8_t* out);
+uint16_t computeSchemaId(const RegisterSnapshot& snap);
+
+void sendLegacyUplink(const RegisterSnapshot& snap, const uint8_t* inputSection, uint8_t inputLen, uint16_t mtu);
+void sendSchemaUplink(const RegisterSnapshot& snap, const uint8_t* inputSection, uint8_t inputLen, uint16_t mtu);
+bool announceSchema(const RegisterSnapshot& snap, uint16_t mtu);
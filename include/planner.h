@@ -0,0 +1,39 @@
+#pragma once
+#include <Arduino.h>
+#include "config.h"
+#include "arena.h"
+
+// Modbus protocol limits for a single read PDU
+#define MAX_PDU_REGS 125
+#define MAX_PDU_BITS 2000
+
+#define MAX_BLOCKS MAX_REQUESTS
+
+// One physical read on the wire. Several ModbusRequests may be served by
+// the same block when they target the same slave/unit/function, share an
+// interval and phase, and their register windows touch, overlap or sit
+// within MODBUS_MAX_GAP of each other.
+struct ModbusBlock {
+  IPAddress slaveIP;
+  uint8_t unitID;
+  ModbusFunction function;
+  uint16_t startReg;
+  uint16_t numRegs;
+  uint16_t poolOffset;
+  uint32_t intervalMs;  // of its requests, see schedule.h
+  int32_t phaseMs;
+  bool success;
+};
+
+extern ModbusBlock blocks[MAX_BLOCKS];
+extern int blockCount;
+extern uint8_t requestBlock[MAX_REQUESTS];  // block serving each request
+
+// Read buffers: one word pool shared by the register blocks and one bool
+// pool by the coil/discrete blocks, sized by the last plan
+void planModbusBlocks();
+size_t blockPoolArenaBytes();
+void bindBlockPools(Arena& arena);
+uint16_t* blockWords(const ModbusBlock& blk);
+bool* blockBits(const ModbusBlock& blk);
+void scatterBlock(int blockIndex);
@@ -0,0 +1,17 @@
+#pragma once
+#include <Arduino.h>
+#include "planner.h"
+
+// Hashed timing wheel over the planned blocks. Each block is due every
+// interval of its requests ("interval" in modbus.json, MODBUS_SCAN_INTERVAL
+// when unset), offset by their "phase". Blocks without a phase get the phase
+// whose reads, over their whole period, least often coincide with those
+// already placed, so reads spread out instead of bursting together.
+#define WHEEL_TICK_MS 50  // scheduling resolution
+#define WHEEL_SLOTS 64    // one turn; blocks due further out wait for their turn in a slot
+
+void planSchedule();  // after the blocks are planned; every block starts a fresh period
+
+// Blocks due at or before now, each already rescheduled for its next
+// period. lateMs is how long past its due time the earliest one is.
+int takeDueBlocks(unsigned long now, uint8_t* due, unsigned long& lateMs);
@@ -0,0 +1,32 @@
+#pragma once
+#include <Arduino.h>
+#include "config.h"
+
+#define MAX_SLAVES MAX_REQUESTS
+#define SLAVE_BACKOFF_MIN 500      // ms before the first reconnect attempt
+#define SLAVE_BACKOFF_MAX 30000    // ms, cap for the exponential backoff
+#define SLAVE_CONNECT_TIMEOUT 250  // ms a single W5500 connect may block
+
+enum SlaveState { SLAVE_DISCONNECTED, SLAVE_CONNECTED, SLAVE_BACKOFF };
+
+// One persistent Modbus TCP socket per distinct slave IP. Every unit ID
+// behind that IP is polled over the same connection.
+struct SlaveConnection {
+  IPAddress ip;
+  SlaveState state;
+  uint8_t unitCount;
+  uint16_t failures;          // consecutive failed connect attempts
+  unsigned long backoffMs;
+  unsigned long nextAttempt;
+  unsigned long connectedSince;
+  uint32_t reconnects;
+};
+
+extern SlaveConnection slaves[MAX_SLAVES];
+extern int slaveCount;
+
+void buildSlaveTable();
+void serviceSlaveConnections();
+bool slaveReady(IPAddress ip);
+void markSlaveLost(IPAddress ip);
+void printSlaveStatus();
@@ -0,0 +1,25 @@
+#pragma once
+#include <Arduino.h>
+#include "config.h"
+#include "fields.h"
+#include "arena.h"
+
+// Copy of the request table taken at the end of a Modbus scan. The uplink
+// encoder works from this so it never sees a half-written scan.
+struct RegisterSnapshot {
+  int count;
+  unsigned long takenAt;
+  ModbusRequest requests[MAX_REQUESTS];
+  const uint16_t* values;  // value store of requests[], see requestValue()
+  int fieldCount;
+  FieldDesc fields[MAX_FIELDS];
+  float fieldValues[MAX_FIELDS];
+};
+
+// The published copy and the reader's copy of the values sit in the request
+// table arena. There is a single reader, the radio task: its snapshot's
+// values stay valid until its next readSnapshot() or table rebuild.
+size_t snapshotArenaBytes(uint16_t valueSlots);
+void bindSnapshot(Arena& arena, uint16_t valueSlots);
+void publishSnapshot();
+void readSnapshot(RegisterSnapshot& out);
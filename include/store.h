@@ -0,0 +1,30 @@
+#pragma once
+#include <Arduino.h>
+#include "txqueue.h"
+
+// Persistent outbound queue on LittleFS for frames the network never
+// confirmed. Append-only segment files under STORE_DIR, each record
+//   [0xA5][port][len][crc16 hi][crc16 lo] + payload
+// with a sibling .ack file that grows by one byte per replayed record.
+// A segment is deleted once every record in it is acknowledged; when the
+// store is full the oldest segment is evicted whole.
+#define STORE_DIR "/sfq"
+#define STORE_SEGMENT_SIZE 4096
+#define STORE_MAX_SEGMENTS 16          // 64 KB of the filesystem
+#define STORE_QUEUE_LEN 4              // frames waiting to be written
+#define STORE_RETRY_MS 60000           // after a failed replay
+#define STORE_REPLAY_FPORT_BASE 64     // a frame first sent on port n replays on 64 + n
+#define STORE_REPLAY_POLICY (TxPolicy{ 1, 0, false })
+
+struct StoredFrame {
+  uint32_t id;
+  uint8_t port;
+  uint8_t len;
+  uint8_t data[TX_MAX_PAYLOAD];
+};
+
+void initStore();
+void serviceStore(uint32_t waitMs);   // store task only, does all the flash I/O
+void storeFrame(uint8_t port, const uint8_t* data, uint8_t len);  // never blocks
+void serviceReplay();                 // radio task
+void printStoreStatus();
@@ -0,0 +1,20 @@
+#pragma once
+#include <Arduino.h>
+#include "config.h"
+
+// The request table shares one arena with everything sized by it: the live
+// values, alarm rules and terms, the planner's read pools, the snapshot
+// copies, window statistics and delta state. A loader fills full-size
+// scratch tables after beginRequestTable(); buildRequestTable() then moves
+// what was loaded into an arena of exactly the size this configuration
+// needs and drops the scratch. Requests too large for the smallest uplink
+// frame are split first, see splitOversizeRequests().
+//
+// Rebuilding frees the previous arena once the new one is swapped in under
+// lockRequestTable(), so nothing may hold on to table memory outside that
+// lock across a reload (see tasks.h).
+
+void beginRequestTable();  // also clears the alarm rules
+bool buildRequestTable();  // false if the arena could not be allocated; the table is then empty
+bool requestTableBuilt();  // false until the first build, while the built-in defaults are in use
+size_t requestTableBytes();
@@ -0,0 +1,29 @@
+#pragma once
+#include <Arduino.h>
+#include "config.h"
+
+// Core 0 carries Ethernet/Modbus and the shell, core 1 the radio and inputs
+#define MODBUS_TASK_CORE 0
+#define SHELL_TASK_CORE  0
+#define RADIO_TASK_CORE  1
+#define INPUTS_TASK_CORE 1
+#define STORE_TASK_CORE  0
+
+#define INPUT_SAMPLE_MS  2
+#define ALARM_QUEUE_LEN  32
+
+void startHardwareInit();
+void waitHardwareInit();
+void startTasks();
+void requestConfigReload();
+
+// The radio task reads the request table arena (snapshot, window statistics,
+// delta state) while it builds uplinks. buildRequestTable() swaps a rebuilt
+// arena in under this lock; no-ops until startTasks().
+void lockRequestTable();
+void unlockRequestTable();
+
+// Alarm events travel from the Modbus and inputs tasks to the radio task
+bool postAlarm(const AlarmEvent& ev);
+bool nextAlarm(AlarmEvent& ev);
+int pendingAlarmCount();
@@ -0,0 +1,32 @@
+#pragma once
+#include <Arduino.h>
+
+#define TX_QUEUE_LEN 12
+#define TX_MAX_PAYLOAD 242
+#define TX_WATCHDOG_MS 30000  // give up on a frame LMIC never completes
+
+// Lower value wins. Alarms jump ahead of anything not yet on air.
+enum TxPriority {
+  TX_PRIORITY_ALARM = 0,
+  TX_PRIORITY_CONTROL,   // schema announcements
+  TX_PRIORITY_PERIODIC,
+};
+
+// Called once per entry when it leaves the queue: acked, or out of retries/expired
+typedef void (*TxDoneCallback)(uint32_t tag, bool acked);
+
+struct TxPolicy {
+  uint8_t retries;       // extra attempts after an unacknowledged transmission
+  unsigned long ttlMs;   // dropped if still queued after this long, 0 = never
+  bool persist;          // hand to the flash store if it leaves unconfirmed
+};
+
+bool txEnqueue(const uint8_t* data, uint8_t len, uint8_t port, TxPriority priority, TxPolicy policy,
+               TxDoneCallback onDone = nullptr, uint32_t tag = 0);
+void serviceTxQueue();
+void txOnComplete(bool acked);
+int txQueueDepth();
+int txQueuedCount(TxPriority priority);
+bool txInFlight();
+uint8_t txInFlightLength();
+void printTxQueue();
@@ -0,0 +1,258 @@
+#pragma once
+// Host stand-in for the parts of the Arduino-ESP32 core the portable modules
+// use: String, Print/Serial, byte helpers, the portMUX critical sections and
+// FreeRTOS queues.
+// Clock and GPIO calls go to the native HAL (native/src/hal_native.cpp).
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <thread>
+
+using std::min;
+using std::max;
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+
+#define highByte(w) ((uint8_t)((w) >> 8))
+#define lowByte(w) ((uint8_t)((w) & 0xff))
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+// ----- Clock and GPIO, routed to the native HAL -----
+uint32_t halMillis();
+uint32_t halMicros();
+
+inline unsigned long millis() { return halMillis(); }
+inline unsigned long micros() { return halMicros(); }
+void delay(uint32_t ms);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+int digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t level);
+
+// ----- FreeRTOS -----
+inline void taskYIELD() { std::this_thread::yield(); }
+
+// Critical sections are a spinlock, so host programs may run the Modbus and
+// radio loops on threads
+struct portMUX_TYPE {
+  std::atomic<bool> locked;
+};
+#define portMUX_INITIALIZER_UNLOCKED {}
+
+inline void portENTER_CRITICAL(portMUX_TYPE* mux) {
+  while (mux->locked.exchange(true, std::memory_order_acquire)) {
+  }
+}
+inline void portEXIT_CRITICAL(portMUX_TYPE* mux) {
+  mux->locked.store(false, std::memory_order_release);
+}
+
+// Queues copy items in and out as FreeRTOS does and may be shared between
+// threads. Waits are wall-clock time, even on the virtual clock.
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+typedef struct HostQueue* QueueHandle_t;
+#define pdTRUE 1
+#define pdFALSE 0
+#define portMAX_DELAY 0xFFFFFFFFUL
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize);
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t wait);
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t wait);
+BaseType_t xQueuePeek(QueueHandle_t queue, void* item, TickType_t wait);
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue);
+
+// ----- String -----
+class String {
+ public:
+  String() {}
+  String(const char* cstr) : s(cstr ? cstr : "") {}
+  String(const String& other) = default;
+  explicit String(char c) : s(1, c) {}
+  explicit String(int value, unsigned char base = 10);
+  explicit String(unsigned int value, unsigned char base = 10);
+  explicit String(long value, unsigned char base = 10);
+  explicit String(unsigned long value, unsigned char base = 10);
+  explicit String(float value, unsigned int decimals = 2);
+  explicit String(double value, unsigned int decimals = 2);
+
+  String& operator=(const String& other) = default;
+  String& operator=(const char* cstr) {
+    s = cstr ? cstr : "";
+    return *this;
+  }
+
+  unsigned int length() const { return s.length(); }
+  bool isEmpty() const { return s.empty(); }
+  const char* c_str() const { return s.c_str(); }
+  bool reserve(unsigned int size) {
+    s.reserve(size);
+    return true;
+  }
+
+  bool concat(const String& str) {
+    s += str.s;
+    return true;
+  }
+  bool concat(const char* cstr) {
+    if (cstr) s += cstr;
+    return true;
+  }
+  bool concat(const char* cstr, unsigned int len) {
+    s.append(cstr, len);
+    return true;
+  }
+  bool concat(char c) {
+    s += c;
+    return true;
+  }
+  bool concat(int value) { return concat(String(value)); }
+  bool concat(unsigned int value) { return concat(String(value)); }
+  bool concat(long value) { return concat(String(value)); }
+  bool concat(unsigned long value) { return concat(String(value)); }
+  bool concat(double value) { return concat(String(value)); }
+
+  template <typename T>
+  String& operator+=(const T& rhs) {
+    concat(rhs);
+    return *this;
+  }
+
+  bool equals(const String& other) const { return s == other.s; }
+  bool equals(const char* cstr) const { return s == (cstr ? cstr : ""); }
+  bool operator==(const String& other) const { return equals(other); }
+  bool operator==(const char* cstr) const { return equals(cstr); }
+  bool operator!=(const String& other) const { return !equals(other); }
+  bool operator!=(const char* cstr) const { return !equals(cstr); }
+  bool operator<(const String& other) const { return s < other.s; }
+  bool equalsIgnoreCase(const String& other) const;
+
+  char charAt(unsigned int index) const { return index < s.length() ? s[index] : 0; }
+  char operator[](unsigned int index) const { return charAt(index); }
+  char& operator[](unsigned int index) { return s[index]; }
+
+  bool startsWith(const String& prefix) const { return s.compare(0, prefix.s.length(), prefix.s) == 0; }
+  bool endsWith(const String& suffix) const {
+    return s.length() >= suffix.s.length() && s.compare(s.length() - suffix.s.length(), suffix.s.length(), suffix.s) == 0;
+  }
+  int indexOf(char c, unsigned int from = 0) const;
+  int indexOf(const String& str, unsigned int from = 0) const;
+  int lastIndexOf(char c) const;
+  int lastIndexOf(const String& str) const;
+  String substring(unsigned int from) const { return substring(from, s.length()); }
+  String substring(unsigned int from, unsigned int to) const;
+
+  void replace(const String& find, const String& with);
+  void remove(unsigned int index) { remove(index, s.length()); }
+  void remove(unsigned int index, unsigned int count);
+  void toLowerCase();
+  void toUpperCase();
+  void trim();
+
+  long toInt() const { return atol(s.c_str()); }
+  float toFloat() const { return atof(s.c_str()); }
+  double toDouble() const { return atof(s.c_str()); }
+
+ private:
+  std::string s;
+};
+
+// Arduino's operator+ result type; ArduinoJson recognises it by name
+class StringSumHelper : public String {
+ public:
+  StringSumHelper(const String& str) : String(str) {}
+};
+
+template <typename T>
+inline StringSumHelper operator+(const String& lhs, const T& rhs) {
+  String sum(lhs);
+  sum.concat(rhs);
+  return sum;
+}
+inline StringSumHelper operator+(const char* lhs, const String& rhs) {
+  String sum(lhs);
+  sum.concat(rhs);
+  return sum;
+}
+
+// ----- Print / Serial -----
+class Print;
+
+class Printable {
+ public:
+  virtual ~Printable() {}
+  virtual size_t printTo(Print& p) const = 0;
+};
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buffer, size_t size);
+  size_t write(const char* str) { return str ? write((const uint8_t*)str, strlen(str)) : 0; }
+
+  size_t print(const String& s) { return write((const uint8_t*)s.c_str(), s.length()); }
+  size_t print(const char* str) { return write(str); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned char value, int base = 10) { return print((unsigned long)value, base); }
+  size_t print(int value, int base = 10) { return print((long)value, base); }
+  size_t print(unsigned int value, int base = 10) { return print((unsigned long)value, base); }
+  size_t print(long value, int base = 10);
+  size_t print(unsigned long value, int base = 10);
+  size_t print(double value, int decimals = 2);
+  size_t print(const Printable& p) { return p.printTo(*this); }
+
+  size_t println() { return write("\r\n"); }
+  template <typename T>
+  size_t println(const T& value) {
+    size_t n = print(value);
+    return n + println();
+  }
+  template <typename T>
+  size_t println(const T& value, int format) {
+    size_t n = print(value, format);
+    return n + println();
+  }
+
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+// Serial goes to stdout. Host programs can silence it around timed sections.
+class HardwareSerial : public Print {
+ public:
+  void begin(unsigned long) {}
+  void setQuiet(bool quiet) { this->quiet = quiet; }
+  int available() { return 0; }
+  int read() { return -1; }
+  int peek() { return -1; }
+  void flush() { fflush(stdout); }
+  operator bool() const { return true; }
+
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* buffer, size_t size) override;
+  using Print::write;
+
+ private:
+  bool quiet = false;
+};
+
+extern HardwareSerial Serial;
+
+#include "IPAddress.h"
@@ -0,0 +1,48 @@
+#pragma once
+#include "Arduino.h"
+
+// Same layout and conversions as the ESP32 core: octets in network order,
+// uint32_t view in host memory order
+class IPAddress : public Printable {
+ public:
+  IPAddress() : IPAddress(0, 0, 0, 0) {}
+  IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+    address.bytes[0] = a;
+    address.bytes[1] = b;
+    address.bytes[2] = c;
+    address.bytes[3] = d;
+  }
+  IPAddress(uint32_t dword) { address.dword = dword; }
+  IPAddress(const uint8_t* octets) { memcpy(address.bytes, octets, 4); }
+
+  operator uint32_t() const { return address.dword; }
+  bool operator==(const IPAddress& other) const { return address.dword == other.address.dword; }
+  bool operator!=(const IPAddress& other) const { return address.dword != other.address.dword; }
+  bool operator==(const uint8_t* octets) const { return memcmp(address.bytes, octets, 4) == 0; }
+
+  uint8_t operator[](int index) const { return address.bytes[index]; }
+  uint8_t& operator[](int index) { return address.bytes[index]; }
+
+  String toString() const {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%u.%u.%u.%u", address.bytes[0], address.bytes[1], address.bytes[2], address.bytes[3]);
+    return String(buf);
+  }
+
+  bool fromString(const char* text) {
+    unsigned a, b, c, d;
+    char tail;
+    if (sscanf(text, "%u.%u.%u.%u%c", &a, &b, &c, &d, &tail) != 4 || a > 255 || b > 255 || c > 255 || d > 255) return false;
+    *this = IPAddress(a, b, c, d);
+    return true;
+  }
+  bool fromString(const String& text) { return fromString(text.c_str()); }
+
+  size_t printTo(Print& p) const override { return p.print(toString()); }
+
+ private:
+  union {
+    uint8_t bytes[4];
+    uint32_t dword;
+  } address;
+};
@@ -0,0 +1,48 @@
+#pragma once
+#include <memory>
+#include <string>
+#include "Arduino.h"
+
+// Host stand-in for the LittleFS calls the store makes: files and
+// directories below the native HAL's filesystem root. A File is a shared
+// handle, closed when the last copy goes or close() is called.
+class File {
+ public:
+  File() {}
+
+  operator bool() const { return handle && (handle->file || handle->dir); }
+  const char* name() const { return handle ? handle->name.c_str() : ""; }
+  bool isDirectory() const { return handle && handle->dir; }
+  size_t size() const;
+
+  size_t write(uint8_t c) { return write(&c, 1); }
+  size_t write(const uint8_t* buffer, size_t size);
+  size_t read(uint8_t* buffer, size_t size);
+  bool seek(uint32_t pos);
+  void close() { handle.reset(); }
+
+  File openNextFile();
+
+ private:
+  struct Handle {
+    std::string path;  // device path
+    std::string name;
+    FILE* file = nullptr;
+    void* dir = nullptr;  // DIR*
+    ~Handle();
+  };
+  std::shared_ptr<Handle> handle;
+
+  friend class LittleFSClass;
+};
+
+class LittleFSClass {
+ public:
+  bool begin(bool formatOnFail = false) { return mkdir("/"); }
+  File open(const char* path, const char* mode = "r");
+  bool exists(const char* path);
+  bool mkdir(const char* path);
+  bool remove(const char* path);
+};
+
+extern LittleFSClass LittleFS;
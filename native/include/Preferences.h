@@ -0,0 +1,41 @@
+#pragma once
+#include <map>
+#include <string>
+#include "Arduino.h"
+
+// In-memory NVS: keys live for the life of the process
+class Preferences {
+ public:
+  bool begin(const char* name, bool readOnly = false) {
+    ns = name;
+    this->readOnly = readOnly;
+    return true;
+  }
+  void end() {}
+
+  bool isKey(const char* key) { return store()[ns].count(key) > 0; }
+  uint32_t getUInt(const char* key, uint32_t defaultValue = 0) {
+    auto& keys = store()[ns];
+    auto it = keys.find(key);
+    return it == keys.end() ? defaultValue : it->second;
+  }
+  size_t putUInt(const char* key, uint32_t value) {
+    if (readOnly) return 0;
+    store()[ns][key] = value;
+    return sizeof(value);
+  }
+  bool remove(const char* key) { return store()[ns].erase(key) > 0; }
+  bool clear() {
+    store()[ns].clear();
+    return true;
+  }
+
+ private:
+  static std::map<std::string, std::map<std::string, uint32_t>>& store() {
+    static std::map<std::string, std::map<std::string, uint32_t>> namespaces;
+    return namespaces;
+  }
+
+  std::string ns;
+  bool readOnly = false;
+};
@@ -0,0 +1,74 @@
+#pragma once
+#include <string>
+#include "hal.h"
+
+// Host-only controls for the native HAL, for the benchmark and simulators
+
+// Clock: the wall clock by default. On the virtual clock, time only moves
+// through halNativeAdvance() and delay().
+void halNativeUseVirtualClock(bool enabled);
+void halNativeAdvance(uint32_t ms);
+
+// GPIO: input levels the application reads back through halPinRead().
+// Rising edges also reach any pulse counter on the pin; halNativePulse()
+// delivers a burst too short for the pin level to ever show it.
+void halNativeSetPin(uint8_t pin, bool level);
+void halNativePulse(uint8_t pin, uint32_t count);
+
+// Filesystem: device paths map below this directory (default ".native_fs",
+// or $FYP_FS_ROOT). The LittleFS stand-in shares it.
+void halNativeSetFsRoot(const char* dir);
+std::string halNativeHostPath(const char* path);
+
+// Modbus: slaves are reached over TCP at their configured IP and this port
+// (502 by default). The hook sees every reply, with its latency.
+typedef void (*HalNativeModbusHook)(IPAddress ip, uint8_t unit, uint16_t start, uint8_t result, uint32_t latencyUs);
+void halNativeSetModbusPort(uint16_t port);
+void halNativeOnModbusReply(HalNativeModbusHook hook);
+
+// Radio: a loopback by default. Each frame handed to halRadioSend() is
+// reported here, then completes (acked) on the next halRadioRunOnce().
+typedef void (*HalNativeUplinkHook)(uint8_t port, const uint8_t* data, uint8_t len, bool confirmed);
+void halNativeOnUplink(HalNativeUplinkHook hook);
+void halNativeSetDataRate(uint8_t sf, uint32_t bandwidthHz);
+
+// With a network server attached, frames keep LoRaWAN class A timing on the
+// HAL clock (time on air, then RX1 or RX2) and the server decides whether
+// each one arrived, whether it is acked and what comes back down. Unacked
+// confirmed frames are retransmitted as LMIC does, each attempt with its own
+// airtime and receive windows; fcnt stays the same across attempts.
+struct HalNativeUplink {
+  uint32_t fcnt;
+  uint8_t port;
+  const uint8_t* data;
+  uint8_t len;
+  bool confirmed;
+  uint8_t sf;
+  uint32_t freqHz;
+  uint32_t airtimeMs;
+  bool adr;  // ADR bit of the uplink FCtrl
+};
+
+struct HalNativeDownlink {
+  bool ack;
+  uint8_t adrSF;  // LinkADRReq data rate as an SF, 0 = none
+  uint8_t port;
+  uint8_t data[64];
+  uint8_t len;
+};
+
+typedef void (*HalNativeNetworkServer)(const HalNativeUplink& up, HalNativeDownlink& down);
+void halNativeAttachNetworkServer(HalNativeNetworkServer server);
+
+struct HalNativeRadioStats {
+  uint32_t frames;      // every transmission, retransmissions included
+  uint32_t retransmissions;  // of unacked confirmed frames
+  uint32_t bytes;       // application payload
+  uint32_t airtimeMs;
+  uint32_t blockedMs;   // halRadioSend() to TX complete: nothing else can go out
+  uint32_t acked;
+  uint32_t downlinks;
+  uint32_t adrChanges;
+};
+
+void halNativeRadioStats(HalNativeRadioStats& out);
@@ -0,0 +1,74 @@
+#pragma once
+#include "hal_native.h"
+#include "config.h"
+#include "fields.h"
+#include "metrics.h"
+
+// Host stand-in for the LoRaWAN network server and the application decoder
+// behind it. It sits on the native radio: frames can be lost (fixed rate
+// and, with ADR, whenever the simulated SNR is below the demodulation floor
+// of the SF in use), confirmed frames are acked unless the ACK is lost, ADR
+// sends LinkADRReq like the Semtech reference algorithm, and every payload
+// is decoded the way the backend decoder does.
+
+struct NetServerConfig {
+  uint8_t lossPct = 0;      // uplinks that never arrive
+  uint8_t ackLossPct = 0;   // ACK downlinks that never reach the device
+  bool ack = true;          // answer confirmed uplinks
+  bool adr = true;          // run ADR for devices that set the ADR bit
+  float snrDb = 5;          // mean link SNR at the gateway
+  float snrJitterDb = 3;    // uniform spread around the mean
+  float installMarginDb = 10;
+  bool keyframeOnGap = true;  // ask for a delta keyframe when the base is missing
+  uint32_t seed = 1;
+};
+
+struct NetServerStats {
+  uint32_t received;
+  uint32_t duplicates;      // retransmissions of a frame already received, acked but not decoded again
+  uint32_t lost;
+  uint32_t bytes;
+  uint32_t acksSent;
+  uint32_t adrCommands;
+  uint32_t keyframeRequests;
+  uint32_t alarms;          // alarm records decoded
+  uint32_t requests;        // request blocks decoded, any format
+  uint32_t registers;       // register values decoded
+  uint32_t undecodable;     // frames the decoder could not make sense of
+  uint32_t diagnostics;     // diagnostic frames decoded
+  uint32_t framesByPort[DIAG_FPORT + 1];
+};
+
+// The latest diagnostic frame, as the backend would chart it
+struct NetServerDiagnostic {
+  uint32_t uptimeMin;
+  uint16_t counters[METRIC_COUNTER_COUNT];
+  uint8_t p50[METRIC_HISTOGRAM_COUNT];  // bucket indices
+  uint8_t p95[METRIC_HISTOGRAM_COUNT];
+  uint16_t failedMask;
+  uint8_t sf;
+  uint8_t queueDepth;
+};
+
+// The decoder's latest view of one request
+struct NetServerRequest {
+  IPAddress ip;
+  uint8_t unit;
+  uint16_t start;
+  uint8_t numRegs;
+  uint8_t function;  // function code, STAT_* mask above it as sent
+  bool valid;
+  bool updated;      // values arrived since netServerTakeUpdates()
+  uint16_t values[MAX_REQUEST_REGS];
+  bool rawValue[MAX_REQUEST_REGS];  // carried as raw words (not narrowed fields)
+  float fieldValues[MAX_REQUEST_REGS];  // narrowed fields at their first register, scale undone
+  bool narrowed[MAX_REQUEST_REGS];      // fieldValues[r] holds one
+};
+
+void netServerBegin(const NetServerConfig& config);  // attaches to the native radio
+void netServerQueueDownlink(uint8_t port, const uint8_t* data, uint8_t len);
+const NetServerStats& netServerStats();
+const NetServerDiagnostic& netServerLastDiagnostic();
+int netServerRequestCount();
+const NetServerRequest& netServerRequest(int index);
+void netServerTakeUpdates();
@@ -0,0 +1,231 @@
+#include <Arduino.h>
+#include <unistd.h>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <vector>
+#include "hal_native.h"
+
+HardwareSerial Serial;
+
+// ===== String =====
+
+static std::string formatNumber(unsigned long value, unsigned char base, bool negative) {
+  if (base < 2 || base > 36) base = 10;
+  char buf[8 * sizeof(long) + 2];
+  char* p = &buf[sizeof(buf) - 1];
+  *p = '\0';
+  do {
+    unsigned digit = value % base;
+    *--p = digit < 10 ? '0' + digit : 'A' + digit - 10;
+    value /= base;
+  } while (value);
+  if (negative) *--p = '-';
+  return p;
+}
+
+String::String(int value, unsigned char base) : String((long)value, base) {}
+String::String(unsigned int value, unsigned char base) : String((unsigned long)value, base) {}
+
+String::String(long value, unsigned char base) {
+  bool negative = value < 0 && base == 10;
+  s = formatNumber(negative ? 0UL - (unsigned long)value : (unsigned long)value, base, negative);
+}
+
+String::String(unsigned long value, unsigned char base) : s(formatNumber(value, base, false)) {}
+
+String::String(float value, unsigned int decimals) : String((double)value, decimals) {}
+
+String::String(double value, unsigned int decimals) {
+  char buf[64];
+  snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+  s = buf;
+}
+
+bool String::equalsIgnoreCase(const String& other) const {
+  if (s.length() != other.s.length()) return false;
+  for (size_t i = 0; i < s.length(); i++) {
+    if (tolower((unsigned char)s[i]) != tolower((unsigned char)other.s[i])) return false;
+  }
+  return true;
+}
+
+int String::indexOf(char c, unsigned int from) const {
+  size_t at = s.find(c, from);
+  return at == std::string::npos ? -1 : (int)at;
+}
+
+int String::indexOf(const String& str, unsigned int from) const {
+  size_t at = s.find(str.s, from);
+  return at == std::string::npos ? -1 : (int)at;
+}
+
+int String::lastIndexOf(char c) const {
+  size_t at = s.rfind(c);
+  return at == std::string::npos ? -1 : (int)at;
+}
+
+int String::lastIndexOf(const String& str) const {
+  size_t at = s.rfind(str.s);
+  return at == std::string::npos ? -1 : (int)at;
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+  if (from > to) std::swap(from, to);
+  if (from >= s.length()) return String();
+  to = std::min<unsigned int>(to, s.length());
+  return String(s.substr(from, to - from).c_str());
+}
+
+void String::replace(const String& find, const String& with) {
+  if (find.s.empty()) return;
+  size_t at = 0;
+  while ((at = s.find(find.s, at)) != std::string::npos) {
+    s.replace(at, find.s.length(), with.s);
+    at += with.s.length();
+  }
+}
+
+void String::remove(unsigned int index, unsigned int count) {
+  if (index < s.length()) s.erase(index, count);
+}
+
+void String::toLowerCase() {
+  for (char& c : s) c = tolower((unsigned char)c);
+}
+
+void String::toUpperCase() {
+  for (char& c : s) c = toupper((unsigned char)c);
+}
+
+void String::trim() {
+  size_t first = s.find_first_not_of(" \t\r\n");
+  if (first == std::string::npos) {
+    s.clear();
+    return;
+  }
+  s = s.substr(first, s.find_last_not_of(" \t\r\n") - first + 1);
+}
+
+// ===== Print =====
+
+size_t Print::write(const uint8_t* buffer, size_t size) {
+  size_t n = 0;
+  while (size--) n += write(*buffer++);
+  return n;
+}
+
+size_t Print::print(long value, int base) {
+  return print(String(value, (unsigned char)base));
+}
+
+size_t Print::print(unsigned long value, int base) {
+  return print(String(value, (unsigned char)base));
+}
+
+size_t Print::print(double value, int decimals) {
+  return print(String(value, (unsigned int)decimals));
+}
+
+size_t Print::printf(const char* format, ...) {
+  char small[256];
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(small, sizeof(small), format, args);
+  va_end(args);
+  if (len < 0) return 0;
+  if ((size_t)len < sizeof(small)) return write((const uint8_t*)small, len);
+
+  std::string big(len + 1, '\0');
+  va_start(args, format);
+  vsnprintf(&big[0], big.size(), format, args);
+  va_end(args);
+  return write((const uint8_t*)big.data(), len);
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  if (!quiet) fputc(c, stdout);
+  return 1;
+}
+
+size_t HardwareSerial::write(const uint8_t* buffer, size_t size) {
+  if (!quiet) fwrite(buffer, 1, size, stdout);
+  return size;
+}
+
+// ===== FreeRTOS queues =====
+
+struct HostQueue {
+  UBaseType_t length;
+  UBaseType_t itemSize;
+  std::deque<std::vector<uint8_t>> items;
+  std::mutex mutex;
+  std::condition_variable changed;
+};
+
+// Waits until ready() holds or the wait runs out
+template <typename Ready>
+static bool waitFor(HostQueue* queue, std::unique_lock<std::mutex>& lock, TickType_t wait, Ready ready) {
+  if (wait == portMAX_DELAY) {
+    queue->changed.wait(lock, ready);
+    return true;
+  }
+  return queue->changed.wait_for(lock, std::chrono::milliseconds(wait), ready);
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  HostQueue* queue = new HostQueue;
+  queue->length = length;
+  queue->itemSize = itemSize;
+  return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t wait) {
+  std::unique_lock<std::mutex> lock(queue->mutex);
+  if (!waitFor(queue, lock, wait, [&] { return queue->items.size() < queue->length; })) return pdFALSE;
+  const uint8_t* bytes = static_cast<const uint8_t*>(item);
+  queue->items.emplace_back(bytes, bytes + queue->itemSize);
+  queue->changed.notify_all();
+  return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t wait) {
+  std::unique_lock<std::mutex> lock(queue->mutex);
+  if (!waitFor(queue, lock, wait, [&] { return !queue->items.empty(); })) return pdFALSE;
+  memcpy(item, queue->items.front().data(), queue->itemSize);
+  queue->items.pop_front();
+  queue->changed.notify_all();
+  return pdTRUE;
+}
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void* item, TickType_t wait) {
+  std::unique_lock<std::mutex> lock(queue->mutex);
+  if (!waitFor(queue, lock, wait, [&] { return !queue->items.empty(); })) return pdFALSE;
+  memcpy(item, queue->items.front().data(), queue->itemSize);
+  return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+  std::lock_guard<std::mutex> lock(queue->mutex);
+  return queue->items.size();
+}
+
+// ===== Timing and GPIO =====
+
+void yield() {
+  std::this_thread::yield();  // busy-wait loops (pollDueModbus) share the host with simulators
+}
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (mode != OUTPUT) halPinInput(pin);
+}
+
+int digitalRead(uint8_t pin) {
+  return halPinRead(pin) ? HIGH : LOW;
+}
+
+void digitalWrite(uint8_t pin, uint8_t level) {
+  halNativeSetPin(pin, level != LOW);
+}
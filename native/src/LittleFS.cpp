@@ -0,0 +1,76 @@
+#include <LittleFS.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "hal_native.h"
+
+LittleFSClass LittleFS;
+
+File::Handle::~Handle() {
+  if (file) fclose(file);
+  if (dir) closedir(static_cast<DIR*>(dir));
+}
+
+size_t File::size() const {
+  if (!handle || !handle->file) return 0;
+  struct stat st;
+  return fstat(fileno(handle->file), &st) == 0 ? st.st_size : 0;
+}
+
+size_t File::write(const uint8_t* buffer, size_t size) {
+  if (!handle || !handle->file) return 0;
+  size_t written = fwrite(buffer, 1, size, handle->file);
+  fflush(handle->file);
+  return written;
+}
+
+size_t File::read(uint8_t* buffer, size_t size) {
+  if (!handle || !handle->file) return 0;
+  return fread(buffer, 1, size, handle->file);
+}
+
+bool File::seek(uint32_t pos) {
+  return handle && handle->file && fseek(handle->file, pos, SEEK_SET) == 0;
+}
+
+// Entries come back in host directory order; LittleFS promises none either
+File File::openNextFile() {
+  if (!handle || !handle->dir) return File();
+  while (dirent* entry = readdir(static_cast<DIR*>(handle->dir))) {
+    if (entry->d_name[0] == '.') continue;
+    std::string path = handle->path + (handle->path.back() == '/' ? "" : "/") + entry->d_name;
+    return LittleFS.open(path.c_str(), "r");
+  }
+  return File();
+}
+
+File LittleFSClass::open(const char* path, const char* mode) {
+  std::string host = halNativeHostPath(path);
+  auto handle = std::make_shared<File::Handle>();
+  handle->path = path;
+  handle->name = handle->path.substr(handle->path.find_last_of('/') + 1);
+
+  struct stat st;
+  if (stat(host.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+    handle->dir = opendir(host.c_str());
+  } else {
+    const char* hostMode = mode[0] == 'a' ? "ab+" : mode[0] == 'w' ? "wb+" : "rb";
+    handle->file = fopen(host.c_str(), hostMode);
+  }
+
+  File file;
+  if (handle->file || handle->dir) file.handle = handle;
+  return file;
+}
+
+bool LittleFSClass::exists(const char* path) {
+  struct stat st;
+  return stat(halNativeHostPath(path).c_str(), &st) == 0;
+}
+
+bool LittleFSClass::mkdir(const char* path) {
+  return ::mkdir(halNativeHostPath(path).c_str(), 0755) == 0 || exists(path);
+}
+
+bool LittleFSClass::remove(const char* path) {
+  return ::remove(halNativeHostPath(path).c_str()) == 0;
+}
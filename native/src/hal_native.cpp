@@ -0,0 +1,537 @@
+#include <chrono>
+#include <thread>
+#include <fstream>
+#include <sstream>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <errno.h>
+#include "hal_native.h"
+#include "airtime.h"
+
+// ===== Clock =====
+
+static const auto clockStart = std::chrono::steady_clock::now();
+static bool virtualClock = false;
+static std::atomic<uint64_t> virtualMicros(0);
+
+uint32_t halMicros() {
+  if (virtualClock) return (uint32_t)virtualMicros.load();
+  auto elapsed = std::chrono::steady_clock::now() - clockStart;
+  return (uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+}
+
+uint32_t halMillis() {
+  if (virtualClock) return (uint32_t)(virtualMicros.load() / 1000);
+  auto elapsed = std::chrono::steady_clock::now() - clockStart;
+  return (uint32_t)std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+}
+
+void halNativeUseVirtualClock(bool enabled) {
+  if (enabled && !virtualClock) virtualMicros = (uint64_t)halMillis() * 1000;
+  virtualClock = enabled;
+}
+
+void halNativeAdvance(uint32_t ms) {
+  virtualMicros += (uint64_t)ms * 1000;
+}
+
+void delay(uint32_t ms) {
+  if (virtualClock) {
+    halNativeAdvance(ms);
+  } else {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+  }
+}
+
+// ===== GPIO =====
+
+#define NATIVE_PIN_COUNT 64
+static std::atomic<bool> pinLevels[NATIVE_PIN_COUNT];
+
+void halPinInput(uint8_t pin) {}
+
+bool halPinRead(uint8_t pin) {
+  return pin < NATIVE_PIN_COUNT && pinLevels[pin].load();
+}
+
+uint64_t halPinReadMask(uint64_t mask) {
+  uint64_t levels = 0;
+  for (int pin = 0; pin < NATIVE_PIN_COUNT; pin++) {
+    if (pinLevels[pin]) levels |= 1ULL << pin;
+  }
+  return levels & mask;
+}
+
+// Pulse counters see every edge set here, however rarely the pin is sampled
+struct NativePulseCounter {
+  std::atomic<bool> active;
+  std::atomic<uint8_t> pin;
+  std::atomic<uint64_t> total;
+};
+static NativePulseCounter pulseCounters[HAL_PULSE_CHANNELS];
+
+void halNativePulse(uint8_t pin, uint32_t count) {
+  for (auto& c : pulseCounters) {
+    if (c.active && c.pin == pin) c.total += count;
+  }
+}
+
+void halNativeSetPin(uint8_t pin, bool level) {
+  if (pin >= NATIVE_PIN_COUNT) return;
+  bool was = pinLevels[pin].exchange(level);
+  if (level && !was) halNativePulse(pin, 1);
+}
+
+bool halPulseCounterBegin(uint8_t channel, uint8_t pin, uint32_t filterNs) {
+  if (channel >= HAL_PULSE_CHANNELS) return false;
+  NativePulseCounter& c = pulseCounters[channel];
+  c.active = false;
+  c.pin = pin;
+  c.total = 0;
+  c.active = true;
+  return true;
+}
+
+void halPulseCounterEnd(uint8_t channel) {
+  if (channel < HAL_PULSE_CHANNELS) pulseCounters[channel].active = false;
+}
+
+uint64_t halPulseCounterTotal(uint8_t channel) {
+  if (channel >= HAL_PULSE_CHANNELS || !pulseCounters[channel].active) return 0;
+  return pulseCounters[channel].total;
+}
+
+// ===== Filesystem (a host directory) =====
+
+static std::string fsRoot;
+
+void halNativeSetFsRoot(const char* dir) {
+  fsRoot = dir;
+}
+
+std::string halNativeHostPath(const char* path) {
+  if (fsRoot.empty()) {
+    const char* env = getenv("FYP_FS_ROOT");
+    fsRoot = env ? env : ".native_fs";
+  }
+  return fsRoot + (path[0] == '/' ? "" : "/") + path;
+}
+
+bool halFsMount() {
+  std::string root = halNativeHostPath("/");
+  mkdir(root.c_str(), 0755);
+  struct stat st;
+  bool ok = stat(root.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+  Serial.printf(ok ? "Host filesystem mounted at %s\n" : "Host filesystem %s unavailable\n", root.c_str());
+  return ok;
+}
+
+bool halFileExists(const char* path) {
+  struct stat st;
+  return stat(halNativeHostPath(path).c_str(), &st) == 0;
+}
+
+bool halFileRead(const char* path, String& out) {
+  std::ifstream file(halNativeHostPath(path), std::ios::binary);
+  if (!file) return false;
+  std::stringstream content;
+  content << file.rdbuf();
+  out = content.str().c_str();
+  return true;
+}
+
+bool halFileWrite(const char* path, const String& content, bool append) {
+  std::ofstream file(halNativeHostPath(path), std::ios::binary | (append ? std::ios::app : std::ios::trunc));
+  if (!file) return false;
+  file.write(content.c_str(), content.length());
+  return file.good();
+}
+
+bool halFileRemove(const char* path) {
+  return ::remove(halNativeHostPath(path).c_str()) == 0;
+}
+
+// ===== Network and Modbus TCP over host sockets =====
+// Slave IPs are used as given, so a simulator can listen on 127.0.0.x
+
+struct NativeConnection {
+  IPAddress ip;
+  int fd;
+  std::vector<uint8_t> rx;
+};
+
+struct NativeTransaction {
+  uint16_t id;
+  IPAddress ip;
+  uint8_t unit;
+  uint8_t function;
+  uint16_t start;
+  uint16_t count;
+  uint16_t* words;
+  bool* bits;
+  uint32_t issuedUs;
+};
+
+static std::vector<NativeConnection> connections;
+static std::vector<NativeTransaction> transactions;
+static HalModbusCallback modbusReply = nullptr;
+static HalNativeModbusHook modbusHook = nullptr;
+static uint16_t modbusPort = 502;
+static uint16_t connectTimeout = 250;
+static uint16_t nextTransaction = 1;
+
+void halNativeSetModbusPort(uint16_t port) {
+  modbusPort = port;
+}
+
+void halNativeOnModbusReply(HalNativeModbusHook hook) {
+  modbusHook = hook;
+}
+
+void halNetworkInit() {}
+bool halNetworkLinkUp() { return true; }
+bool halNetworkBeginDhcp(const uint8_t* mac) { return true; }
+
+bool halNetworkBeginStatic(const uint8_t* mac, IPAddress ip, IPAddress dns, IPAddress gateway, IPAddress subnet) {
+  return true;
+}
+
+IPAddress halNetworkLocalIP() { return IPAddress(127, 0, 0, 1); }
+
+void halModbusBegin(uint16_t connectTimeoutMs, HalModbusCallback onReply) {
+  connectTimeout = connectTimeoutMs;
+  modbusReply = onReply;
+}
+
+static NativeConnection* findConnection(IPAddress ip) {
+  for (auto& c : connections) {
+    if (c.ip == ip) return &c;
+  }
+  return nullptr;
+}
+
+static void complete(const NativeTransaction& t, uint8_t result) {
+  if (modbusHook) modbusHook(t.ip, t.unit, t.start, result, halMicros() - t.issuedUs);
+  if (modbusReply) modbusReply(result, t.id);
+}
+
+// Closes the socket; its outstanding transactions fail the way a W5500
+// reset socket makes ModbusEthernet fail them
+static void closeConnection(IPAddress ip, bool notify) {
+  for (size_t i = 0; i < connections.size(); i++) {
+    if (connections[i].ip != ip) continue;
+    close(connections[i].fd);
+    connections.erase(connections.begin() + i);
+    break;
+  }
+
+  std::vector<NativeTransaction> lost;
+  for (size_t i = 0; i < transactions.size();) {
+    if (transactions[i].ip == ip) {
+      lost.push_back(transactions[i]);
+      transactions.erase(transactions.begin() + i);
+    } else {
+      i++;
+    }
+  }
+  if (notify) {
+    for (auto& t : lost) complete(t, HAL_MODBUS_CONNECTION_LOST);
+  }
+}
+
+bool halModbusConnected(IPAddress ip) {
+  return findConnection(ip) != nullptr;
+}
+
+// Blocks for at most the connect timeout, like Ethernet.setConnectionTimeout()
+bool halModbusConnect(IPAddress ip) {
+  if (findConnection(ip)) return true;
+
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return false;
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(modbusPort);
+  addr.sin_addr.s_addr = (uint32_t)ip;  // octets are already in network order
+
+  bool ok = connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0;
+  if (!ok && errno == EINPROGRESS) {
+    pollfd pfd = { fd, POLLOUT, 0 };
+    int err = 0;
+    socklen_t len = sizeof(err);
+    ok = poll(&pfd, 1, connectTimeout) == 1 && getsockopt(fd, SOL_SOCKET, SO_ERROR, &err, &len) == 0 && err == 0;
+  }
+  if (!ok) {
+    close(fd);
+    return false;
+  }
+  connections.push_back({ ip, fd, {} });
+  return true;
+}
+
+void halModbusDisconnect(IPAddress ip) {
+  closeConnection(ip, false);
+}
+
+uint16_t halModbusRead(IPAddress ip, uint8_t unit, ModbusFunction function, uint16_t start, uint16_t count,
+                       uint16_t* words, bool* bits) {
+  NativeConnection* conn = findConnection(ip);
+  if (!conn) return 0;
+
+  uint16_t id = nextTransaction++;
+  if (nextTransaction == 0) nextTransaction = 1;
+
+  uint8_t adu[12] = { highByte(id), lowByte(id), 0, 0, 0, 6, unit, (uint8_t)function,
+                      highByte(start), lowByte(start), highByte(count), lowByte(count) };
+  if (send(conn->fd, adu, sizeof(adu), MSG_NOSIGNAL) != (ssize_t)sizeof(adu)) {
+    closeConnection(ip, true);
+    return 0;
+  }
+  transactions.push_back({ id, ip, unit, (uint8_t)function, start, count, words, bits, halMicros() });
+  return id;
+}
+
+// Parses one complete response ADU; false if the buffer holds less than one
+static bool takeResponse(NativeConnection& conn) {
+  std::vector<uint8_t>& rx = conn.rx;
+  if (rx.size() < 8) return false;
+  size_t total = 6 + ((rx[4] << 8) | rx[5]);
+  if (rx.size() < total) return false;
+
+  uint16_t id = (rx[0] << 8) | rx[1];
+  uint8_t function = rx[7];
+  for (size_t i = 0; i < transactions.size(); i++) {
+    NativeTransaction t = transactions[i];
+    if (t.id != id || t.ip != conn.ip) continue;
+    transactions.erase(transactions.begin() + i);
+
+    uint8_t result = HAL_MODBUS_OK;
+    if (function & 0x80) {
+      result = total > 8 ? rx[8] : HAL_MODBUS_TIMEOUT;
+    } else if (t.words) {
+      for (size_t r = 0; r < t.count && 9 + 2 * r + 1 < total; r++) t.words[r] = (rx[9 + 2 * r] << 8) | rx[10 + 2 * r];
+    } else if (t.bits) {
+      for (size_t b = 0; b < t.count && 9 + b / 8 < total; b++) t.bits[b] = (rx[9 + b / 8] >> (b % 8)) & 1;
+    }
+    complete(t, result);
+    break;
+  }
+  rx.erase(rx.begin(), rx.begin() + total);  // late replies to dropped transactions land here too
+  return true;
+}
+
+void halModbusTask() {
+  for (size_t c = 0; c < connections.size(); c++) {
+    NativeConnection& conn = connections[c];
+    uint8_t buf[512];
+    ssize_t n;
+    while ((n = recv(conn.fd, buf, sizeof(buf), 0)) > 0) conn.rx.insert(conn.rx.end(), buf, buf + n);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+      closeConnection(conn.ip, true);
+      c--;
+      continue;
+    }
+    while (takeResponse(conn)) {
+    }
+  }
+}
+
+void halModbusDropTransactions() {
+  transactions.clear();
+}
+
+// ===== Radio =====
+// A loopback until a network server is attached: each frame completes,
+// acked, on the next halRadioRunOnce(). With a server, frames follow LMIC's
+// class A timeline on the HAL clock: on air for their time on air, then RX1
+// (RECEIVE_DELAY1 after TX end) or, with nothing for the device, RX2. A
+// confirmed frame that is not acked goes out again on the next channel with
+// the same frame counter, up to TXCONF_ATTEMPTS times, before TX complete.
+
+#define RX1_DELAY_MS 1000
+#define RX2_DELAY_MS 2000
+#define RX2_WINDOW_MS 50        // preamble timeout of the RX2 listen
+#define TXCONF_ATTEMPTS 8       // LMIC's transmissions of an unacked confirmed frame
+#define ADR_ACK_LIMIT 64        // uplinks without any downlink before ADRACKReq
+#define ADR_ACK_DELAY 32        // then one SF step up per this many more
+#define AU915_UPLINK_BASE_HZ 915200000
+#define AU915_UPLINK_STEP_HZ 200000
+
+enum RadioState { RADIO_IDLE, RADIO_QUEUED, RADIO_ON_AIR, RADIO_RX };
+
+static HalNativeUplinkHook uplinkHook = nullptr;
+static HalNativeNetworkServer networkServer = nullptr;
+static HalNativeRadioStats radioStats = {};
+static uint8_t radioSF = 7;
+static uint32_t radioBandwidth = 125000;
+static bool radioAdr = false;
+static uint8_t radioSubband = 2;
+static uint8_t radioChannel = 0;
+static uint32_t frameCounter = 0;
+static uint32_t adrAckCount = 0;
+static RadioState radioState = RADIO_IDLE;
+
+// The frame in flight
+static uint8_t txPort;
+static uint8_t txData[256];
+static uint8_t txLen;
+static bool txConfirmed;
+static uint32_t txQueuedAt;
+static uint32_t txEndAt;
+static uint32_t txDoneAt;
+static uint8_t txAttempt;              // 1 = first transmission
+static HalNativeDownlink txReply;      // of the current attempt
+static HalNativeDownlink txPayload;    // application data from any attempt
+
+void halNativeOnUplink(HalNativeUplinkHook hook) {
+  uplinkHook = hook;
+}
+
+void halNativeSetDataRate(uint8_t sf, uint32_t bandwidthHz) {
+  radioSF = sf;
+  radioBandwidth = bandwidthHz;
+}
+
+void halNativeAttachNetworkServer(HalNativeNetworkServer server) {
+  networkServer = server;
+}
+
+void halNativeRadioStats(HalNativeRadioStats& out) {
+  out = radioStats;
+}
+
+void halRadioInit() {}
+void halRadioReset() {}
+
+void halRadioConfigure(bool adr, uint8_t subband, uint8_t sf) {
+  radioAdr = adr;
+  if (subband >= 1 && subband <= 8) radioSubband = subband;
+  if (!adr && sf >= 7 && sf <= 12) radioSF = sf;
+}
+
+void halRadioStartAbp(uint32_t devAddr, const uint8_t* nwkSKey, const uint8_t* appSKey) {}
+
+// The join is accepted on the spot
+void halRadioStartJoin() {
+  onRadioJoined();
+}
+
+// LMIC's ADR backoff: with no downlink for long enough the device assumes
+// it is out of range and steps the data rate down on its own
+static void adrBackoff() {
+  if (!radioAdr) return;
+  if (++adrAckCount < ADR_ACK_LIMIT + ADR_ACK_DELAY) return;
+  if ((adrAckCount - ADR_ACK_LIMIT) % ADR_ACK_DELAY == 0 && radioSF < 12) {
+    radioSF++;
+    radioStats.adrChanges++;
+  }
+}
+
+// After the receive windows of one attempt: send again, or report TX complete
+static void finishAttempt() {
+  bool downlink = txReply.ack || txReply.adrSF || txReply.len > 0;
+  if (downlink) {
+    radioStats.downlinks++;
+    adrAckCount = 0;
+  }
+  if (txReply.adrSF && radioAdr && txReply.adrSF != radioSF) {
+    radioSF = txReply.adrSF;
+    radioStats.adrChanges++;
+  }
+  if (txReply.len > 0) txPayload = txReply;
+
+  bool acked = txConfirmed && txReply.ack;
+  if (txConfirmed && !acked && txAttempt < TXCONF_ATTEMPTS) {
+    txAttempt++;
+    radioState = RADIO_QUEUED;  // no duty cycle in AU915, so straight after RX2
+    return;
+  }
+
+  radioStats.blockedMs += halMillis() - txQueuedAt;
+  radioState = RADIO_IDLE;
+  if (acked) radioStats.acked++;
+  onRadioTxComplete(acked, frameCounter, txPayload.port, txPayload.data, txPayload.len);
+}
+
+void halRadioRunOnce() {
+  if (radioState == RADIO_IDLE) return;
+
+  if (!networkServer) {
+    radioState = RADIO_IDLE;
+    onRadioTxStart(AU915_UPLINK_BASE_HZ);
+    onRadioTxComplete(true, ++frameCounter, 0, nullptr, 0);
+    return;
+  }
+
+  uint32_t now = halMillis();
+  if (radioState == RADIO_QUEUED) {
+    // Channels rotate through the configured subband, as LMIC's AU915 plan does
+    uint32_t freq = AU915_UPLINK_BASE_HZ + ((radioSubband - 1) * 8 + radioChannel) * AU915_UPLINK_STEP_HZ;
+    radioChannel = (radioChannel + 1) % 8;
+    uint32_t airtime = timeOnAirMs(radioSF, radioBandwidth, txLen + LORAWAN_OVERHEAD);
+
+    if (txAttempt == 1) {
+      frameCounter++;
+    } else {
+      radioStats.retransmissions++;
+    }
+    radioStats.frames++;
+    radioStats.bytes += txLen;
+    radioStats.airtimeMs += airtime;
+    txEndAt = now + airtime;
+    radioState = RADIO_ON_AIR;
+    onRadioTxStart(freq);
+
+    HalNativeUplink up = { frameCounter, txPort, txData, txLen, txConfirmed, radioSF, freq, airtime, radioAdr };
+    txReply = HalNativeDownlink();
+    networkServer(up, txReply);
+    return;
+  }
+
+  if (radioState == RADIO_ON_AIR) {
+    if ((int32_t)(now - txEndAt) < 0) return;
+    bool downlink = txReply.ack || txReply.adrSF || txReply.len > 0;
+    uint32_t rxAirtime = downlink ? timeOnAirMs(radioSF, radioBandwidth, txReply.len + LORAWAN_OVERHEAD) : 0;
+    txDoneAt = txEndAt + (downlink ? RX1_DELAY_MS + rxAirtime : RX2_DELAY_MS + RX2_WINDOW_MS);
+    if (!downlink) adrBackoff();
+    radioState = RADIO_RX;
+  }
+
+  if (radioState == RADIO_RX && (int32_t)(now - txDoneAt) >= 0) finishAttempt();
+}
+
+bool halRadioBusy() { return radioState != RADIO_IDLE; }
+
+bool halRadioSend(uint8_t port, const uint8_t* data, uint8_t len, bool confirmed) {
+  if (radioState != RADIO_IDLE) return false;
+  txPort = port;
+  memcpy(txData, data, len);
+  txLen = len;
+  txConfirmed = confirmed;
+  txAttempt = 1;
+  txPayload = HalNativeDownlink();
+  txQueuedAt = halMillis();
+  radioState = RADIO_QUEUED;
+  if (uplinkHook) uplinkHook(port, data, len, confirmed);
+  return true;
+}
+
+void halRadioCancel() {
+  if (radioState != RADIO_IDLE) radioStats.blockedMs += halMillis() - txQueuedAt;
+  radioState = RADIO_IDLE;
+}
+
+uint8_t halRadioSF() { return radioSF; }
+uint32_t halRadioBandwidth() { return radioBandwidth; }
+uint32_t halRadioFrameCounter() { return frameCounter; }
+void halRadioSetFrameCounter(uint32_t seqnoUp) { frameCounter = seqnoUp; }
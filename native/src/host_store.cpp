@@ -0,0 +1,19 @@
+#include "store.h"
+
+// Host version of store.cpp for the benchmark and simulators, which run
+// without a flash store: unconfirmed frames are counted and dropped. The unit
+// tests build the real store on the LittleFS stand-in instead.
+
+static uint32_t lostTotal = 0;
+
+void initStore() {}
+void serviceStore(uint32_t waitMs) {}
+void serviceReplay() {}
+
+void storeFrame(uint8_t port, const uint8_t* data, uint8_t len) {
+  lostTotal++;
+}
+
+void printStoreStatus() {
+  Serial.printf("Store: not available on the host, %lu frame(s) dropped\n", (unsigned long)lostTotal);
+}
@@ -0,0 +1,42 @@
+#include <deque>
+#include <mutex>
+#include "tasks.h"
+
+// Host versions of what tasks.cpp provides on the board, where it sits on
+// FreeRTOS queues and semaphores
+
+static std::deque<AlarmEvent> alarmQueue;
+static std::mutex alarmMutex;
+
+bool postAlarm(const AlarmEvent& ev) {
+  std::lock_guard<std::mutex> lock(alarmMutex);
+  if (alarmQueue.size() >= ALARM_QUEUE_LEN) {
+    Serial.println("Alarm queue full — event dropped");
+    return false;
+  }
+  alarmQueue.push_back(ev);
+  return true;
+}
+
+bool nextAlarm(AlarmEvent& ev) {
+  std::lock_guard<std::mutex> lock(alarmMutex);
+  if (alarmQueue.empty()) return false;
+  ev = alarmQueue.front();
+  alarmQueue.pop_front();
+  return true;
+}
+
+int pendingAlarmCount() {
+  std::lock_guard<std::mutex> lock(alarmMutex);
+  return alarmQueue.size();
+}
+
+static std::mutex tableMutex;
+
+void lockRequestTable() {
+  tableMutex.lock();
+}
+
+void unlockRequestTable() {
+  tableMutex.unlock();
+}
@@ -0,0 +1,540 @@
+#include <deque>
+#include <random>
+#include "netserver.h"
+#include "payload.h"
+#include "delta.h"
+#include "lora.h"
+#include "aggregate.h"
+#include "snapshot.h"
+
+#define ADR_HISTORY 20          // uplinks the ADR decision looks back over
+#define ADR_STEP_DB 3.0f        // margin per data rate step
+#define DELTA_HISTORY 256       // one slot per delta sequence number
+
+struct QueuedDownlink {
+  uint8_t port;
+  uint8_t data[64];
+  uint8_t len;
+};
+
+static NetServerConfig config;
+static NetServerStats stats;
+static NetServerDiagnostic lastDiagnostic;
+static std::mt19937 rng;
+static std::deque<QueuedDownlink> downlinks;
+static uint32_t lastFcnt = 0;  // of the last uplink received
+static bool haveLastFcnt = false;
+
+// ADR state of the one device
+static float snrHistory[ADR_HISTORY];
+static int snrCount = 0;
+
+// Decoder state: the announced schema and what it has decoded so far
+static NetServerRequest table[MAX_REQUESTS];
+static int tableCount = 0;
+static uint16_t schemaId = 0;
+static bool schemaValid = false;
+static FieldDesc schemaFields[MAX_FIELDS];
+static int schemaFieldCount = 0;
+static uint16_t pendingSchemaId = 0;
+static uint16_t pendingRequestMask = 0;  // announced entries seen for pendingSchemaId
+static int pendingRequestTotal = 0;
+static int pendingFieldTotal = 0;
+static NetServerRequest pendingTable[MAX_REQUESTS];
+static FieldDesc pendingFields[MAX_FIELDS];
+
+static uint16_t deltaValues[DELTA_HISTORY][MAX_REQUESTS][MAX_REQUEST_REGS];
+static uint16_t deltaSeen[DELTA_HISTORY];  // requests decoded per sequence
+
+static float uniform(float lo, float hi) {
+  return std::uniform_real_distribution<float>(lo, hi)(rng);
+}
+
+static bool chance(uint8_t pct) {
+  return pct > 0 && uniform(0, 100) < pct;
+}
+
+// Lowest SNR each spreading factor still demodulates at (SX127x datasheet)
+static float demodFloorDb(uint8_t sf) {
+  return -7.5f - 2.5f * (sf - 7);
+}
+
+// ===== ADR =====
+
+// Semtech's reference algorithm: step the data rate up by one per 3 dB of
+// margin above the demodulation floor plus the installation margin. It only
+// ever speeds a device up; slowing down is the device's own ADR backoff.
+static uint8_t adrDecision(uint8_t sf, float snr) {
+  snrHistory[snrCount++ % ADR_HISTORY] = snr;
+  if (snrCount < ADR_HISTORY) return 0;
+
+  float best = snrHistory[0];
+  for (int i = 1; i < ADR_HISTORY; i++) best = max(best, snrHistory[i]);
+  int steps = (int)floorf((best - demodFloorDb(sf) - config.installMarginDb) / ADR_STEP_DB);
+
+  uint8_t target = sf;
+  while (steps-- > 0 && target > 7) target--;
+  if (target == sf) return 0;
+
+  snrCount = 0;  // the next decision waits for frames at the new rate
+  stats.adrCommands++;
+  return target;
+}
+
+// ===== Decoding =====
+
+static ModbusRequest requestFromEntry(const NetServerRequest& entry) {
+  ModbusRequest req(entry.ip, entry.unit, entry.start, entry.numRegs, (ModbusFunction)(entry.function & 0x07));
+  req.stats = (entry.function >> 3) ? (entry.function >> 3) : STAT_LAST;
+  return req;
+}
+
+static bool isBitFunction(uint8_t function) {
+  return (function & 0x07) <= 2;
+}
+
+// Raw last values of one request, as encodeLastValues() writes them
+static uint8_t decodeLastValues(NetServerRequest& entry, const uint8_t* in) {
+  uint8_t n = min<uint8_t>(entry.numRegs, MAX_REQUEST_REGS);
+  if (isBitFunction(entry.function)) {
+    for (int r = 0; r < n; r++) entry.values[r] = (in[r / 8] >> (r % 8)) & 1;
+  } else {
+    for (int r = 0; r < n; r++) entry.values[r] = (in[2 * r] << 8) | in[2 * r + 1];
+  }
+  for (int r = 0; r < n; r++) entry.rawValue[r] = true;
+  memset(entry.narrowed, 0, sizeof(entry.narrowed));
+  entry.updated = true;
+  stats.registers += n;
+  return isBitFunction(entry.function) ? (entry.numRegs + 7) / 8 : entry.numRegs * 2;
+}
+
+// [0xFF][count] then index, type, value[2] per input; 0 if malformed
+// 0xFF, inputs, counters, level bitmap, then index and 32-bit count per counter
+static uint8_t decodeInputSection(const uint8_t* in, uint8_t len) {
+  if (len < 3 || in[0] != 0xFF) return 0;
+  int size = 3 + (in[1] + 7) / 8 + in[2] * 5;
+  return size <= len ? size : 0;
+}
+
+static int findEntry(const uint8_t* header) {
+  for (int i = 0; i < tableCount; i++) {
+    const NetServerRequest& e = table[i];
+    if (e.ip == header && e.unit == header[4] && e.start == ((header[5] << 8) | header[6]) &&
+        e.numRegs == header[7] && e.function == header[9]) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+// fPort 1: self-describing blocks, then the input section
+static bool decodeLegacy(const uint8_t* data, uint8_t len) {
+  uint8_t pos = 0;
+  while (pos < len) {
+    if (data[pos] == 0xFF) {
+      uint8_t inputLen = decodeInputSection(&data[pos], len - pos);
+      if (inputLen == 0) return false;
+      pos += inputLen;
+      continue;
+    }
+    if (pos + LEGACY_HEADER_LEN > len) return false;
+    const uint8_t* header = &data[pos];
+
+    int i = findEntry(header);
+    if (i < 0) {
+      // Without a schema the legacy blocks define the table themselves
+      if (schemaValid || tableCount >= MAX_REQUESTS) return false;
+      i = tableCount++;
+      NetServerRequest& e = table[i];
+      e = NetServerRequest();
+      e.ip = IPAddress(header);
+      e.unit = header[4];
+      e.start = (header[5] << 8) | header[6];
+      e.numRegs = header[7];
+      e.function = header[9];
+      e.valid = true;
+    }
+
+    NetServerRequest& entry = table[i];
+    ModbusRequest req = requestFromEntry(entry);
+    uint16_t valuesLen = requestValuesLength(req);
+    pos += LEGACY_HEADER_LEN;
+    if (pos + valuesLen > len) return false;
+    if (header[8] && (req.stats & STAT_LAST)) decodeLastValues(entry, &data[pos]);
+    pos += valuesLen;
+    stats.requests++;
+  }
+  return true;
+}
+
+// fPort 2: [count] then Modbus (12 byte) or input (0xFF, 4 byte) records
+static bool decodeAlarms(const uint8_t* data, uint8_t len) {
+  if (len < 1) return false;
+  uint8_t pos = 1;
+  for (int r = 0; r < data[0]; r++) {
+    uint8_t recordLen = (pos < len && data[pos] == 0xFF) ? ALARM_INPUT_RECORD_LEN : ALARM_MODBUS_RECORD_LEN;
+    if (pos + recordLen > len) return false;
+    pos += recordLen;
+    stats.alarms++;
+  }
+  return pos == len;
+}
+
+// fPort 6: version, uptime, counters, p50/p95 nibbles, failed mask, SF, queue depth
+static bool decodeDiagnostic(const uint8_t* data, uint8_t len) {
+  if (len != DIAG_FRAME_LEN || data[0] != DIAG_FORMAT_VERSION) return false;
+  NetServerDiagnostic d;
+  d.uptimeMin = ((uint32_t)data[1] << 16) | (data[2] << 8) | data[3];
+  uint8_t pos = 4;
+  for (int i = 0; i < METRIC_COUNTER_COUNT; i++, pos += 2) d.counters[i] = (data[pos] << 8) | data[pos + 1];
+  for (int i = 0; i < METRIC_HISTOGRAM_COUNT; i++, pos++) {
+    d.p50[i] = data[pos] >> 4;
+    d.p95[i] = data[pos] & 0x0F;
+  }
+  d.failedMask = (data[pos] << 8) | data[pos + 1];
+  d.sf = data[pos + 2];
+  d.queueDepth = data[pos + 3];
+  lastDiagnostic = d;
+  stats.diagnostics++;
+  return true;
+}
+
+// Schema ID as the device computes it, to know the announcement is complete
+static uint16_t pendingSchemaCrc() {
+  static RegisterSnapshot snap;
+  snap.count = pendingRequestTotal;
+  for (int i = 0; i < pendingRequestTotal; i++) snap.requests[i] = requestFromEntry(pendingTable[i]);
+  snap.fieldCount = pendingFieldTotal;
+  memcpy(snap.fields, pendingFields, sizeof(FieldDesc) * pendingFieldTotal);
+  return computeSchemaId(snap);
+}
+
+static float decodeFloat(const uint8_t* in) {
+  uint32_t bits = ((uint32_t)in[0] << 24) | ((uint32_t)in[1] << 16) | (in[2] << 8) | in[3];
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+// fPort 4: request entries, or field entries when firstReq has the 0x80 flag
+static bool decodeSchemaAnnounce(const uint8_t* data, uint8_t len) {
+  if (len < 4) return false;
+  uint16_t id = (data[0] << 8) | data[1];
+  if (id != pendingSchemaId) {
+    pendingSchemaId = id;
+    pendingRequestMask = 0;
+    pendingRequestTotal = 0;
+    pendingFieldTotal = 0;
+  }
+
+  bool fieldFrame = data[2] & SCHEMA_FIELD_FLAG;
+  int first = data[2] & ~SCHEMA_FIELD_FLAG;
+  int total = data[3];
+  uint8_t entryLen = fieldFrame ? FIELD_ENTRY_LEN : SCHEMA_ENTRY_LEN;
+  if ((len - 4) % entryLen != 0 || total > (fieldFrame ? MAX_FIELDS : MAX_REQUESTS)) return false;
+  int count = (len - 4) / entryLen;
+  if (first + count > total) return false;
+
+  for (int k = 0; k < count; k++) {
+    const uint8_t* in = &data[4 + k * entryLen];
+    if (fieldFrame) {
+      FieldDesc& f = pendingFields[first + k];
+      f.request = in[0];
+      f.index = in[1];
+      f.type = (FieldType)(in[2] & 0x0F);
+      f.flags = in[2] >> 4;
+      f.uplink = (FieldUplink)in[3];
+      f.scale = decodeFloat(&in[4]);
+      f.offset = decodeFloat(&in[8]);
+    } else {
+      NetServerRequest& e = pendingTable[first + k];
+      e = NetServerRequest();
+      e.ip = IPAddress(in);
+      e.unit = in[4];
+      e.start = (in[5] << 8) | in[6];
+      e.numRegs = in[7];
+      e.function = in[8];
+      e.valid = true;
+      pendingRequestMask |= 1 << (first + k);
+    }
+  }
+  if (fieldFrame) {
+    pendingFieldTotal = total;
+  } else {
+    pendingRequestTotal = total;
+  }
+
+  // Field frames carry no request count, so completeness is the schema ID itself
+  bool requestsDone = pendingRequestTotal > 0 && pendingRequestMask == (1u << pendingRequestTotal) - 1;
+  if (requestsDone && pendingSchemaCrc() == id && !(schemaValid && schemaId == id)) {
+    for (int i = 0; i < pendingRequestTotal; i++) table[i] = pendingTable[i];
+    tableCount = pendingRequestTotal;
+    memcpy(schemaFields, pendingFields, sizeof(FieldDesc) * pendingFieldTotal);
+    schemaFieldCount = pendingFieldTotal;
+    schemaId = id;
+    schemaValid = true;
+    memset(deltaSeen, 0, sizeof(deltaSeen));
+  }
+  return true;
+}
+
+// A narrowed field is round(decoded * scale + offset) as int16 or int8
+static float decodeFieldUplink(const FieldDesc& f, const uint8_t* in) {
+  int32_t narrow = f.uplink == FIELD_UPLINK_INT8 ? (int8_t)in[0] : (int16_t)((in[0] << 8) | in[1]);
+  return (narrow - f.offset) / f.scale;
+}
+
+// One request of a schema data frame: raw words, narrowed fields, then stats
+static int decodeSchemaValues(int i, const uint8_t* in, int avail) {
+  NetServerRequest& entry = table[i];
+  ModbusRequest req = requestFromEntry(entry);
+  if (isBitFunction(entry.function) || !(req.stats & STAT_LAST)) {
+    int len = requestValuesLength(req);
+    if (len > avail) return -1;
+    if (req.stats & STAT_LAST) decodeLastValues(entry, in);
+    return len;
+  }
+
+  int pos = 0;
+  memset(entry.rawValue, 0, sizeof(entry.rawValue));
+  memset(entry.narrowed, 0, sizeof(entry.narrowed));
+  for (int r = 0; r < entry.numRegs;) {
+    int f = findField(schemaFields, schemaFieldCount, i, r);
+    if (f >= 0 && schemaFields[f].uplink != FIELD_UPLINK_RAW) {
+      const FieldDesc& field = schemaFields[f];
+      if (pos + fieldUplinkLength(field) > avail) return -1;
+      if (r < MAX_REQUEST_REGS) {
+        entry.fieldValues[r] = decodeFieldUplink(field, &in[pos]);
+        entry.narrowed[r] = true;
+      }
+      pos += fieldUplinkLength(field);
+      r += fieldWords(field.type);
+      continue;
+    }
+    if (pos + 2 > avail) return -1;
+    if (r < MAX_REQUEST_REGS) {
+      entry.values[r] = (in[pos] << 8) | in[pos + 1];
+      entry.rawValue[r] = true;
+      stats.registers++;
+    }
+    pos += 2;
+    r++;
+  }
+  entry.updated = true;
+  pos += statsLength(req);
+  return pos <= avail ? pos : -1;
+}
+
+// fPort 5: [schemaId][included bitmap][success bitmap] values [input section]
+static bool decodeSchemaData(const uint8_t* data, uint8_t len) {
+  if (!schemaValid || len < 2 || ((data[0] << 8) | data[1]) != schemaId) return false;
+  int mapLen = (tableCount + 7) / 8;
+  if (len < 2 + 2 * mapLen) return false;
+  const uint8_t* included = &data[2];
+  const uint8_t* success = included + mapLen;
+
+  int pos = 2 + 2 * mapLen;
+  for (int i = 0; i < tableCount; i++) {
+    if (!(included[i / 8] & (1 << (i % 8)))) continue;
+    stats.requests++;
+    if (!(success[i / 8] & (1 << (i % 8)))) continue;
+    int used = decodeSchemaValues(i, &data[pos], len - pos);
+    if (used < 0) return false;
+    pos += used;
+  }
+  if (pos < len) {
+    uint8_t inputLen = decodeInputSection(&data[pos], len - pos);
+    if (inputLen == 0) return false;
+    pos += inputLen;
+  }
+  return pos == len;
+}
+
+static bool getVarint(const uint8_t* in, int avail, int& pos, int32_t& diff) {
+  uint32_t zz = 0;
+  for (int shift = 0; shift < 35; shift += 7) {
+    if (pos >= avail) return false;
+    uint8_t b = in[pos++];
+    zz |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) {
+      diff = (int32_t)(zz >> 1) ^ -(int32_t)(zz & 1);
+      return true;
+    }
+  }
+  return false;
+}
+
+static void askForKeyframe() {
+  if (!config.keyframeOnGap) return;
+  for (auto& d : downlinks) {
+    if (d.port == DELTA_FPORT) return;  // already on its way
+  }
+  uint8_t cmd = DELTA_CMD_KEYFRAME;
+  netServerQueueDownlink(DELTA_FPORT, &cmd, 1);
+  stats.keyframeRequests++;
+}
+
+// fPort 3: deltas against the base sequence, see delta.h
+static bool decodeDelta(const uint8_t* data, uint8_t len) {
+  if (!schemaValid || len < 4) return false;
+  uint8_t seq = data[0];
+  uint8_t base = data[1];
+  int first = data[2];
+  int count = data[3] & 0x7F;
+  bool final = data[3] & 0x80;
+  bool keyframe = base == seq;
+  uint16_t all = (1u << tableCount) - 1;
+
+  deltaSeen[(uint8_t)(seq + DELTA_HISTORY / 2)] = 0;  // far enough back to be stale
+  if (first + count > tableCount) return false;
+  if (!keyframe && deltaSeen[base] != all) {
+    askForKeyframe();
+    return false;
+  }
+
+  int mapLen = (count + 7) / 8;
+  if (len < 4 + 2 * mapLen) return false;
+  const uint8_t* success = &data[4];
+  const uint8_t* raw = success + mapLen;
+  int pos = 4 + 2 * mapLen;
+
+  for (int k = 0; k < count; k++) {
+    int i = first + k;
+    NetServerRequest& entry = table[i];
+    uint8_t n = min<uint8_t>(entry.numRegs, MAX_REQUEST_REGS);
+    uint16_t* out = deltaValues[seq][i];
+    if (keyframe) {
+      memset(out, 0, sizeof(deltaValues[seq][i]));
+    } else {
+      memcpy(out, deltaValues[base][i], sizeof(deltaValues[seq][i]));
+    }
+    deltaSeen[seq] |= 1 << i;
+    stats.requests++;
+    if (!(success[k / 8] & (1 << (k % 8)))) continue;
+
+    if (raw[k / 8] & (1 << (k % 8))) {
+      if (pos + 2 * n > len) return false;
+      for (int r = 0; r < n; r++) out[r] = (data[pos + 2 * r] << 8) | data[pos + 2 * r + 1];
+      pos += 2 * n;
+    } else {
+      int changedLen = (n + 7) / 8;
+      if (pos + changedLen > len) return false;
+      const uint8_t* changed = &data[pos];
+      pos += changedLen;
+      for (int r = 0; r < n; r++) {
+        if (!(changed[r / 8] & (1 << (r % 8)))) continue;
+        int32_t diff;
+        if (!getVarint(data, len, pos, diff)) return false;
+        out[r] = (uint16_t)(out[r] + diff);
+      }
+    }
+    memcpy(entry.values, out, n * sizeof(uint16_t));
+    for (int r = 0; r < n; r++) entry.rawValue[r] = true;
+    memset(entry.narrowed, 0, sizeof(entry.narrowed));
+    entry.updated = true;
+    stats.registers += n;
+  }
+
+  if (final && pos < len) {
+    uint8_t inputLen = decodeInputSection(&data[pos], len - pos);
+    if (inputLen == 0) return false;
+    pos += inputLen;
+  }
+  return pos == len;
+}
+
+static bool decodeUplink(uint8_t port, const uint8_t* data, uint8_t len) {
+  if (port <= DIAG_FPORT) stats.framesByPort[port]++;
+  switch (port) {
+    case LEGACY_FPORT: return decodeLegacy(data, len);
+    case ALARM_FPORT: return decodeAlarms(data, len);
+    case DELTA_FPORT: return decodeDelta(data, len);
+    case SCHEMA_ANNOUNCE_FPORT: return decodeSchemaAnnounce(data, len);
+    case SCHEMA_DATA_FPORT: return decodeSchemaData(data, len);
+    case DIAG_FPORT: return decodeDiagnostic(data, len);
+    default: return false;
+  }
+}
+
+// ===== Network side =====
+
+static void onUplink(const HalNativeUplink& up, HalNativeDownlink& down) {
+  float snr = config.snrDb + uniform(-config.snrJitterDb, config.snrJitterDb);
+  if (chance(config.lossPct) || snr < demodFloorDb(up.sf)) {
+    stats.lost++;
+    return;
+  }
+
+  // A confirmed retransmission whose first copy got through only needs its ACK
+  if (haveLastFcnt && up.fcnt == lastFcnt) {
+    stats.duplicates++;
+  } else {
+    stats.received++;
+    stats.bytes += up.len;
+    if (!decodeUplink(up.port, up.data, up.len)) stats.undecodable++;
+  }
+  lastFcnt = up.fcnt;
+  haveLastFcnt = true;
+
+  if (config.adr && up.adr) down.adrSF = adrDecision(up.sf, snr);
+  if (up.confirmed && config.ack) down.ack = true;
+  if (!downlinks.empty()) {
+    const QueuedDownlink& d = downlinks.front();
+    down.port = d.port;
+    memcpy(down.data, d.data, d.len);
+    down.len = d.len;
+  }
+
+  bool sending = down.ack || down.adrSF || down.len > 0;
+  if (!sending) return;
+  if (chance(config.ackLossPct)) {
+    down = HalNativeDownlink();  // queued data waits for the next uplink
+    return;
+  }
+  if (down.ack) stats.acksSent++;
+  if (down.len > 0) downlinks.pop_front();
+}
+
+void netServerBegin(const NetServerConfig& cfg) {
+  config = cfg;
+  rng.seed(cfg.seed);
+  memset(&stats, 0, sizeof(stats));
+  lastDiagnostic = NetServerDiagnostic();
+  downlinks.clear();
+  haveLastFcnt = false;
+  snrCount = 0;
+  tableCount = 0;
+  schemaValid = false;
+  pendingSchemaId = 0;
+  pendingRequestMask = 0;
+  memset(deltaSeen, 0, sizeof(deltaSeen));
+  halNativeAttachNetworkServer(onUplink);
+}
+
+void netServerQueueDownlink(uint8_t port, const uint8_t* data, uint8_t len) {
+  QueuedDownlink d;
+  d.port = port;
+  d.len = min<uint8_t>(len, sizeof(d.data));
+  memcpy(d.data, data, d.len);
+  downlinks.push_back(d);
+}
+
+const NetServerStats& netServerStats() {
+  return stats;
+}
+
+const NetServerDiagnostic& netServerLastDiagnostic() {
+  return lastDiagnostic;
+}
+
+int netServerRequestCount() {
+  return tableCount;
+}
+
+const NetServerRequest& netServerRequest(int index) {
+  return table[index];
+}
+
+void netServerTakeUpdates() {
+  for (int i = 0; i < tableCount; i++) table[i].updated = false;
+}
@@ -0,0 +1,126 @@
+#include "aggregate.h"
+
+// Accumulated by the Modbus task after each scan, drained by the radio task
+// once per uplink
+static RequestStats accumulating[MAX_REQUESTS];
+static RequestStats window[MAX_REQUESTS];  // radio task's copy of the closed window
+static portMUX_TYPE aggMux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint8_t statRegs(const ModbusRequest& req) {
+  return req.stats == STAT_LAST ? 0 : req.numRegs;
+}
+
+static uint16_t tableStatRegs() {
+  uint16_t n = 0;
+  for (int i = 0; i < requestCount; i++) n += statRegs(requests[i]);
+  return n;
+}
+
+// Each side of the window gets its own registers, swapped when it closes.
+// A new table starts with empty windows.
+size_t aggregateArenaBytes() {
+  return 2 * arenaSize(tableStatRegs() * sizeof(RegisterStats));
+}
+
+void bindAggregates(Arena& arena) {
+  uint16_t n = tableStatRegs();
+  RegisterStats* acc = arenaArray<RegisterStats>(arena, n);
+  RegisterStats* win = arenaArray<RegisterStats>(arena, n);
+
+  portENTER_CRITICAL(&aggMux);
+  uint16_t at = 0;
+  for (int i = 0; i < MAX_REQUESTS; i++) {
+    bool used = i < requestCount && statRegs(requests[i]) > 0;
+    accumulating[i] = { 0, used ? &acc[at] : nullptr };
+    window[i] = { 0, used ? &win[at] : nullptr };
+    if (used) at += statRegs(requests[i]);
+  }
+  portEXIT_CRITICAL(&aggMux);
+}
+
+void accumulateScan() {
+  portENTER_CRITICAL(&aggMux);
+  for (int i = 0; i < requestCount; i++) {
+    const ModbusRequest& req = requests[i];
+    if (req.stats == STAT_LAST || !req.fresh || !req.success) continue;
+
+    RequestStats& st = accumulating[i];
+    bool first = st.count == 0;
+    if (st.count < 0xFFFF) st.count++;
+    for (int r = 0; r < statRegs(req); r++) {
+      RegisterStats& rs = st.regs[r];
+      uint16_t v = requestValue(requestValues, req, r);
+      if (first) {
+        rs.min = rs.max = v;
+        rs.sum = 0;
+      }
+      rs.min = min(rs.min, v);
+      rs.max = max(rs.max, v);
+      rs.sum += v;
+    }
+  }
+  portEXIT_CRITICAL(&aggMux);
+}
+
+// Closes the window: the totals swap over to the radio task's side and the
+// next scan starts a fresh one, so no sample lands in both or neither
+void takeAggregates() {
+  portENTER_CRITICAL(&aggMux);
+  for (int i = 0; i < MAX_REQUESTS; i++) {
+    RequestStats closed = accumulating[i];
+    accumulating[i] = { 0, window[i].regs };
+    window[i] = closed;
+  }
+  portEXIT_CRITICAL(&aggMux);
+}
+
+const RequestStats& windowStats(int requestIndex) {
+  return window[requestIndex];
+}
+
+// Aggregated requests have data as long as any scan of the window succeeded
+bool requestReportable(const ModbusRequest& req, int requestIndex) {
+  if (req.stats == STAT_LAST) return req.success;
+  return window[requestIndex].count > 0;
+}
+
+// Bytes appended after the last-value words: min, max, mean words, then count
+uint16_t statsLength(const ModbusRequest& req) {
+  uint16_t len = 0;
+  if (req.stats & STAT_MIN) len += statRegs(req) * 2;
+  if (req.stats & STAT_MAX) len += statRegs(req) * 2;
+  if (req.stats & STAT_MEAN) len += statRegs(req) * 2;
+  if (req.stats & STAT_COUNT) len += 2;
+  return len;
+}
+
+uint16_t encodeRequestStats(const ModbusRequest& req, int requestIndex, uint8_t* out) {
+  const RequestStats& st = window[requestIndex];
+  uint8_t n = statRegs(req);
+  uint16_t len = 0;
+
+  if (req.stats & STAT_MIN) {
+    for (int r = 0; r < n; r++) {
+      out[len++] = highByte(st.regs[r].min);
+      out[len++] = lowByte(st.regs[r].min);
+    }
+  }
+  if (req.stats & STAT_MAX) {
+    for (int r = 0; r < n; r++) {
+      out[len++] = highByte(st.regs[r].max);
+      out[len++] = lowByte(st.regs[r].max);
+    }
+  }
+  if (req.stats & STAT_MEAN) {
+    for (int r = 0; r < n; r++) {
+      uint16_t mean = st.count ? (st.regs[r].sum + st.count / 2) / st.count : 0;
+      out[len++] = highByte(mean);
+      out[len++] = lowByte(mean);
+    }
+  }
+  if (req.stats & STAT_COUNT) {
+    out[len++] = highByte(st.count);
+    out[len++] = lowByte(st.count);
+  }
+  return len;
+}
@@ -0,0 +1,104 @@
+#include "airtime.h"
+#include "config.h"
+#include "lora.h"
+
+static uint32_t buckets[AIRTIME_BUCKETS];
+static unsigned long bucketStart = 0;
+static int bucketIndex = 0;
+
+static uint32_t intervalEstimate = 0;   // ms on air of the interval being built
+static uint32_t lastIntervalAirtime = 0;
+static uint8_t stretch = 1;
+
+// Semtech AN1200.13 with explicit header, CRC on, coding rate 4/5 and an
+// 8 symbol preamble. Low data rate optimisation kicks in above 16 ms/symbol.
+uint32_t timeOnAirMs(uint8_t sf, uint32_t bandwidthHz, uint8_t phyPayloadLen) {
+  float tSym = (float)(1UL << sf) / bandwidthHz * 1000.0f;
+  int de = tSym > 16.0f ? 1 : 0;
+  float tPreamble = (8 + 4.25f) * tSym;
+
+  int num = 8 * phyPayloadLen - 4 * sf + 28 + 16;
+  int den = 4 * (sf - 2 * de);
+  int symbols = 8 + max((int)ceil((float)num / den) * 5, 0);
+
+  return (uint32_t)ceil(tPreamble + symbols * tSym);
+}
+
+uint32_t currentTimeOnAirMs(uint8_t appPayloadLen) {
+  return timeOnAirMs(getCurrentSF(), getCurrentBandwidth(), appPayloadLen + LORAWAN_OVERHEAD);
+}
+
+// Retire buckets that have slid out of the window
+static void advanceBuckets() {
+  unsigned long width = LORA_AIRTIME_WINDOW / AIRTIME_BUCKETS;
+  unsigned long now = millis();
+  int steps = 0;
+  while (now - bucketStart >= width && steps < AIRTIME_BUCKETS) {
+    bucketStart += width;
+    bucketIndex = (bucketIndex + 1) % AIRTIME_BUCKETS;
+    buckets[bucketIndex] = 0;
+    steps++;
+  }
+  if (steps == AIRTIME_BUCKETS) bucketStart = now;
+}
+
+void recordAirtime(uint32_t ms) {
+  advanceBuckets();
+  buckets[bucketIndex] += ms;
+}
+
+uint32_t airtimeUsedMs() {
+  advanceBuckets();
+  uint32_t total = 0;
+  for (int i = 0; i < AIRTIME_BUCKETS; i++) total += buckets[i];
+  return total;
+}
+
+// Alarms always go out. Everything else has to fit in what is left.
+bool airtimeAllows(TxPriority priority, uint8_t appPayloadLen) {
+  if (LORA_AIRTIME_BUDGET == 0 || priority == TX_PRIORITY_ALARM) return true;
+  return airtimeUsedMs() + currentTimeOnAirMs(appPayloadLen) <= LORA_AIRTIME_BUDGET;
+}
+
+void startIntervalEstimate() {
+  intervalEstimate = 0;
+}
+
+void addIntervalFrame(uint8_t appPayloadLen) {
+  intervalEstimate += currentTimeOnAirMs(appPayloadLen);
+}
+
+// Stretch the uplink interval so one interval's frames fit the share of the
+// budget that interval is entitled to
+void finishIntervalEstimate() {
+  lastIntervalAirtime = intervalEstimate;
+  if (LORA_AIRTIME_BUDGET == 0 || lastIntervalAirtime == 0) {
+    stretch = 1;
+    return;
+  }
+
+  float allowance = (float)LORA_AIRTIME_BUDGET * LORA_UPLINK_INTERVAL / LORA_AIRTIME_WINDOW;
+  uint8_t next = constrain((int)ceil(lastIntervalAirtime / allowance), 1, 255);
+  if (next != stretch) {
+    Serial.printf("Airtime: uplink interval stretched x%u (%lu ms per interval)\n", next, (unsigned long)lastIntervalAirtime);
+  }
+  stretch = next;
+}
+
+unsigned long effectiveUplinkInterval() {
+  return LORA_UPLINK_INTERVAL * stretch;
+}
+
+void printAirtimeStatus() {
+  uint32_t used = airtimeUsedMs();
+  Serial.printf("SF%u @ %lu kHz, last interval %lu ms on air\n", getCurrentSF(),
+                (unsigned long)(getCurrentBandwidth() / 1000), (unsigned long)lastIntervalAirtime);
+  if (LORA_AIRTIME_BUDGET == 0) {
+    Serial.printf("Airtime: %lu ms in the last %lu s, budget unlimited\n",
+                  (unsigned long)used, LORA_AIRTIME_WINDOW / 1000);
+    return;
+  }
+  Serial.printf("Airtime: %lu / %lu ms in the last %lu s (%.1f%%)\n", (unsigned long)used,
+                LORA_AIRTIME_BUDGET, LORA_AIRTIME_WINDOW / 1000, 100.0f * used / LORA_AIRTIME_BUDGET);
+  Serial.printf("Uplink interval %lu ms (x%u stretch)\n", LORA_UPLINK_INTERVAL * stretch, stretch);
+}
@@ -0,0 +1,224 @@
+#include "alarms.h"
+#include "tasks.h"
+
+AlarmRule* alarmRules = nullptr;
+int alarmRuleCount = 0;
+AlarmTerm* alarmTerms = nullptr;
+int alarmTermCount = 0;
+
+// Compiled into while a config loads, released once the table is built
+static AlarmRule* scratchRules = nullptr;
+static AlarmTerm* scratchTerms = nullptr;
+
+static const char opChars[] = { '>', '<', '=', 'r' };
+
+void clearAlarmRules() {
+  if (!scratchRules) {
+    scratchRules = new AlarmRule[MAX_ALARM_RULES];
+    scratchTerms = new AlarmTerm[MAX_ALARM_TERMS];
+  }
+  alarmRules = scratchRules;
+  alarmTerms = scratchTerms;
+  alarmRuleCount = 0;
+  alarmTermCount = 0;
+}
+
+size_t alarmArenaBytes() {
+  return arenaSize(alarmRuleCount * sizeof(AlarmRule)) + arenaSize(alarmTermCount * sizeof(AlarmTerm));
+}
+
+void bindAlarmRules(Arena& arena) {
+  AlarmRule* rules = arenaArray<AlarmRule>(arena, alarmRuleCount);
+  AlarmTerm* terms = arenaArray<AlarmTerm>(arena, alarmTermCount);
+  if (alarmRuleCount > 0) memcpy(rules, alarmRules, alarmRuleCount * sizeof(AlarmRule));
+  if (alarmTermCount > 0) memcpy(terms, alarmTerms, alarmTermCount * sizeof(AlarmTerm));
+  alarmRules = rules;
+  alarmTerms = terms;
+
+  delete[] scratchRules;
+  delete[] scratchTerms;
+  scratchRules = nullptr;
+  scratchTerms = nullptr;
+}
+
+static bool compileTerm(JsonObject obj, uint8_t owner, AlarmTerm& t) {
+  if (!obj.containsKey("index") || !obj.containsKey("op") || !obj.containsKey("threshold")) return false;
+
+  String op = obj["op"].as<String>();
+  if (op == ">") t.op = ALARM_OP_GT;
+  else if (op == "<") t.op = ALARM_OP_LT;
+  else if (op == "=") t.op = ALARM_OP_EQ;
+  else if (op == "rate") t.op = ALARM_OP_RATE;
+  else return false;
+
+  t.request = obj["request"] | owner;  // other requests may be referenced by table index
+  t.index = obj["index"];
+  t.field = -1;
+  t.threshold = obj["threshold"].as<float>();
+  t.hysteresis = obj["hysteresis"] | 0.0f;
+  t.active = false;
+  t.hasLast = false;
+  t.measured = 0;
+  return true;
+}
+
+// Each entry of a request's "alarms" array is either a single condition or
+// { "all": [...] } / { "any": [...] } over up to MAX_TERMS_PER_RULE of them.
+// "debounce" (ms) sits on the rule, "hysteresis" on each condition.
+int compileAlarmRules(uint8_t requestIndex, JsonArray rules) {
+  int compiled = 0;
+
+  for (JsonObject obj : rules) {
+    if (alarmRuleCount >= MAX_ALARM_RULES || compiled >= MAX_ALARMS_PER_REQUEST) break;
+
+    AlarmRule& rule = alarmRules[alarmRuleCount];
+    rule.firstTerm = alarmTermCount;
+    rule.termCount = 0;
+    rule.any = obj.containsKey("any");
+    rule.active = false;
+    rule.debounceMs = obj["debounce"] | 0;
+    rule.holdingSince = 0;
+
+    bool ok = true;
+    if (obj.containsKey("all") || obj.containsKey("any")) {
+      JsonArray terms = obj[rule.any ? "any" : "all"];
+      for (JsonObject term : terms) {
+        if (rule.termCount >= MAX_TERMS_PER_RULE || alarmTermCount >= MAX_ALARM_TERMS ||
+            !compileTerm(term, requestIndex, alarmTerms[alarmTermCount])) {
+          ok = false;
+          break;
+        }
+        alarmTermCount++;
+        rule.termCount++;
+      }
+    } else if (alarmTermCount < MAX_ALARM_TERMS && compileTerm(obj, requestIndex, alarmTerms[alarmTermCount])) {
+      alarmTermCount++;
+      rule.termCount = 1;
+    } else {
+      ok = false;
+    }
+
+    if (!ok || rule.termCount == 0) {
+      Serial.printf("Skipping malformed alarm rule on request %d\n", requestIndex);
+      alarmTermCount = rule.firstTerm;
+      continue;
+    }
+    alarmRuleCount++;
+    compiled++;
+  }
+  return compiled;
+}
+
+// Cross-request references and typed fields can only be resolved once the
+// whole table is loaded
+void validateAlarmRules() {
+  for (int r = 0; r < alarmRuleCount; r++) {
+    AlarmRule& rule = alarmRules[r];
+    for (int i = 0; i < rule.termCount; i++) {
+      AlarmTerm& t = alarmTerms[rule.firstTerm + i];
+      if (t.request >= requestCount || t.index >= requests[t.request].numRegs) {
+        Serial.printf("Alarm rule %d disabled: request %u has no Reg[%u]\n", r, t.request, t.index);
+        rule.termCount = 0;
+        break;
+      }
+      t.field = findField(fields, fieldCount, t.request, t.index);
+    }
+  }
+}
+
+// Updates the term's latched state from this poll's reading. A failed read,
+// or a request that was not due, leaves the state as it was.
+static bool evaluateTerm(AlarmTerm& t, unsigned long now) {
+  const ModbusRequest& req = requests[t.request];
+  if (!req.fresh || !req.success) return t.active;
+
+  float value = t.field >= 0 ? fieldValues[t.field] : requestValue(requestValues, req, t.index);
+  float measured = value;
+
+  if (t.op == ALARM_OP_RATE) {
+    bool hadLast = t.hasLast;
+    unsigned long dt = now - t.lastAt;
+    float change = fabsf(value - t.lastValue);
+    t.lastValue = value;
+    t.lastAt = now;
+    t.hasLast = true;
+    if (!hadLast) return t.active = false;
+    measured = change * 1000.0f / max(dt, 1UL);
+  }
+  t.measured = measured;
+
+  float thr = t.threshold;
+  float hyst = t.hysteresis;
+  switch (t.op) {
+    case ALARM_OP_GT:
+    case ALARM_OP_RATE:
+      t.active = t.active ? measured + hyst > thr : measured > thr;
+      break;
+    case ALARM_OP_LT:
+      t.active = t.active ? measured < thr + hyst : measured < thr;
+      break;
+    case ALARM_OP_EQ:
+      t.active = t.active ? fabsf(measured - thr) <= hyst : measured == thr;
+      break;
+  }
+  return t.active;
+}
+
+// Alarm records carry 16-bit words: values are rounded, and negative values of
+// signed fields go out as two's complement
+static uint16_t alarmWord(float v) {
+  if (isnan(v)) return 0;
+  return (uint16_t)(int32_t)lroundf(constrain(v, -32768.0f, 65535.0f));
+}
+
+static void raiseAlarm(const AlarmTerm& t) {
+  const ModbusRequest& req = requests[t.request];
+  Serial.printf("Alarm triggered: Reg[%d] = %g %c %g\n", t.index, t.measured, opChars[t.op], t.threshold);
+
+  AlarmEvent ev = {};
+  ev.source = ALARM_SOURCE_MODBUS;
+  ev.slaveIP = req.slaveIP;
+  ev.unitID = req.unitID;
+  ev.reg = req.startReg + t.index;
+  ev.op = opChars[t.op];
+  ev.threshold = alarmWord(t.threshold);
+  ev.value = alarmWord(t.measured);
+  postAlarm(ev);
+}
+
+// Runs once at the end of every scan, after all replies are in
+void evaluateAlarmRules() {
+  unsigned long now = millis();
+
+  for (int r = 0; r < alarmRuleCount; r++) {
+    AlarmRule& rule = alarmRules[r];
+    if (rule.termCount == 0) continue;
+
+    // Every term is evaluated so rate terms keep their sample history
+    bool holding = !rule.any;
+    int reportTerm = rule.firstTerm;
+    for (int i = 0; i < rule.termCount; i++) {
+      int ti = rule.firstTerm + i;
+      bool termActive = evaluateTerm(alarmTerms[ti], now);
+      if (rule.any) {
+        if (termActive && !holding) reportTerm = ti;
+        holding = holding || termActive;
+      } else {
+        holding = holding && termActive;
+      }
+    }
+
+    if (!holding) {
+      rule.holdingSince = 0;
+      rule.active = false;  // re-arm
+      continue;
+    }
+    if (rule.active) continue;
+
+    if (rule.holdingSince == 0) rule.holdingSince = now ? now : 1;
+    if (now - rule.holdingSince < rule.debounceMs) continue;
+
+    rule.active = true;
+    raiseAlarm(alarmTerms[reportTerm]);
+  }
+}
@@ -0,0 +1,26 @@
+#include "arena.h"
+
+bool arenaReset(Arena& arena, size_t bytes) {
+  free(arena.base);
+  arena.base = nullptr;
+  arena.size = 0;
+  arena.used = 0;
+  if (bytes == 0) return true;
+
+  arena.base = static_cast<uint8_t*>(malloc(bytes));
+  if (!arena.base) {
+    Serial.printf("Arena: %u bytes not available\n", (unsigned)bytes);
+    return false;
+  }
+  arena.size = bytes;
+  memset(arena.base, 0, bytes);
+  return true;
+}
+
+void* arenaAlloc(Arena& arena, size_t bytes) {
+  size_t len = arenaSize(bytes);
+  if (arena.used + len > arena.size) return nullptr;
+  void* p = arena.base + arena.used;
+  arena.used += len;
+  return p;
+}
@@ -0,0 +1,35 @@
+#include "bootprof.h"
+
+struct BootMark {
+  const char* phase;
+  uint32_t at;
+};
+
+static BootMark marks[BOOT_MAX_MARKS];
+static int markCount = 0;
+static portMUX_TYPE bootMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Phase names are string literals, so the pointer identifies the phase
+void bootMark(const char* phase) {
+  uint32_t now = micros();
+  portENTER_CRITICAL(&bootMux);
+  bool seen = false;
+  for (int i = 0; i < markCount && !seen; i++) seen = marks[i].phase == phase;
+  if (!seen && markCount < BOOT_MAX_MARKS) marks[markCount++] = { phase, now };
+  portEXIT_CRITICAL(&bootMux);
+}
+
+void printBootProfile() {
+  BootMark copy[BOOT_MAX_MARKS];
+  portENTER_CRITICAL(&bootMux);
+  int count = markCount;
+  memcpy(copy, marks, count * sizeof(BootMark));
+  portEXIT_CRITICAL(&bootMux);
+
+  Serial.println("Boot profile (ms since app start, +ms since previous phase):");
+  uint32_t prev = 0;
+  for (int i = 0; i < count; i++) {
+    Serial.printf("  %9.1f  +%8.1f  %s\n", copy[i].at / 1000.0, (copy[i].at - prev) / 1000.0, copy[i].phase);
+    prev = copy[i].at;
+  }
+}
@@ -11,10 +11,13 @@ bool joined = false;
 uint16_t uplinkCount = 0;
 
 unsigned long MODBUS_SCAN_INTERVAL = 5000;
+unsigned long MODBUS_REQUEST_TIMEOUT = 1000;
+uint16_t MODBUS_MAX_GAP = 0;
 
 
-// Format: { IPAddress(a, b, c, d), unitID, startRegister, numRegisters, {0}, successFlag, functionCode}
-ModbusRequest requests[MAX_REQUESTS] = {
+// Built-in table, used until modbus.json (or the config image) has been loaded
+// Format: { IPAddress(a, b, c, d), unitID, startRegister, numRegisters, functionCode }
+static ModbusRequest defaultRequests[] = {
     ModbusRequest(IPAddress(192, 168, 0, 187), 1, 0, 4, READ_HREG),
     ModbusRequest(IPAddress(192, 168, 0, 187), 1, 4100, 8, READ_COILS),
     ModbusRequest(IPAddress(192, 168, 0, 187), 1, 1100, 2, READ_IREG),
@@ -22,7 +25,9 @@ ModbusRequest requests[MAX_REQUESTS] = {
   };
   
   
+ModbusRequest* requests = defaultRequests;
 int requestCount = 4;
+uint16_t* requestValues = nullptr;
 
 uint8_t DEVEUI[8]  = { 0x0E,0x7A,0x5B,0x11,0x8B,0x3F,0x10,0x2B };
 uint8_t APPEUI[8]  = { 0x8F,0xCD,0xCE,0xB4,0x06,0xAD,0xBC,0x06 };
@@ -45,6 +50,11 @@ unsigned long LORA_UPLINK_INTERVAL = 10000;  // ms
 uint8_t LORA_SUBBAND = 4;                    // AU915 sub-band 4
 bool LORA_ADR = true;                        // Adaptive Data Rate
 uint8_t LORA_SF = 7;  // default to SF7
+uint8_t LORA_ENCODING = ENCODING_FULL;       // "full", "schema" or "delta"
+uint16_t LORA_KEYFRAME_EVERY = 10;           // uplinks between forced keyframes
+unsigned long LORA_AIRTIME_BUDGET = 0;       // unlimited unless "airtimeBudget" is set
+unsigned long LORA_AIRTIME_WINDOW = 3600000; // rolling 1 h window
+unsigned long LORA_DIAG_INTERVAL = 0;        // diagnostic uplink off unless "diagInterval" is set
 unsigned long lastUplink = -LORA_UPLINK_INTERVAL;  // triggers immediately
 
 // ----- Join Mode -----
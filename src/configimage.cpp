@@ -0,0 +1,204 @@
+#include <LittleFS.h>
+#include <esp_partition.h>
+#include <esp_rom_crc.h>
+#include "configimage.h"
+#include "flashfs.h"
+#include "table.h"
+#include "hal.h"
+
+static const char* sourcePaths[CONFIG_SOURCE_COUNT] = {
+  "/ethernet.json", "/lora.json", "/modbus.json", "/inputs.json"
+};
+
+// Streams the file through the ROM CRC routine; no String, no parsing
+static uint32_t sourceCrc(const char* path) {
+  File file = LittleFS.open(path, "r");
+  if (!file) return 0;
+
+  uint8_t buf[256];
+  uint32_t crc = 0;
+  size_t n;
+  while ((n = file.read(buf, sizeof(buf))) > 0) crc = esp_rom_crc32_le(crc, buf, n);
+  crc ^= file.size();  // an empty file still differs from a missing one
+  file.close();
+  return crc;
+}
+
+static const esp_partition_t* imagePartition() {
+  return esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY, CONFIG_IMAGE_PARTITION);
+}
+
+static void applyImage(const ConfigImageBody& img) {
+  memcpy(MAC_ADDR, img.mac, sizeof(img.mac));
+  enableEthernet = img.enableEthernet;
+  useDHCP = img.useDHCP;
+  ETH_IP = IPAddress(img.ip);
+  ETH_GATEWAY = IPAddress(img.gateway);
+  ETH_SUBNET = IPAddress(img.subnet);
+  ETH_DNS = IPAddress(img.dns);
+
+  JOIN_MODE_ABP = img.joinABP;
+  LORA_ADR = img.adr;
+  LORA_SUBBAND = img.subband;
+  LORA_SF = img.sf;
+  LORA_ENCODING = img.encoding;
+  memcpy(DEVEUI, img.devEui, sizeof(DEVEUI));
+  memcpy(APPEUI, img.appEui, sizeof(APPEUI));
+  memcpy(APPKEY, img.appKey, sizeof(APPKEY));
+  memcpy(NWKSKEY, img.nwkSKey, sizeof(NWKSKEY));
+  memcpy(APPSKEY, img.appSKey, sizeof(APPSKEY));
+  DEVADDR = img.devAddr;
+  LORA_UPLINK_INTERVAL = img.uplinkInterval;
+  LORA_KEYFRAME_EVERY = img.keyframeEvery;
+  LORA_AIRTIME_BUDGET = img.airtimeBudget;
+  LORA_AIRTIME_WINDOW = img.airtimeWindow;
+  LORA_DIAG_INTERVAL = img.diagInterval;
+
+  MODBUS_SCAN_INTERVAL = img.scanInterval;
+  MODBUS_REQUEST_TIMEOUT = img.requestTimeout;
+  MODBUS_MAX_GAP = img.maxGap;
+
+  beginRequestTable();
+  requestCount = img.requestCount;
+  for (int i = 0; i < requestCount; i++) {
+    const ImageRequest& r = img.requests[i];
+    requests[i] = ModbusRequest(IPAddress(r.ip), r.unitID, r.startReg, r.numRegs, static_cast<ModbusFunction>(r.function));
+    requests[i].stats = r.stats;
+    requests[i].intervalMs = r.intervalMs;
+    requests[i].phaseMs = r.phaseMs;
+  }
+  fieldCount = img.fieldCount;
+  memcpy(fields, img.fields, fieldCount * sizeof(FieldDesc));
+  alarmRuleCount = img.ruleCount;
+  memcpy(alarmRules, img.rules, alarmRuleCount * sizeof(AlarmRule));
+  alarmTermCount = img.termCount;
+  memcpy(alarmTerms, img.terms, alarmTermCount * sizeof(AlarmTerm));
+
+  applyInputs(img.inputs, img.inputCount);
+}
+
+// True when a valid image built from the current JSON sources was applied
+bool loadConfigImage() {
+  const esp_partition_t* part = imagePartition();
+  if (!part) {
+    Serial.println("Config image: no cfgimg partition");
+    return false;
+  }
+
+  uint32_t sources[CONFIG_SOURCE_COUNT];
+  for (int i = 0; i < CONFIG_SOURCE_COUNT; i++) sources[i] = sourceCrc(sourcePaths[i]);
+
+  const void* mapped = nullptr;
+  esp_partition_mmap_handle_t handle;
+  size_t mapSize = sizeof(ConfigImageHeader) + sizeof(ConfigImageBody);
+  if (mapSize > part->size || esp_partition_mmap(part, 0, mapSize, ESP_PARTITION_MMAP_DATA, &mapped, &handle) != ESP_OK) {
+    Serial.println("Config image: mmap failed");
+    return false;
+  }
+
+  const ConfigImageHeader* hdr = (const ConfigImageHeader*)mapped;
+  const ConfigImageBody* body = (const ConfigImageBody*)(hdr + 1);
+  const char* reason = nullptr;
+
+  if (hdr->magic != CONFIG_IMAGE_MAGIC || hdr->version != CONFIG_IMAGE_VERSION ||
+      hdr->layout != (uint16_t)sizeof(ConfigImageBody) || hdr->length != sizeof(ConfigImageBody)) {
+    reason = "missing or from another firmware";
+  } else if (memcmp(hdr->sources, sources, sizeof(sources)) != 0) {
+    reason = "JSON sources changed";
+  } else if (esp_rom_crc32_le(0, (const uint8_t*)body, sizeof(ConfigImageBody)) != hdr->crc) {
+    reason = "CRC mismatch";
+  }
+
+  if (reason) {
+    Serial.printf("Config image: %s, loading JSON\n", reason);
+    esp_partition_munmap(handle);
+    return false;
+  }
+
+  applyImage(*body);
+  esp_partition_munmap(handle);
+  buildRequestTable();
+  Serial.printf("Config image applied: %d requests, %d alarm rules, %d fields\n", requestCount, alarmRuleCount, fieldCount);
+  return true;
+}
+
+// Captures the configuration the JSON loaders just applied
+void compileConfigImage() {
+  const esp_partition_t* part = imagePartition();
+  if (!part) return;
+
+  static ConfigImageBody img;
+  memset(&img, 0, sizeof(img));
+
+  memcpy(img.mac, MAC_ADDR, sizeof(img.mac));
+  img.enableEthernet = enableEthernet;
+  img.useDHCP = useDHCP;
+  img.ip = (uint32_t)ETH_IP;
+  img.gateway = (uint32_t)ETH_GATEWAY;
+  img.subnet = (uint32_t)ETH_SUBNET;
+  img.dns = (uint32_t)ETH_DNS;
+
+  img.joinABP = JOIN_MODE_ABP;
+  img.adr = LORA_ADR;
+  img.subband = LORA_SUBBAND;
+  img.sf = LORA_SF;
+  img.encoding = LORA_ENCODING;
+  memcpy(img.devEui, DEVEUI, sizeof(img.devEui));
+  memcpy(img.appEui, APPEUI, sizeof(img.appEui));
+  memcpy(img.appKey, APPKEY, sizeof(img.appKey));
+  memcpy(img.nwkSKey, NWKSKEY, sizeof(img.nwkSKey));
+  memcpy(img.appSKey, APPSKEY, sizeof(img.appSKey));
+  img.devAddr = DEVADDR;
+  img.uplinkInterval = LORA_UPLINK_INTERVAL;
+  img.keyframeEvery = LORA_KEYFRAME_EVERY;
+  img.airtimeBudget = LORA_AIRTIME_BUDGET;
+  img.airtimeWindow = LORA_AIRTIME_WINDOW;
+  img.diagInterval = LORA_DIAG_INTERVAL;
+
+  img.scanInterval = MODBUS_SCAN_INTERVAL;
+  img.requestTimeout = MODBUS_REQUEST_TIMEOUT;
+  img.maxGap = MODBUS_MAX_GAP;
+  img.requestCount = requestCount;
+  for (int i = 0; i < requestCount; i++) {
+    const ModbusRequest& req = requests[i];
+    img.requests[i] = { (uint32_t)req.slaveIP, req.startReg, req.unitID, req.numRegs,
+                        static_cast<uint8_t>(req.function), req.stats, req.intervalMs, req.phaseMs };
+  }
+  img.fieldCount = fieldCount;
+  memcpy(img.fields, fields, fieldCount * sizeof(FieldDesc));
+  img.ruleCount = alarmRuleCount;
+  memcpy(img.rules, alarmRules, alarmRuleCount * sizeof(AlarmRule));
+  img.termCount = alarmTermCount;
+  memcpy(img.terms, alarmTerms, alarmTermCount * sizeof(AlarmTerm));
+  img.inputCount = inputCount;
+  for (int i = 0; i < inputCount; i++) img.inputs[i] = inputConfigs[i];
+
+  ConfigImageHeader hdr = {};
+  hdr.magic = CONFIG_IMAGE_MAGIC;
+  hdr.version = CONFIG_IMAGE_VERSION;
+  hdr.layout = sizeof(ConfigImageBody);
+  hdr.length = sizeof(ConfigImageBody);
+  hdr.crc = esp_rom_crc32_le(0, (const uint8_t*)&img, sizeof(img));
+  for (int i = 0; i < CONFIG_SOURCE_COUNT; i++) hdr.sources[i] = sourceCrc(sourcePaths[i]);
+
+  // Body first, header last: a power cut in between leaves no valid magic
+  size_t total = sizeof(hdr) + sizeof(img);
+  size_t eraseSize = (total + 4095) & ~4095;
+  if (eraseSize > part->size ||
+      esp_partition_erase_range(part, 0, eraseSize) != ESP_OK ||
+      esp_partition_write(part, sizeof(hdr), &img, sizeof(img)) != ESP_OK ||
+      esp_partition_write(part, 0, &hdr, sizeof(hdr)) != ESP_OK) {
+    Serial.println("Config image: write failed");
+    return;
+  }
+  Serial.printf("Config image compiled (%u bytes)\n", (unsigned)total);
+}
+
+// Boot uses the image when it is current; a reload always goes back to JSON
+void loadConfig(bool allowImage) {
+  if (allowImage && loadConfigImage()) return;
+
+  loadModbusConfigFromFlash();  // also applies ethernet.json and lora.json
+  loadInputsConfig();
+  compileConfigImage();
+}
@@ -0,0 +1,240 @@
+#include "delta.h"
+#include "config.h"
+#include "lora.h"
+
+#define DELTA_HEADER_LEN 4
+#define DELTA_FINAL_FLAG 0x80
+
+// Value stores in the request table layout, so both change with the table
+static uint16_t* reference = nullptr;
+static int referenceCount = -1;              // -1 = no acknowledged base yet
+static uint8_t baseSeq = 0;
+static uint8_t nextSeq = 0;
+static uint16_t sinceKeyframe = 0;
+static volatile bool keyframeRequested = false;
+static uint16_t slotCount = 0;
+
+// Values the decoder will hold once every frame of the interval in flight lands
+static uint16_t* pending = nullptr;
+static int pendingCount = 0;
+static uint8_t pendingSeq = 0;
+static bool pendingKeyframe = false;
+static int pendingFrames = 0;  // frames still in the TX queue, 0 = nothing in flight
+static bool pendingFailed = false;
+static bool pendingLanded = false;  // acknowledged, copied over to the base at the next encode
+
+// TX completion runs outside the table lock, so it only counts frames here;
+// the value stores are touched by the encoder and the rebuild alone
+static portMUX_TYPE deltaMux = portMUX_INITIALIZER_UNLOCKED;
+
+static uint8_t* pieces = nullptr;  // one worst-case piece per request
+
+void requestKeyframe() {
+  keyframeRequested = true;
+}
+
+// Changed bitmap plus a varint of up to 3 bytes per register
+static uint16_t maxPieceLen(const ModbusRequest& req) {
+  return (req.numRegs + 7) / 8 + 3 * req.numRegs;
+}
+
+uint16_t deltaFrameLength(const ModbusRequest& req) {
+  return DELTA_HEADER_LEN + 2 + 2 * req.numRegs;
+}
+
+static uint16_t tablePieceBytes() {
+  uint16_t n = 0;
+  for (int i = 0; i < requestCount; i++) n += maxPieceLen(requests[i]);
+  return n;
+}
+
+size_t deltaArenaBytes(uint16_t valueSlots) {
+  return 2 * arenaSize(valueSlots * sizeof(uint16_t)) + arenaSize(tablePieceBytes());
+}
+
+// A new table has no base, and ACKs for frames of the old one are ignored
+void bindDelta(Arena& arena, uint16_t valueSlots) {
+  reference = arenaArray<uint16_t>(arena, valueSlots);
+  pending = arenaArray<uint16_t>(arena, valueSlots);
+  pieces = arenaArray<uint8_t>(arena, tablePieceBytes());
+  slotCount = valueSlots;
+  referenceCount = -1;
+  portENTER_CRITICAL(&deltaMux);
+  pendingFrames = 0;
+  pendingLanded = false;
+  portEXIT_CRITICAL(&deltaMux);
+}
+
+static uint8_t putVarint(uint8_t* out, int32_t diff) {
+  uint32_t zz = ((uint32_t)diff << 1) ^ (uint32_t)(diff >> 31);
+  uint8_t len = 0;
+  while (zz >= 0x80) {
+    out[len++] = (zz & 0x7F) | 0x80;
+    zz >>= 7;
+  }
+  out[len++] = zz;
+  return len;
+}
+
+// Encode one request against its base values. Returns the piece length and
+// reports whether the raw form was used (chosen whenever it is not larger).
+static uint16_t encodePiece(const ModbusRequest& req, const uint16_t* values, const uint16_t* base, bool keyframe,
+                            uint8_t* out, bool& raw) {
+  uint8_t n = req.numRegs;
+
+  uint16_t deltaLen = 0;
+  if (!keyframe) {
+    uint8_t mapLen = (n + 7) / 8;
+    memset(out, 0, mapLen);
+    deltaLen = mapLen;
+    for (int r = 0; r < n; r++) {
+      uint16_t value = requestValue(values, req, r);
+      uint16_t prev = requestValue(base, req, r);
+      if (value == prev) continue;
+      out[r / 8] |= 1 << (r % 8);
+      deltaLen += putVarint(&out[deltaLen], (int32_t)value - (int32_t)prev);
+    }
+    if (deltaLen < n * 2) {
+      raw = false;
+      return deltaLen;
+    }
+  }
+
+  raw = true;
+  for (int r = 0; r < n; r++) {
+    uint16_t value = requestValue(values, req, r);
+    out[r * 2] = highByte(value);
+    out[r * 2 + 1] = lowByte(value);
+  }
+  return n * 2;
+}
+
+// Only an interval the network fully acknowledged may become the new base
+static void onDeltaFrameDone(uint32_t tag, bool acked) {
+  portENTER_CRITICAL(&deltaMux);
+  if (tag == pendingSeq && pendingFrames > 0) {
+    if (!acked) pendingFailed = true;
+    if (--pendingFrames == 0 && !pendingFailed) pendingLanded = true;
+  }
+  portEXIT_CRITICAL(&deltaMux);
+}
+
+static void promoteLandedInterval() {
+  portENTER_CRITICAL(&deltaMux);
+  bool landed = pendingLanded;
+  pendingLanded = false;
+  portEXIT_CRITICAL(&deltaMux);
+  if (!landed) return;
+
+  if (slotCount > 0) memcpy(reference, pending, slotCount * sizeof(uint16_t));
+  referenceCount = pendingCount;
+  baseSeq = pendingSeq;
+
+  if (pendingKeyframe) {
+    keyframeRequested = false;
+    sinceKeyframe = 0;
+  } else {
+    sinceKeyframe++;
+  }
+}
+
+void sendDeltaUplink(const RegisterSnapshot& snap, const uint8_t* inputSection, uint8_t inputLen, uint16_t mtu) {
+  promoteLandedInterval();
+  bool keyframe = keyframeRequested || snap.count != referenceCount || sinceKeyframe >= LORA_KEYFRAME_EVERY;
+  uint8_t seq = nextSeq++;
+  uint8_t base = keyframe ? seq : baseSeq;
+
+  // A newer interval supersedes one still in the queue; its ACKs are ignored
+  pendingSeq = seq;
+  pendingKeyframe = keyframe;
+  pendingCount = snap.count;
+  pendingFrames = 0;
+  pendingFailed = false;
+
+  // A keyframe is taken against all zeros
+  if (slotCount > 0) {
+    if (keyframe) memset(pending, 0, slotCount * sizeof(uint16_t));
+    else memcpy(pending, reference, slotCount * sizeof(uint16_t));
+  }
+
+  uint8_t* piece[MAX_REQUESTS];
+  uint16_t pieceLen[MAX_REQUESTS];
+  bool pieceRaw[MAX_REQUESTS];
+  bool pieceSent[MAX_REQUESTS];
+
+  uint16_t at = 0;
+  for (int i = 0; i < snap.count; i++) {
+    const ModbusRequest& req = snap.requests[i];
+    piece[i] = &pieces[at];
+    at += maxPieceLen(req);
+    pieceLen[i] = 0;
+    pieceRaw[i] = false;
+    pieceSent[i] = false;
+    if (!req.success) continue;
+
+    uint16_t len = encodePiece(req, snap.values, reference, keyframe, piece[i], pieceRaw[i]);
+    if (DELTA_HEADER_LEN + 2 + len > mtu) {
+      // Sent as failed, so the decoder keeps its base values for it
+      Serial.printf("Delta: request %d does not fit a %u byte frame\n", i, mtu);
+      continue;
+    }
+    pieceLen[i] = len;
+    pieceSent[i] = true;
+    memcpy(&pending[req.valueOffset], &snap.values[req.valueOffset], requestValueSlots(req) * sizeof(uint16_t));
+  }
+
+  uint8_t frame[256];
+  int first = 0;
+
+  do {
+    // Take as many whole requests as fit next to the header and bitmaps
+    int count = 0;
+    uint16_t body = 0;
+    while (first + count < snap.count && count < 0x7F) {
+      uint8_t mapLen = (count + 1 + 7) / 8;
+      if (DELTA_HEADER_LEN + 2 * mapLen + body + pieceLen[first + count] > mtu) break;
+      body += pieceLen[first + count];
+      count++;
+    }
+    if (count == 0 && first < snap.count) {
+      // Cannot happen: pieces that do not fit alone were dropped above
+      Serial.printf("Delta: request %d does not fit a %u byte frame\n", first, mtu);
+      pendingFailed = true;
+      break;
+    }
+
+    uint8_t mapLen = (count + 7) / 8;
+    uint16_t len = DELTA_HEADER_LEN + 2 * mapLen + body;
+    bool final = first + count == snap.count && len + inputLen <= mtu;
+
+    frame[0] = seq;
+    frame[1] = base;
+    frame[2] = first;
+    frame[3] = count | (final ? DELTA_FINAL_FLAG : 0);
+    uint8_t* successMap = &frame[DELTA_HEADER_LEN];
+    uint8_t* rawMap = successMap + mapLen;
+    memset(successMap, 0, 2 * mapLen);
+
+    uint16_t pos = DELTA_HEADER_LEN + 2 * mapLen;
+    for (int k = 0; k < count; k++) {
+      int i = first + k;
+      if (!pieceSent[i]) continue;
+      successMap[k / 8] |= 1 << (k % 8);
+      if (pieceRaw[i]) rawMap[k / 8] |= 1 << (k % 8);
+      memcpy(&frame[pos], piece[i], pieceLen[i]);
+      pos += pieceLen[i];
+    }
+
+    if (final) {
+      memcpy(&frame[pos], inputSection, inputLen);
+      pos += inputLen;
+    }
+
+    pendingFrames++;
+    if (!sendLoRaPayloadChunk(frame, pos, DELTA_FPORT, onDeltaFrameDone, seq)) pendingFailed = true;
+    first += count;
+    if (final) break;
+  } while (true);
+
+  Serial.printf("Delta uplink seq %u (base %u, %s): %d frame(s) queued\n", seq, base, keyframe ? "keyframe" : "delta", pendingFrames);
+}
@@ -0,0 +1,56 @@
+#include <Preferences.h>
+#include "fcnt.h"
+#include "hal.h"
+
+static Preferences prefs;
+static uint32_t committed = 0;
+static volatile uint32_t latest = 0;
+static bool opened = false;
+
+static void commit(uint32_t value) {
+  if (!opened) return;
+  prefs.putUInt(FCNT_KEY, value);
+  committed = value;
+}
+
+void restoreFrameCounter() {
+  opened = prefs.begin(FCNT_NAMESPACE, false);
+  if (!opened) {
+    Serial.println("Frame counter store unavailable — counter starts at 0");
+    return;
+  }
+
+  bool found = prefs.isKey(FCNT_KEY);
+  uint32_t stored = found ? prefs.getUInt(FCNT_KEY, 0) : 0;
+
+  // One-off import of the counter the old LittleFS file held
+  if (!found && halFileExists(FCNT_LEGACY_FILE)) {
+    String legacy;
+    if (halFileRead(FCNT_LEGACY_FILE, legacy)) {
+      stored = legacy.toInt();
+      found = true;
+    }
+    halFileRemove(FCNT_LEGACY_FILE);
+  }
+  if (!found) {
+    // Written now so a reboot before the first periodic commit still skips ahead
+    commit(0);
+    Serial.println("No stored frame counter, starting at 0");
+    return;
+  }
+
+  uint32_t resumed = stored + FCNT_SKIP_AHEAD;
+  halRadioSetFrameCounter(resumed);
+  latest = resumed;
+  commit(resumed);
+  Serial.printf("Restored frame counter: %lu (last commit %lu)\n", (unsigned long)resumed, (unsigned long)stored);
+}
+
+void noteFrameCounter(uint32_t seqnoUp) {
+  latest = seqnoUp;
+}
+
+void serviceFrameCounter() {
+  uint32_t now = latest;
+  if (now - committed >= FCNT_COMMIT_EVERY) commit(now);
+}
@@ -0,0 +1,139 @@
+#include "fields.h"
+
+FieldDesc fields[MAX_FIELDS];
+int fieldCount = 0;
+float fieldValues[MAX_FIELDS];
+
+void clearFields() {
+  fieldCount = 0;
+}
+
+uint8_t fieldWords(FieldType type) {
+  return (type == FIELD_UINT16 || type == FIELD_INT16) ? 1 : 2;
+}
+
+// { "index": 0, "type": "float32", "wordSwap": true, "byteSwap": false,
+//   "scale": 10, "offset": 0, "uplink": "int16" }
+int compileFields(uint8_t requestIndex, JsonArray arr) {
+  int compiled = 0;
+
+  for (JsonObject obj : arr) {
+    if (fieldCount >= MAX_FIELDS) break;
+    if (!obj.containsKey("index") || !obj.containsKey("type")) {
+      Serial.printf("Skipping malformed field on request %d\n", requestIndex);
+      continue;
+    }
+
+    FieldDesc& f = fields[fieldCount];
+    String type = obj["type"].as<String>();
+    if (type == "uint16") f.type = FIELD_UINT16;
+    else if (type == "int16") f.type = FIELD_INT16;
+    else if (type == "uint32") f.type = FIELD_UINT32;
+    else if (type == "int32") f.type = FIELD_INT32;
+    else if (type == "float32") f.type = FIELD_FLOAT32;
+    else {
+      Serial.printf("Unknown field type '%s' on request %d\n", type.c_str(), requestIndex);
+      continue;
+    }
+
+    String uplink = obj["uplink"] | "raw";
+    if (uplink == "int16") f.uplink = FIELD_UPLINK_INT16;
+    else if (uplink == "int8") f.uplink = FIELD_UPLINK_INT8;
+    else f.uplink = FIELD_UPLINK_RAW;
+
+    f.request = requestIndex;
+    f.index = obj["index"];
+    f.flags = 0;
+    if (obj["wordSwap"] | false) f.flags |= FIELD_WORD_SWAP;
+    if (obj["byteSwap"] | false) f.flags |= FIELD_BYTE_SWAP;
+    f.scale = obj["scale"] | 1.0f;
+    f.offset = obj["offset"] | 0.0f;
+    fieldValues[fieldCount] = 0;
+    fieldCount++;
+    compiled++;
+  }
+  return compiled;
+}
+
+// Drops fields that fall outside their request or overlap an earlier one, so
+// the encoder can walk a request's registers and fields in a single pass
+void validateFields() {
+  int kept = 0;
+  for (int i = 0; i < fieldCount; i++) {
+    const FieldDesc& f = fields[i];
+    const ModbusRequest& req = requests[f.request];
+    int end = f.index + fieldWords(f.type);
+
+    bool ok = f.request < requestCount && req.function >= READ_HREG && end <= req.numRegs;
+    for (int k = 0; ok && k < kept; k++) {
+      const FieldDesc& g = fields[k];
+      if (g.request == f.request && f.index < g.index + fieldWords(g.type) && g.index < end) ok = false;
+    }
+    if (!ok) {
+      Serial.printf("Field on request %u at Reg[%u] dropped (out of range or overlapping)\n", f.request, f.index);
+      continue;
+    }
+    fields[kept++] = f;
+  }
+  fieldCount = kept;
+}
+
+int findField(const FieldDesc* table, int count, uint8_t request, uint8_t index) {
+  for (int i = 0; i < count; i++) {
+    if (table[i].request == request && table[i].index == index) return i;
+  }
+  return -1;
+}
+
+static uint16_t swapBytes(uint16_t w) {
+  return (w << 8) | (w >> 8);
+}
+
+// Runs once per poll; fields of a request that failed or was not due keep
+// their last value
+void decodeFields() {
+  for (int i = 0; i < fieldCount; i++) {
+    const FieldDesc& f = fields[i];
+    const ModbusRequest& req = requests[f.request];
+    if (!req.fresh || !req.success) continue;
+
+    uint16_t hi = requestValue(requestValues, req, f.index);
+    uint16_t lo = fieldWords(f.type) == 2 ? requestValue(requestValues, req, f.index + 1) : 0;
+    if (f.flags & FIELD_BYTE_SWAP) {
+      hi = swapBytes(hi);
+      lo = swapBytes(lo);
+    }
+    uint32_t raw = (f.flags & FIELD_WORD_SWAP) ? ((uint32_t)lo << 16) | hi : ((uint32_t)hi << 16) | lo;
+
+    float value = 0;
+    switch (f.type) {
+      case FIELD_UINT16:  value = hi; break;
+      case FIELD_INT16:   value = (int16_t)hi; break;
+      case FIELD_UINT32:  value = raw; break;
+      case FIELD_INT32:   value = (int32_t)raw; break;
+      case FIELD_FLOAT32: memcpy(&value, &raw, sizeof(value)); break;
+    }
+    fieldValues[i] = value * f.scale + f.offset;
+  }
+}
+
+uint8_t fieldUplinkLength(const FieldDesc& f) {
+  switch (f.uplink) {
+    case FIELD_UPLINK_INT16: return 2;
+    case FIELD_UPLINK_INT8:  return 1;
+    default:                 return fieldWords(f.type) * 2;
+  }
+}
+
+// Narrow forms only; raw fields are sent as their register words by the caller
+uint8_t encodeFieldUplink(const FieldDesc& f, float value, uint8_t* out) {
+  if (isnan(value)) value = 0;
+  if (f.uplink == FIELD_UPLINK_INT8) {
+    out[0] = (uint8_t)(int8_t)lroundf(constrain(value, -128.0f, 127.0f));
+    return 1;
+  }
+  int16_t narrow = lroundf(constrain(value, -32768.0f, 32767.0f));
+  out[0] = highByte((uint16_t)narrow);
+  out[1] = lowByte((uint16_t)narrow);
+  return 2;
+}
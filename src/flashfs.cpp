@@ -1,26 +1,15 @@
 #include "flashfs.h"
-#include <LittleFS.h>
 #include <ArduinoJson.h>
+#include "hal.h"
 #include "config.h"
 #include "inputs.h"
-#include <lmic.h>
+#include "table.h"
+#include "airtime.h"
+#include "alarms.h"
+#include "fields.h"
 
 bool initFlashFS() {
-  if (!LittleFS.begin()) {
-    Serial.println("LittleFS mount failed, formatting...");
-    if (LittleFS.format()) {
-      Serial.println("Format OK — mounting...");
-      if (LittleFS.begin()) {
-        Serial.println("Mounted after format");
-        return true;
-      }
-    }
-    Serial.println("Format failed");
-    return false;
-  }
-
-  Serial.println("LittleFS mounted");
-  return true;
+  return halFsMount();
 }
 
 
@@ -37,44 +26,32 @@ bool parseHexString(const String& hex, uint8_t* output, size_t len) {
 
 
 bool fileExistsFS(const char* path) {
-  return LittleFS.exists(path);
+  return halFileExists(path);
 }
 
 String readFileFS(const char* path) {
-  File file = LittleFS.open(path, "r");
-  if (!file) {
+  String content;
+  if (!halFileRead(path, content)) {
     Serial.printf("Failed to open %s\n", path);
     return "";
   }
-
-  String content;
-  while (file.available()) {
-    content += (char)file.read();
-  }
-  file.close();
   return content;
 }
 
 bool writeFileFS(const char* path, const String& content) {
-  File file = LittleFS.open(path, "w");
-  if (!file) {
+  if (!halFileWrite(path, content, false)) {
     Serial.printf("Failed to open %s for write\n", path);
     return false;
   }
-  file.print(content);
-  file.close();
   Serial.printf("File written: %s\n", path);
   return true;
 }
 
 bool appendToFileFS(const char* path, const String& content) {
-  File file = LittleFS.open(path, "a");
-  if (!file) {
+  if (!halFileWrite(path, content, true)) {
     Serial.printf("Failed to open %s for append\n", path);
     return false;
   }
-  file.print(content);
-  file.close();
   Serial.printf("Content appended to: %s\n", path);
   return true;
 }
@@ -155,6 +132,29 @@ void configureLoRaFromJson(JsonObject doc) {
     LORA_SF = lora["sf"].as<uint8_t>();
     Serial.printf("LoRa spreading factor set to SF%d\n", LORA_SF);
   }
+  if (lora.containsKey("encoding")) {
+    String encoding = lora["encoding"].as<String>();
+    if (encoding == "delta") LORA_ENCODING = ENCODING_DELTA;
+    else if (encoding == "schema") LORA_ENCODING = ENCODING_SCHEMA;
+    else LORA_ENCODING = ENCODING_FULL;
+    Serial.printf("LoRa payload encoding: %s\n", encoding.c_str());
+  }
+  if (lora.containsKey("airtimeBudget")) {
+    LORA_AIRTIME_BUDGET = lora["airtimeBudget"].as<unsigned long>();
+    Serial.printf("LoRa airtime budget set to %lu ms\n", LORA_AIRTIME_BUDGET);
+  }
+  if (lora.containsKey("airtimeWindow")) {
+    LORA_AIRTIME_WINDOW = max(lora["airtimeWindow"].as<unsigned long>(), (unsigned long)AIRTIME_BUCKETS);
+    Serial.printf("LoRa airtime window set to %lu ms\n", LORA_AIRTIME_WINDOW);
+  }
+  if (lora.containsKey("keyframe")) {
+    LORA_KEYFRAME_EVERY = lora["keyframe"].as<uint16_t>();
+    Serial.printf("LoRa keyframe every %u uplinks\n", LORA_KEYFRAME_EVERY);
+  }
+  if (lora.containsKey("diagInterval")) {
+    LORA_DIAG_INTERVAL = lora["diagInterval"].as<unsigned long>();
+    Serial.printf("LoRa diagnostic uplink every %lu ms\n", LORA_DIAG_INTERVAL);
+  }
 
   Serial.println("LoRa config loaded from lora.json");
 }
@@ -271,7 +271,7 @@ void loadModbusConfigFromFlash(const char* configPath) {
           "count": 4,
           "function": 3,
           "alarms": [
-            { "index": 0, "op": ">", "threshold": 1000 },
+            { "index": 0, "op": ">", "threshold": 1000, "hysteresis": 20, "debounce": 2000 },
             { "index": 2, "op": "=", "threshold": 123 }
           ]
         }
@@ -288,6 +288,7 @@ void loadModbusConfigFromFlash(const char* configPath) {
     DeserializationError err = deserializeJson(doc, jsonStr);
     if (err) {
       Serial.println("JSON parse error");
+      if (!requestTableBuilt()) buildRequestTable();  // keep serving the table already in memory
       return;
     }
 
@@ -296,8 +297,19 @@ void loadModbusConfigFromFlash(const char* configPath) {
       Serial.printf("Modbus scan interval set to %lu ms\n", MODBUS_SCAN_INTERVAL);
     }
 
+    if (doc.containsKey("timeout")) {
+      MODBUS_REQUEST_TIMEOUT = doc["timeout"].as<unsigned long>();
+      Serial.printf("Modbus request timeout set to %lu ms\n", MODBUS_REQUEST_TIMEOUT);
+    }
+
+    if (doc.containsKey("maxGap")) {
+      MODBUS_MAX_GAP = doc["maxGap"].as<uint16_t>();
+      Serial.printf("Modbus coalescing gap set to %u registers\n", MODBUS_MAX_GAP);
+    }
+
     JsonArray arr = doc["requests"].as<JsonArray>();
-    requestCount = 0;
+    beginRequestTable();
+    clearFields();
 
     for (JsonObject obj : arr) {
       if (!obj.containsKey("ip") || obj["ip"].size() != 4 ||
@@ -309,7 +321,7 @@ void loadModbusConfigFromFlash(const char* configPath) {
 
       int count = obj["count"];
       int function = obj["function"];
-      if (count <= 0 || count > 125 || !(function >= 1 && function <= 4)) {
+      if (count <= 0 || count > MAX_REQUEST_REGS || !(function >= 1 && function <= 4)) {
         Serial.println("Invalid Modbus parameters");
         continue;
       }
@@ -324,27 +336,46 @@ void loadModbusConfigFromFlash(const char* configPath) {
       req.function = static_cast<ModbusFunction>(function);
       req.success = false;
 
-      // Alarms
-      req.alarmCount = 0;
-      if (obj.containsKey("alarms")) {
-        JsonArray alarmArr = obj["alarms"];
-        for (JsonObject alarm : alarmArr) {
-          if (req.alarmCount >= 4) break;
-          if (!alarm.containsKey("index") || !alarm.containsKey("op") || !alarm.containsKey("threshold")) continue;
-
-          AlarmCondition& a = req.alarms[req.alarmCount++];
-          a.index = alarm["index"];
-          a.op = alarm["op"].as<const char*>()[0];
-          a.threshold = alarm["threshold"];
-          a.active = false;
+      // Own poll period in ms, e.g. "interval": 60000 for a slow tank level;
+      // "phase" pins where in that period it is read, otherwise the
+      // scheduler spreads it out (see schedule.h)
+      req.intervalMs = obj["interval"] | 0;
+      req.phaseMs = obj["phase"] | -1;
+
+      // Window statistics, e.g. "stats": ["min", "max", "mean", "count"]
+      req.stats = STAT_LAST;
+      if (obj.containsKey("stats") && req.function >= READ_HREG) {
+        req.stats = 0;
+        for (JsonVariant stat : obj["stats"].as<JsonArray>()) {
+          String name = stat.as<String>();
+          if (name == "last") req.stats |= STAT_LAST;
+          else if (name == "min") req.stats |= STAT_MIN;
+          else if (name == "max") req.stats |= STAT_MAX;
+          else if (name == "mean") req.stats |= STAT_MEAN;
+          else if (name == "count") req.stats |= STAT_COUNT;
         }
-        Serial.printf("%d alarms configured for request %d\n", req.alarmCount, requestCount - 1);
+        if (req.stats == 0) req.stats = STAT_LAST;
+      }
+
+      if (obj.containsKey("fields")) {
+        int count = compileFields(requestCount - 1, obj["fields"].as<JsonArray>());
+        Serial.printf("%d typed fields configured for request %d\n", count, requestCount - 1);
+      }
+
+      // Alarm rules are compiled into the evaluation table here, once
+      if (obj.containsKey("alarms")) {
+        int rules = compileAlarmRules(requestCount - 1, obj["alarms"].as<JsonArray>());
+        Serial.printf("%d alarms configured for request %d\n", rules, requestCount - 1);
       }
     }
+    validateFields();
+    validateAlarmRules();  // binds terms to the fields that survived
+    buildRequestTable();
 
     Serial.printf("Loaded %d Modbus requests from %s\n", requestCount, configPath);
   } else {
     Serial.printf("No Modbus config file found at %s\n", configPath);
+    if (!requestTableBuilt()) buildRequestTable();
   }
 }
 
@@ -353,14 +384,14 @@ void loadInputsConfig(const char* path) {
     writeFileFS(path, R"json({
       "inputs": [
         { "pin": 14, "type": "digital", "alarm": { "active": true, "expected": 1 } },
-        { "pin": 15, "type": "counter", "alarm": { "active": false } }
+        { "pin": 15, "type": "counter", "filterNs": 10000, "alarm": { "active": false } }
       ]
     })json");
     Serial.println("Default inputs.json created");
   }
 
   String content = readFileFS(path);
-  StaticJsonDocument<1024> doc;
+  DynamicJsonDocument doc(8192);
   DeserializationError err = deserializeJson(doc, content);
   if (err) {
     Serial.println("Failed to parse inputs.json");
@@ -368,30 +399,32 @@ void loadInputsConfig(const char* path) {
   }
 
   JsonArray arr = doc["inputs"];
-  for (int i = 0; i < 2 && i < arr.size(); i++) {
-    auto obj = arr[i];
-    inputConfigs[i].pin = obj["pin"];
-    inputConfigs[i].type = strcmp(obj["type"], "counter") == 0 ? COUNTER : DIGITAL;
-    inputConfigs[i].alarmActive = obj["alarm"]["active"];
-    inputConfigs[i].alarmExpected = obj["alarm"]["expected"] | 0;
-    pinMode(inputConfigs[i].pin, INPUT);
+  if (arr.size() > MAX_INPUTS) {
+    Serial.printf("inputs.json: %u inputs, only the first %d are used\n", (unsigned)arr.size(), MAX_INPUTS);
   }
-}
-
-void saveFrameCounter() {
-  File file = LittleFS.open("/fcnt.txt", "w");
-  if (file) {
-    file.print(LMIC.seqnoUp);
-    file.close();
-  }
-}
-
-void loadFrameCounter() {
-  File file = LittleFS.open("/fcnt.txt", "r");
-  if (file) {
-    LMIC.seqnoUp = file.parseInt();
-    file.close();
-    Serial.printf("Restored frame counter: %lu\n", LMIC.seqnoUp);
+  // Parsed aside, the inputs task keeps sampling the live table meanwhile
+  InputConfig table[MAX_INPUTS];
+  int count = 0;
+  int counters = 0;
+  for (JsonObject obj : arr) {
+    if (count >= MAX_INPUTS) break;
+    int pin = obj["pin"] | -1;
+    if (pin < 0 || pin > INPUT_MAX_PIN) {
+      Serial.printf("inputs.json: input %d has invalid pin %d, skipped\n", count, pin);
+      continue;
+    }
+    InputConfig& cfg = table[count++];
+    cfg = InputConfig();
+    cfg.pin = pin;
+    cfg.type = strcmp(obj["type"] | "digital", "counter") == 0 ? COUNTER : DIGITAL;
+    if (cfg.type == COUNTER && ++counters > MAX_COUNTER_INPUTS) {
+      Serial.printf("inputs.json: more than %d counters, pin %d read as digital\n", MAX_COUNTER_INPUTS, pin);
+      cfg.type = DIGITAL;
+    }
+    cfg.alarmActive = obj["alarm"]["active"];
+    cfg.alarmExpected = obj["alarm"]["expected"] | 0;
+    cfg.filterNs = obj["filterNs"] | INPUT_DEFAULT_FILTER_NS;
   }
+  applyInputs(table, count);
+  Serial.printf("%d inputs loaded from inputs.json\n", count);
 }
-
@@ -0,0 +1,317 @@
+#include <SPI.h>
+#include <Ethernet.h>
+#include <ModbusEthernet.h>
+#include <LittleFS.h>
+#include <lmic.h>
+#include <hal/hal.h>
+#include <driver/pcnt.h>
+#include <soc/gpio_reg.h>
+#include "hal.h"
+
+// ===== Clock and GPIO =====
+
+uint32_t halMillis() { return millis(); }
+uint32_t halMicros() { return micros(); }
+
+void halPinInput(uint8_t pin) { pinMode(pin, INPUT); }
+bool halPinRead(uint8_t pin) { return digitalRead(pin); }
+
+// GPIO 0-31 and 32-48 sit in two input registers; only the ones needed are read
+uint64_t halPinReadMask(uint64_t mask) {
+  uint64_t levels = 0;
+  if (mask & 0xFFFFFFFFULL) levels |= REG_READ(GPIO_IN_REG);
+  if (mask >> 32) levels |= (uint64_t)REG_READ(GPIO_IN1_REG) << 32;
+  return levels & mask;
+}
+
+// ===== Pulse counters (PCNT) =====
+
+// The 16-bit hardware counter clears itself at the high limit; the overflow
+// interrupt folds each wrap into a 64-bit total
+#define PCNT_HIGH_LIMIT 30000
+#define PCNT_FILTER_MAX 1023  // APB cycles, about 12.8 µs
+
+static volatile uint64_t pulseOverflow[HAL_PULSE_CHANNELS];
+static uint64_t pulseLastTotal[HAL_PULSE_CHANNELS];
+static bool pulseActive[HAL_PULSE_CHANNELS];
+static bool pcntIsrInstalled = false;
+static portMUX_TYPE pulseMux = portMUX_INITIALIZER_UNLOCKED;
+
+static void IRAM_ATTR onPulseOverflow(void* arg) {
+  int unit = (int)(intptr_t)arg;
+  uint32_t status = 0;
+  pcnt_get_event_status((pcnt_unit_t)unit, &status);
+  if (status & PCNT_EVT_H_LIM) {
+    portENTER_CRITICAL_ISR(&pulseMux);
+    pulseOverflow[unit] += PCNT_HIGH_LIMIT;
+    portEXIT_CRITICAL_ISR(&pulseMux);
+  }
+}
+
+bool halPulseCounterBegin(uint8_t channel, uint8_t pin, uint32_t filterNs) {
+  if (channel >= HAL_PULSE_CHANNELS) return false;
+  halPulseCounterEnd(channel);
+  pcnt_unit_t unit = (pcnt_unit_t)channel;
+
+  pcnt_config_t cfg = {};
+  cfg.pulse_gpio_num = pin;
+  cfg.ctrl_gpio_num = PCNT_PIN_NOT_USED;
+  cfg.channel = PCNT_CHANNEL_0;
+  cfg.unit = unit;
+  cfg.pos_mode = PCNT_COUNT_INC;
+  cfg.neg_mode = PCNT_COUNT_DIS;
+  cfg.lctrl_mode = PCNT_MODE_KEEP;
+  cfg.hctrl_mode = PCNT_MODE_KEEP;
+  cfg.counter_h_lim = PCNT_HIGH_LIMIT;
+  cfg.counter_l_lim = 0;
+  if (pcnt_unit_config(&cfg) != ESP_OK) return false;
+
+  uint32_t cycles = min((uint64_t)filterNs * (APB_CLK_FREQ / 1000000) / 1000, (uint64_t)PCNT_FILTER_MAX);
+  if (cycles > 0) {
+    pcnt_set_filter_value(unit, cycles);
+    pcnt_filter_enable(unit);
+  } else {
+    pcnt_filter_disable(unit);
+  }
+
+  if (!pcntIsrInstalled) {
+    if (pcnt_isr_service_install(0) != ESP_OK) return false;
+    pcntIsrInstalled = true;
+  }
+  pcnt_event_enable(unit, PCNT_EVT_H_LIM);
+  pcnt_isr_handler_add(unit, onPulseOverflow, (void*)(intptr_t)channel);
+
+  pcnt_counter_pause(unit);
+  pcnt_counter_clear(unit);
+  portENTER_CRITICAL(&pulseMux);
+  pulseOverflow[channel] = 0;
+  pulseLastTotal[channel] = 0;
+  pulseActive[channel] = true;
+  portEXIT_CRITICAL(&pulseMux);
+  pcnt_counter_resume(unit);
+  return true;
+}
+
+void halPulseCounterEnd(uint8_t channel) {
+  if (channel >= HAL_PULSE_CHANNELS || !pulseActive[channel]) return;
+  pcnt_unit_t unit = (pcnt_unit_t)channel;
+  pcnt_counter_pause(unit);
+  pcnt_event_disable(unit, PCNT_EVT_H_LIM);
+  pcnt_isr_handler_remove(unit);
+  pulseActive[channel] = false;
+}
+
+// A wrap whose interrupt has not run yet reads as a small count on the old
+// overflow; the total is held until the interrupt catches up
+uint64_t halPulseCounterTotal(uint8_t channel) {
+  if (channel >= HAL_PULSE_CHANNELS || !pulseActive[channel]) return 0;
+  int16_t count = 0;
+  portENTER_CRITICAL(&pulseMux);
+  pcnt_get_counter_value((pcnt_unit_t)channel, &count);
+  uint64_t total = pulseOverflow[channel] + (uint16_t)count;
+  if (total < pulseLastTotal[channel]) total = pulseLastTotal[channel];
+  pulseLastTotal[channel] = total;
+  portEXIT_CRITICAL(&pulseMux);
+  return total;
+}
+
+// ===== Filesystem (LittleFS) =====
+
+bool halFsMount() {
+  if (LittleFS.begin()) {
+    Serial.println("LittleFS mounted");
+    return true;
+  }
+
+  Serial.println("LittleFS mount failed, formatting...");
+  if (LittleFS.format()) {
+    Serial.println("Format OK — mounting...");
+    if (LittleFS.begin()) {
+      Serial.println("Mounted after format");
+      return true;
+    }
+  }
+  Serial.println("Format failed");
+  return false;
+}
+
+bool halFileExists(const char* path) {
+  return LittleFS.exists(path);
+}
+
+bool halFileRead(const char* path, String& out) {
+  File file = LittleFS.open(path, "r");
+  if (!file) return false;
+
+  out = "";
+  out.reserve(file.size());
+  while (file.available()) out += (char)file.read();
+  file.close();
+  return true;
+}
+
+bool halFileWrite(const char* path, const String& content, bool append) {
+  File file = LittleFS.open(path, append ? "a" : "w");
+  if (!file) return false;
+  bool ok = file.print(content) == content.length();
+  file.close();
+  return ok;
+}
+
+bool halFileRemove(const char* path) {
+  return LittleFS.remove(path);
+}
+
+// ===== W5500 and Modbus TCP =====
+
+static ModbusEthernet mb;
+static HalModbusCallback modbusReply = nullptr;
+
+// The SPI bus is shared with the LoRa radio and must come up on these pins first
+void halNetworkInit() {
+  pinMode(CS_W5500, OUTPUT);
+  digitalWrite(CS_W5500, HIGH);
+  SPI.begin(SCK_PIN, MISO_PIN, MOSI_PIN);
+  Ethernet.init(CS_W5500);
+}
+
+bool halNetworkLinkUp() {
+  return Ethernet.linkStatus() != LinkOFF;
+}
+
+bool halNetworkBeginDhcp(const uint8_t* mac) {
+  return Ethernet.begin((uint8_t*)mac) != 0;
+}
+
+bool halNetworkBeginStatic(const uint8_t* mac, IPAddress ip, IPAddress dns, IPAddress gateway, IPAddress subnet) {
+  Ethernet.begin((uint8_t*)mac, ip, dns, gateway, subnet);
+  return Ethernet.localIP() != IPAddress(0, 0, 0, 0);
+}
+
+IPAddress halNetworkLocalIP() {
+  return Ethernet.localIP();
+}
+
+static bool onTransaction(Modbus::ResultCode event, uint16_t transactionId, void*) {
+  if (modbusReply) modbusReply(event, transactionId);
+  return true;
+}
+
+void halModbusBegin(uint16_t connectTimeoutMs, HalModbusCallback onReply) {
+  modbusReply = onReply;
+  Ethernet.setConnectionTimeout(connectTimeoutMs);
+  mb.client();
+}
+
+bool halModbusConnected(IPAddress ip) { return mb.isConnected(ip); }
+bool halModbusConnect(IPAddress ip) { return mb.connect(ip); }
+void halModbusDisconnect(IPAddress ip) { mb.disconnect(ip); }
+
+uint16_t halModbusRead(IPAddress ip, uint8_t unit, ModbusFunction function, uint16_t start, uint16_t count,
+                       uint16_t* words, bool* bits) {
+  switch (function) {
+    case READ_HREG:            return mb.readHreg(ip, start, words, count, onTransaction, unit);
+    case READ_IREG:            return mb.readIreg(ip, start, words, count, onTransaction, unit);
+    case READ_COILS:           return mb.readCoil(ip, start, bits, count, onTransaction, unit);
+    case READ_DISCRETE_INPUTS: return mb.readIsts(ip, start, bits, count, onTransaction, unit);
+  }
+  return 0;
+}
+
+void halModbusTask() { mb.task(); }
+void halModbusDropTransactions() { mb.dropTransactions(); }
+
+// ===== SX127x via LMIC =====
+
+void os_getArtEui(u1_t* buf) { memcpy(buf, APPEUI, sizeof(APPEUI)); }
+void os_getDevEui(u1_t* buf) { memcpy(buf, DEVEUI, sizeof(DEVEUI)); }
+void os_getDevKey(u1_t* buf) { memcpy(buf, APPKEY, sizeof(APPKEY)); }
+
+const lmic_pinmap lmic_pins = {
+  .nss  = LORA_NSS_PIN,
+  .rxtx = LMIC_UNUSED_PIN,
+  .rst  = LORA_RST_PIN,
+  .dio  = { LORA_DIO0_PIN, LORA_DIO1_PIN, LMIC_UNUSED_PIN }
+};
+
+void onEvent(ev_t ev) {
+  switch (ev) {
+    case EV_TXSTART:
+      onRadioTxStart(LMIC.freq);
+      break;
+    case EV_JOINING:
+      Serial.println("EV_JOINING");
+      break;
+    case EV_JOINED:
+      onRadioJoined();
+      break;
+    case EV_TXCOMPLETE: {
+      bool hasData = LMIC.dataLen > 0 && (LMIC.txrxFlags & TXRX_PORT);
+      onRadioTxComplete((LMIC.txrxFlags & TXRX_ACK) != 0, LMIC.seqnoUp,
+                        hasData ? LMIC.frame[LMIC.dataBeg - 1] : 0,
+                        hasData ? &LMIC.frame[LMIC.dataBeg] : nullptr,
+                        hasData ? LMIC.dataLen : 0);
+      break;
+    }
+    default:
+      Serial.println((unsigned)ev);
+      break;
+  }
+}
+
+void halRadioInit() {
+  pinMode(LORA_RST_PIN, OUTPUT);
+  os_init_ex(&lmic_pins);
+  LMIC_reset();
+}
+
+void halRadioReset() {
+  digitalWrite(LORA_RST_PIN, LOW); delay(10);
+  digitalWrite(LORA_RST_PIN, HIGH); delay(10);
+}
+
+void halRadioConfigure(bool adr, uint8_t subband, uint8_t sf) {
+  LMIC_setAdrMode(adr);
+  LMIC_selectSubBand(subband);
+  if (adr) return;
+
+  switch (sf) {
+    case 7:  LMIC_setDrTxpow(DR_SF7, 14); break;
+    case 8:  LMIC_setDrTxpow(DR_SF8, 14); break;
+    case 9:  LMIC_setDrTxpow(DR_SF9, 14); break;
+    case 10: LMIC_setDrTxpow(DR_SF10, 14); break;
+    case 11: LMIC_setDrTxpow(DR_SF11, 14); break;
+    case 12: LMIC_setDrTxpow(DR_SF12, 14); break;
+    default:
+      Serial.println("Invalid SF in config — defaulting to SF7");
+      LMIC_setDrTxpow(DR_SF7, 14);
+  }
+}
+
+void halRadioStartAbp(uint32_t devAddr, const uint8_t* nwkSKey, const uint8_t* appSKey) {
+  LMIC_setSession(0x13, devAddr, (xref2u1_t)nwkSKey, (xref2u1_t)appSKey);
+  LMIC_setLinkCheckMode(0);  // disable MAC link check in ABP
+}
+
+void halRadioStartJoin() { LMIC_startJoining(); }
+void halRadioRunOnce() { os_runloop_once(); }
+bool halRadioBusy() { return (LMIC.opmode & OP_TXRXPEND) != 0; }
+
+bool halRadioSend(uint8_t port, const uint8_t* data, uint8_t len, bool confirmed) {
+  return LMIC_setTxData2(port, (xref2u1_t)data, len, confirmed) == 0;
+}
+
+void halRadioCancel() { LMIC_clrTxData(); }
+
+uint8_t halRadioSF() {
+  // LMIC.datarate values: DR_0 = SF12 ... DR_5 = SF7 (for AU915/US915)
+  if (LMIC.datarate == DR_SF8C) return 8;  // DR_6 = SF8 on a 500 kHz channel
+  return 12 - LMIC.datarate;  // DR_0 = 0 -> SF12, DR_5 = 5 -> SF7
+}
+
+uint32_t halRadioBandwidth() {
+  return LMIC.datarate == DR_SF8C ? 500000 : 125000;
+}
+
+uint32_t halRadioFrameCounter() { return LMIC.seqnoUp; }
+void halRadioSetFrameCounter(uint32_t seqnoUp) { LMIC.seqnoUp = seqnoUp; }
@@ -1,51 +1,196 @@
 #include "inputs.h"
-#include "lora.h"  // For alarmUplink() or sendAlarmUplink()
+#include "tasks.h"  // For postAlarm()
+#include "hal.h"
+#include "metrics.h"
 
-InputConfig inputConfigs[2]; 
+InputConfig inputConfigs[MAX_INPUTS];
+uint8_t inputCount = 0;
 
-void handleDigitalInputs() {
-  for (int i = 0; i < 2; i++) {
-    bool state = digitalRead(inputConfigs[i].pin);
+// Counters are bumped by the inputs task and drained by the radio task
+static portMUX_TYPE inputsMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Per-channel bitmaps (bit i = input i), rebuilt by applyInputs()
+static uint64_t pinMask = 0;       // GPIOs to read each sample
+static uint32_t channelMask = 0;   // every configured input
+static uint32_t counterMask = 0;
+static uint32_t sampledMask = 0;   // counters without a pulse counter channel
+static uint32_t expectedBits = 0;  // alarm expected level per input
+static uint8_t counterList[MAX_COUNTER_INPUTS];
+static uint8_t counterCount = 0;
 
-    if (inputConfigs[i].type == COUNTER) {
-      if (state && !inputConfigs[i].lastState) {
-        inputConfigs[i].counterValue++;
+// Sampled state, owned by the inputs task between reloads
+static uint32_t levels = 0;
+static uint32_t alarmLatched = 0;
+
+// Counters take a pulse counter channel each, in table order. The live
+// table is only touched under the lock: counters are detached first so the
+// inputs task stops reading the channels while they are set up again, then
+// the new table and its masks are swapped in together.
+void applyInputs(const InputConfig* table, uint8_t count) {
+  // Last reading of every counter, carried over to a counter on the same pin
+  InputConfig previous[MAX_COUNTER_INPUTS];
+  uint8_t previousCount = 0;
+  portENTER_CRITICAL(&inputsMux);
+  for (int c = 0; c < counterCount; c++) {
+    InputConfig& cfg = inputConfigs[counterList[c]];
+    if (cfg.pulseChannel >= 0) cfg.counterTotal = cfg.channelBase + halPulseCounterTotal(cfg.pulseChannel);
+    previous[previousCount++] = cfg;
+  }
+  channelMask = 0;
+  counterCount = 0;
+  portEXIT_CRITICAL(&inputsMux);
+
+  InputConfig staged[MAX_INPUTS];
+  uint8_t next = 0;
+  for (int c = 0; c < HAL_PULSE_CHANNELS; c++) halPulseCounterEnd(c);
+  for (int i = 0; i < count; i++) {
+    InputConfig& cfg = staged[i];
+    cfg = InputConfig();
+    cfg.pin = table[i].pin;
+    cfg.type = table[i].type;
+    cfg.alarmActive = table[i].alarmActive;
+    cfg.alarmExpected = table[i].alarmExpected;
+    cfg.filterNs = table[i].filterNs;
+    if (cfg.type == COUNTER) {
+      for (int p = 0; p < previousCount; p++) {
+        if (previous[p].pin != cfg.pin) continue;
+        cfg.counterTotal = previous[p].counterTotal;
+        cfg.counterBase = previous[p].counterBase;
+        cfg.counterValue = (uint32_t)min(cfg.counterTotal - cfg.counterBase, (uint64_t)UINT32_MAX);
+        cfg.channelBase = cfg.counterTotal;  // a restarted channel counts from zero
+        break;
       }
     }
 
-    inputConfigs[i].lastState = state;
+    halPinInput(cfg.pin);
+    if (cfg.type != COUNTER || next >= HAL_PULSE_CHANNELS) continue;
+    if (halPulseCounterBegin(next, cfg.pin, cfg.filterNs)) {
+      cfg.pulseChannel = next++;
+    } else {
+      Serial.printf("Input %d: no pulse counter, counting sampled edges\n", i);
+    }
+  }
 
-    if (inputConfigs[i].alarmActive && inputConfigs[i].type == DIGITAL) {
-      if (state == inputConfigs[i].alarmExpected) {
-        Serial.printf("Alarm: input %d = %d\n", inputConfigs[i].pin, state);
-        // mark for alarm uplink
-      }
+  uint64_t pins = 0;
+  uint32_t counters = 0, sampled = 0, expected = 0, latched = 0;
+  uint8_t list[MAX_COUNTER_INPUTS];
+  uint8_t listCount = 0;
+  for (int i = 0; i < count; i++) {
+    const InputConfig& cfg = staged[i];
+    pins |= 1ULL << cfg.pin;
+    if (cfg.alarmExpected) expected |= 1UL << i;
+    if (cfg.alarmActive) latched |= 1UL << i;
+    if (cfg.type == COUNTER) {
+      counters |= 1UL << i;
+      if (cfg.pulseChannel < 0) sampled |= 1UL << i;
+      list[listCount++] = i;  // the loader caps counters at MAX_COUNTER_INPUTS
     }
   }
-  checkInputAlarms();
+
+  portENTER_CRITICAL(&inputsMux);
+  for (int i = 0; i < count; i++) inputConfigs[i] = staged[i];
+  inputCount = count;
+  pinMask = pins;
+  counterMask = counters;
+  sampledMask = sampled;
+  expectedBits = expected;
+  alarmLatched = latched;
+  memcpy(counterList, list, listCount);
+  counterCount = listCount;
+  levels = 0;
+  channelMask = count == 32 ? 0xFFFFFFFFUL : (1UL << count) - 1;
+  portEXIT_CRITICAL(&inputsMux);
 }
 
-void resetCounters() {
-  for (int i = 0; i < 2; i++) {
-    if (inputConfigs[i].type == COUNTER) {
-      inputConfigs[i].counterValue = 0;
+// One batched GPIO read per sample; edges for every input fall out of one XOR
+void handleDigitalInputs() {
+  portENTER_CRITICAL(&inputsMux);
+  uint64_t mask = pinMask;
+  portEXIT_CRITICAL(&inputsMux);
+  uint64_t pins = halPinReadMask(mask);
+
+  portENTER_CRITICAL(&inputsMux);
+  if (mask != pinMask) {  // the table was swapped during the read
+    portEXIT_CRITICAL(&inputsMux);
+    return;
+  }
+  uint32_t now = 0;
+  for (int i = 0; i < inputCount; i++) {
+    now |= (uint32_t)((pins >> inputConfigs[i].pin) & 1) << i;
+  }
+  now &= channelMask;
+  uint32_t rising = (now ^ levels) & now;
+  levels = now;
+
+  uint32_t pulses = 0;
+  for (int c = 0; c < counterCount; c++) {
+    InputConfig& cfg = inputConfigs[counterList[c]];
+    uint64_t before = cfg.counterTotal;
+    if (cfg.pulseChannel >= 0) {
+      cfg.counterTotal = cfg.channelBase + halPulseCounterTotal(cfg.pulseChannel);
+    } else if (rising & sampledMask & (1UL << counterList[c])) {
+      cfg.counterTotal++;
     }
+    cfg.counterValue = (uint32_t)min(cfg.counterTotal - cfg.counterBase, (uint64_t)UINT32_MAX);
+    pulses += cfg.counterTotal - before;
   }
+  portEXIT_CRITICAL(&inputsMux);
+
+  if (pulses) metricCount(METRIC_INPUT_PULSES, pulses);
+  checkInputAlarms();
 }
 
+void resetCounters() {
+  portENTER_CRITICAL(&inputsMux);
+  for (int c = 0; c < counterCount; c++) {
+    InputConfig& cfg = inputConfigs[counterList[c]];
+    cfg.counterBase = cfg.counterTotal;
+    cfg.counterValue = 0;
+  }
+  portEXIT_CRITICAL(&inputsMux);
+}
 
-void checkInputAlarms() {
-  for (int i = 0; i < 2; i++) {
-    InputConfig& cfg = inputConfigs[i];
-    uint8_t actual = (cfg.type == COUNTER) ? (cfg.counterValue > 0 ? 1 : 0) : (cfg.lastState ? 1 : 0);
-
-    if (actual != cfg.alarmExpected && !cfg.alarmActive) {
-      cfg.alarmActive = true;
-      sendAlarmUplink(i, cfg.alarmExpected, actual);
-    } else if (actual == cfg.alarmExpected && cfg.alarmActive) {
-      cfg.alarmActive = false;
+void snapshotInputs(InputSnapshot& out, bool clearCounters) {
+  portENTER_CRITICAL(&inputsMux);
+  out.count = inputCount;
+  out.levels = levels;
+  out.counterCount = counterCount;
+  for (int c = 0; c < counterCount; c++) {
+    InputConfig& cfg = inputConfigs[counterList[c]];
+    out.counterIndex[c] = counterList[c];
+    out.counterValue[c] = cfg.counterValue;
+    if (clearCounters) {
+      cfg.counterBase = cfg.counterTotal;
+      cfg.counterValue = 0;
     }
   }
+  portEXIT_CRITICAL(&inputsMux);
 }
 
+// A digital input alarms on its level, a counter on having counted since
+// the last uplink. Each input alarms once until it is back as expected.
+void checkInputAlarms() {
+  portENTER_CRITICAL(&inputsMux);
+  uint32_t actual = levels & ~counterMask;
+  for (int c = 0; c < counterCount; c++) {
+    if (inputConfigs[counterList[c]].counterValue > 0) actual |= 1UL << counterList[c];
+  }
+  uint32_t expected = expectedBits;
+  uint32_t mismatch = (actual ^ expected) & channelMask;
+  uint32_t raised = mismatch & ~alarmLatched;
+  alarmLatched = mismatch;
+  portEXIT_CRITICAL(&inputsMux);
+
+  while (raised) {
+    int i = __builtin_ctz(raised);
+    raised &= raised - 1;
 
+    AlarmEvent ev = {};
+    ev.source = ALARM_SOURCE_INPUT;
+    ev.inputIndex = i;
+    ev.expected = (expected >> i) & 1;
+    ev.actual = (actual >> i) & 1;
+    metricCount(METRIC_INPUT_ALARMS);
+    postAlarm(ev);
+  }
+}
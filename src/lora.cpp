@@ -3,250 +3,191 @@
 #include "config.h"
 #include "lora.h"
 #include "flashfs.h"
-
-void os_getArtEui(u1_t* buf) { memcpy(buf, APPEUI, sizeof(APPEUI)); }
-void os_getDevEui(u1_t* buf) { memcpy(buf, DEVEUI, sizeof(DEVEUI)); }
-void os_getDevKey(u1_t* buf) { memcpy(buf, APPKEY, sizeof(APPKEY)); }
-
-
-const lmic_pinmap lmic_pins = {
-  .nss  = LORA_NSS_PIN,
-  .rxtx = LMIC_UNUSED_PIN,
-  .rst  = LORA_RST_PIN,
-  .dio  = { LORA_DIO0_PIN, LORA_DIO1_PIN, LMIC_UNUSED_PIN }
-};
-
-volatile bool txComplete = false;
-
-void resetLoRaChip() {
-  digitalWrite(LORA_RST_PIN, LOW); delay(10);
-  digitalWrite(LORA_RST_PIN, HIGH); delay(10);
-}
-
+#include "snapshot.h"
+#include "tasks.h"
+#include "delta.h"
+#include "payload.h"
+#include "airtime.h"
+#include "aggregate.h"
+#include "fcnt.h"
+#include "bootprof.h"
+#include "metrics.h"
+#include "hal.h"
 
 void initLoRa() {
-  pinMode(LORA_RST_PIN, OUTPUT);
-  os_init_ex(&lmic_pins);
-  LMIC_reset();
   applyLoRaConfig();
 
   if (JOIN_MODE_ABP) {
-    LMIC_setSession(0x13, DEVADDR, NWKSKEY, APPSKEY);
-    LMIC_setLinkCheckMode(0);  // disable MAC link check in ABP
+    halRadioStartAbp(DEVADDR, NWKSKEY, APPSKEY);
+    restoreFrameCounter();     // the network rejects counters it has seen
     joined = true;
     Serial.println("ABP session initialized");
   } else {
-    LMIC_startJoining();
+    halRadioStartJoin();
     Serial.println("OTAA join started");
   }
 }
 
 
 
+// Builds the interval's frames and hands them to the TX queue; never waits on air
 void sendLoRaUplink() {
-  if (LMIC.opmode & OP_TXRXPEND) return;
-
+  uint32_t buildStart = micros();
   uint8_t sf = getCurrentSF();
   uint16_t mtu = getMaxMTU(sf);
 
-  uint8_t buffer[256];  // working chunk
-  uint8_t index = 0;
-
-  for (int i = 0; i < requestCount; i++) {
-    uint8_t reqBuf[64];  // temporary buffer for one request
-    uint8_t reqLen = 0;
-
-    ModbusRequest& req = requests[i];
+  static RegisterSnapshot snap;  // too large for the radio task stack
+  readSnapshot(snap);
+  takeAggregates();  // closes the statistics window for this uplink
 
-    reqBuf[reqLen++] = req.slaveIP[0];
-    reqBuf[reqLen++] = req.slaveIP[1];
-    reqBuf[reqLen++] = req.slaveIP[2];
-    reqBuf[reqLen++] = req.slaveIP[3];
-    reqBuf[reqLen++] = req.unitID;
-    reqBuf[reqLen++] = highByte(req.startReg);
-    reqBuf[reqLen++] = lowByte(req.startReg);
-    reqBuf[reqLen++] = req.numRegs;
-    reqBuf[reqLen++] = req.success ? 1 : 0;
-    reqBuf[reqLen++] = static_cast<uint8_t>(req.function);
+  uint8_t inputSection[INPUT_SECTION_MAX];
+  uint8_t inputLen = buildInputSection(inputSection);
 
-    if (!req.success) {
-      uint8_t filler = (req.function <= 2) ? ceil(req.numRegs / 8.0) : req.numRegs * 2;
-      while (filler--) reqBuf[reqLen++] = 0x00;
-    } else if (req.function <= 2) {
-      uint8_t bitPacked = 0;
-      int bitIndex = 0;
-      for (int r = 0; r < req.numRegs; r++) {
-        if (req.result[r] & 0x01) bitPacked |= (1 << bitIndex);
-        bitIndex++;
-        if (bitIndex == 8 || r == req.numRegs - 1) {
-          reqBuf[reqLen++] = bitPacked;
-          bitPacked = 0;
-          bitIndex = 0;
-        }
-      }
-    } else {
-      for (int r = 0; r < req.numRegs; r++) {
-        reqBuf[reqLen++] = highByte(req.result[r]);
-        reqBuf[reqLen++] = lowByte(req.result[r]);
-      }
-    }
+  startIntervalEstimate();
 
-    // Check if this request fits
-    if (index + reqLen > mtu) {
-      sendLoRaPayloadChunk(buffer, index);
-      index = 0;
-    }
-
-    memcpy(&buffer[index], reqBuf, reqLen);
-    index += reqLen;
+  // Header-less formats are only decodable once the schema is known
+  if (LORA_ENCODING != ENCODING_FULL && !announceSchema(snap, mtu)) {
+    sendLegacyUplink(snap, inputSection, inputLen, mtu);
+  } else if (LORA_ENCODING == ENCODING_DELTA) {
+    sendDeltaUplink(snap, inputSection, inputLen, mtu);
+  } else if (LORA_ENCODING == ENCODING_SCHEMA) {
+    sendSchemaUplink(snap, inputSection, inputLen, mtu);
+  } else {
+    sendLegacyUplink(snap, inputSection, inputLen, mtu);
   }
 
-  // Send digital input section
-  uint8_t inputSection[16];
-  uint8_t inputLen = 0;
-
-  inputSection[inputLen++] = 0xFF;
-  inputSection[inputLen++] = 2;
+  finishIntervalEstimate();
+  uplinkCount++;
+  metricCount(METRIC_UPLINKS);
+  metricRecord(METRIC_UPLINK_BUILD_US, micros() - buildStart);
+  bootMark("first uplink queued");
+}
 
-  for (int i = 0; i < 2; i++) {
-    inputSection[inputLen++] = i;
-    inputSection[inputLen++] = inputConfigs[i].type;
-    if (inputConfigs[i].type == COUNTER) {
-      inputSection[inputLen++] = highByte(inputConfigs[i].counterValue);
-      inputSection[inputLen++] = lowByte(inputConfigs[i].counterValue);
-    } else {
-      inputSection[inputLen++] = 0x00;
-      inputSection[inputLen++] = inputConfigs[i].lastState ? 1 : 0;
-    }
+  void applyLoRaConfig() {
+    halRadioConfigure(LORA_ADR, LORA_SUBBAND, LORA_SF);
   }
 
-  if (index + inputLen > mtu) {
-    sendLoRaPayloadChunk(buffer, index);
-    index = 0;
-  }
+  // Modbus: ip[4], unit, reg[2], op, threshold[2], value[2]
+  // Input:  0xFF, input index, expected, actual
+  uint8_t encodeAlarmRecord(const AlarmEvent& ev, uint8_t* out) {
+    uint8_t i = 0;
 
-  memcpy(&buffer[index], inputSection, inputLen);
-  index += inputLen;
+    if (ev.source == ALARM_SOURCE_INPUT) {
+      out[i++] = 0xFF;   // Input alarm flag (distinct from IP start of Modbus)
+      out[i++] = ev.inputIndex;
+      out[i++] = ev.expected;
+      out[i++] = ev.actual;
+      Serial.printf("Digital Input Alarm %d: expected %d, got %d\n", ev.inputIndex, ev.expected, ev.actual);
+      return i;
+    }
 
-  // Final packet
-  if (index > 0) {
-    sendLoRaPayloadChunk(buffer, index);
+    for (int j = 0; j < 4; j++) out[i++] = ev.slaveIP[j];
+    out[i++] = ev.unitID;
+    out[i++] = highByte(ev.reg);
+    out[i++] = lowByte(ev.reg);
+    out[i++] = ev.op;
+    out[i++] = highByte(ev.threshold);
+    out[i++] = lowByte(ev.threshold);
+    out[i++] = highByte(ev.value);
+    out[i++] = lowByte(ev.value);
+    return i;
   }
 
-  uplinkCount++;
-  resetCounters();
-}
+  // Alarms are batched: whatever is pending once the batch window has passed
+  // and no earlier alarm frame is still waiting goes out as [count][records...]
+  void checkAlarmUplink() {
+    static unsigned long firstPendingAt = 0;
 
-  void applyLoRaConfig() {
-    LMIC_setAdrMode(LORA_ADR);
-    LMIC_selectSubBand(LORA_SUBBAND);
-  
-    if (!LORA_ADR) {
-      switch (LORA_SF) {
-        case 7:  LMIC_setDrTxpow(DR_SF7, 14); break;
-        case 8:  LMIC_setDrTxpow(DR_SF8, 14); break;
-        case 9:  LMIC_setDrTxpow(DR_SF9, 14); break;
-        case 10: LMIC_setDrTxpow(DR_SF10, 14); break;
-        case 11: LMIC_setDrTxpow(DR_SF11, 14); break;
-        case 12: LMIC_setDrTxpow(DR_SF12, 14); break;
-        default:
-          Serial.println("Invalid SF in config — defaulting to SF7");
-          LMIC_setDrTxpow(DR_SF7, 14);
-      }
+    if (pendingAlarmCount() == 0) {
+      firstPendingAt = 0;
+      return;
     }
-  }
-
-  void checkAlarmUplink() {
-    for (int i = 0; i < requestCount; i++) {
-      ModbusRequest& req = requests[i];
-  
-      for (int a = 0; a < req.alarmCount; a++) {
-        AlarmCondition& alarm = req.alarms[a];
-        if (alarm.pending) {
-          sendAlarmUplink(req, alarm, req.result[alarm.index]);
-          alarm.pending = false;  // clear it after send
-          return;  // only send one per loop
-        }
+    unsigned long now = millis();
+    if (firstPendingAt == 0) firstPendingAt = now ? now : 1;  // 0 marks "nothing pending"
+    if (now - firstPendingAt < ALARM_BATCH_WINDOW_MS) return;
+    // Keep collecting behind an alarm frame that is still waiting, unless the
+    // event queue is filling up
+    if (txQueuedCount(TX_PRIORITY_ALARM) > 0 && pendingAlarmCount() < ALARM_QUEUE_LEN / 2) return;
+    firstPendingAt = 0;
+
+    uint16_t mtu = getMaxMTU(getCurrentSF());
+    uint8_t frame[256];
+    uint8_t len = 1;
+    uint8_t count = 0;
+    int frames = 0;
+    int total = 0;
+
+    AlarmEvent ev;
+    while (nextAlarm(ev)) {
+      uint8_t record[ALARM_RECORD_MAX];
+      uint8_t recordLen = encodeAlarmRecord(ev, record);
+
+      if (len + recordLen > mtu) {
+        frame[0] = count;
+        txEnqueue(frame, len, ALARM_FPORT, TX_PRIORITY_ALARM, ALARM_TX_POLICY);
+        frames++;
+        len = 1;
+        count = 0;
       }
+      memcpy(&frame[len], record, recordLen);
+      len += recordLen;
+      count++;
+      total++;
     }
-  }
 
-  void sendAlarmUplink(const ModbusRequest& req, const AlarmCondition& alarm, uint16_t value) {
-    if (LMIC.opmode & OP_TXRXPEND) return;
-  
-    uint8_t payload[12];  // 4 IP, 1 unit, 2 reg, 1 op, 2 threshold, 2 value
-    uint8_t i = 0;
-  
-    for (int j = 0; j < 4; j++) payload[i++] = req.slaveIP[j];
-    payload[i++] = req.unitID;
-    payload[i++] = highByte(req.startReg + alarm.index);
-    payload[i++] = lowByte(req.startReg + alarm.index);
-    payload[i++] = alarm.op;
-    payload[i++] = highByte(alarm.threshold);
-    payload[i++] = lowByte(alarm.threshold);
-    payload[i++] = highByte(value);
-    payload[i++] = lowByte(value);
-  
-    txComplete = false;
-    LMIC_setTxData2(2, payload, i, 1);  //  fPort = 2 for alarms
-  
-    while (!txComplete) os_runloop_once();
-    LMIC_clrTxData();
-  
-    Serial.println("Alarm uplink sent");
+    if (count > 0) {
+      frame[0] = count;
+      txEnqueue(frame, len, ALARM_FPORT, TX_PRIORITY_ALARM, ALARM_TX_POLICY);
+      frames++;
+    }
+    metricCount(METRIC_ALARMS_SENT, total);
+    Serial.printf("%d alarm(s) queued in %d frame(s)\n", total, frames);
   }
 
-  void sendAlarmUplink(uint8_t inputIndex, uint8_t expected, uint8_t actual) {
-    if (LMIC.opmode & OP_TXRXPEND) return;
-
-    uint8_t payload[5];  // 1 input index, 1 expected, 1 actual, + 2 reserved for future
-    payload[0] = 0xFF;   // Input alarm flag (distinct from IP start of Modbus)
-    payload[1] = inputIndex;
-    payload[2] = expected;
-    payload[3] = actual;
-    payload[4] = 0x00;   // Reserved or checksum, optional
-
-    txComplete = false;
-    LMIC_setTxData2(2, payload, 5, 1);  // fPort = 2 = alarm
-    
-    while (!txComplete) os_runloop_once();
-    LMIC_clrTxData();
+static bool firstUplinkDone = false;
+static unsigned long txStartedAt = 0;
 
-    Serial.printf("Digital Input Alarm %d: expected %d, got %d\n", inputIndex, expected, actual);
+void onRadioTxStart(uint32_t freqHz) {
+  txStartedAt = millis();
+  metricCount(METRIC_TX);
+  Serial.printf("TX Start - freq: %lu Hz, sf: SF%d\n", (unsigned long)freqHz, getCurrentSF());
+  // Join requests never pass through the TX queue
+  recordAirtime(txInFlight() ? currentTimeOnAirMs(txInFlightLength())
+                             : timeOnAirMs(getCurrentSF(), getCurrentBandwidth(), JOIN_REQUEST_LEN));
 }
 
-  
-  
-  
+void onRadioJoined() {
+  Serial.println("EV_JOINED");
+  joined = true;
+  bootMark("joined");
+}
 
-  
-  
-void onEvent(ev_t ev) {
-  switch (ev) {
-    case EV_TXSTART:
-      Serial.printf("TX Start - freq: %lu Hz, sf: SF%d\n", LMIC.freq, LMIC.datarate);
-      break;
-    case EV_JOINING:  Serial.println("EV_JOINING"); break;
-    case EV_JOINED:   Serial.println("EV_JOINED"); joined = true; break;
-    case EV_TXCOMPLETE:
-      //resetLoRaChip(); 
-      txComplete = true;
-      Serial.println("EV_TXCOMPLETE");
-      saveFrameCounter();
-      if (LMIC.txrxFlags & TXRX_ACK) {
-        Serial.println("Server ACK received");
-      } else {
-        Serial.println("No ACK received");
-      }
-      break;
-    default: Serial.println((unsigned)ev); break;
+void onRadioTxComplete(bool acked, uint32_t seqnoUp, uint8_t port, const uint8_t* data, uint8_t len) {
+  Serial.println("EV_TXCOMPLETE");
+  if (!firstUplinkDone) {
+    firstUplinkDone = true;
+    bootMark("first uplink complete");
+    printBootProfile();
+  }
+  noteFrameCounter(seqnoUp);
+  Serial.println(acked ? "Server ACK received" : "No ACK received");
+  metricRecord(METRIC_TX_MS, millis() - txStartedAt);
+  metricCount(acked ? METRIC_TX_ACKED : METRIC_TX_UNACKED);
+  if (len > 0) metricCount(METRIC_DOWNLINKS);
+  txOnComplete(acked);
+  if (len > 0 && port == DELTA_FPORT && data[0] == DELTA_CMD_KEYFRAME) {
+    Serial.println("Keyframe requested by downlink");
+    requestKeyframe();
   }
 }
 
 
 uint8_t getCurrentSF() {
-  // LMIC.datarate values: DR_0 = SF12 ... DR_5 = SF7 (for AU915/US915)
-  return 12 - LMIC.datarate;  // DR_0 = 0 -> SF12, DR_5 = 5 -> SF7
+  return halRadioSF();
+}
+
+uint32_t getCurrentBandwidth() {
+  return halRadioBandwidth();
 }
 
 uint16_t getMaxMTU(uint8_t sf) {
@@ -256,26 +197,19 @@ uint16_t getMaxMTU(uint8_t sf) {
     case 9: return 115;
     case 10:
     case 11:
-    case 12: return 51;
-    default: return 51;
+    case 12: return LORA_MIN_MTU;
+    default: return LORA_MIN_MTU;
   }
 }
 
-void sendLoRaPayloadChunk(uint8_t* payload, uint8_t len) {
-  txComplete = false;
-  LMIC_setTxData2(1, payload, len, 1);
-
-  unsigned long start = millis();
-  while (!txComplete && millis() - start < 3000) {
-    os_runloop_once();
-    yield();  // Allow Serial input / shell / background tasks
-  }
-
-  if (!txComplete) {
-    Serial.println("TX timeout — no confirmation from LMIC");
-  }
-
-  LMIC_clrTxData();
+// Periodic data: one retry, then moved to the flash store once the next
+// interval's data exists
+bool sendLoRaPayloadChunk(uint8_t* payload, uint8_t len, uint8_t port, TxDoneCallback onDone, uint32_t tag) {
+  uint32_t start = micros();
+  TxPolicy policy = { 1, effectiveUplinkInterval(), true };
+  addIntervalFrame(len);
+  bool queued = txEnqueue(payload, len, port, TX_PRIORITY_PERIODIC, policy, onDone, tag);
+  metricCount(queued ? METRIC_FRAMES_QUEUED : METRIC_QUEUE_REJECTED);
+  metricRecord(METRIC_ENQUEUE_US, micros() - start);
+  return queued;
 }
-
-
@@ -0,0 +1,224 @@
+#include "metrics.h"
+#include "lora.h"
+#include "txqueue.h"
+#include "table.h"
+
+struct Histogram {
+  uint32_t buckets[METRIC_BUCKETS];
+  uint32_t count;
+  uint32_t max;
+  uint64_t sum;
+};
+
+struct RequestMetrics {
+  uint32_t ok;
+  uint32_t failed;
+  uint32_t maxMs;
+  uint32_t buckets[METRIC_BUCKETS];  // latency of successful reads
+};
+
+static const char* counterNames[METRIC_COUNTER_COUNT] = {
+  "scans", "reads ok", "read timeouts", "read errors", "reads skipped",
+  "uplinks", "frames queued", "queue rejected", "tx started", "tx acked",
+  "tx unacked", "downlinks", "alarms sent", "input pulses", "input alarms",
+};
+
+static const char* histogramNames[METRIC_HISTOGRAM_COUNT] = {
+  "read ms", "scan ms", "scan late ms", "enqueue us", "uplink build us",
+  "tx ms", "radio gap ms", "input late ms",
+};
+
+static uint32_t counters[METRIC_COUNTER_COUNT];
+static Histogram histograms[METRIC_HISTOGRAM_COUNT];
+static RequestMetrics requestMetrics[MAX_REQUESTS];
+static uint16_t failedMask = 0;  // requests that failed since the last diagnostic frame
+static portMUX_TYPE metricsMux = portMUX_INITIALIZER_UNLOCKED;
+
+// Baseline of the diagnostic window, only touched by the radio task
+static uint32_t diagCounters[METRIC_COUNTER_COUNT];
+static uint32_t diagBuckets[METRIC_HISTOGRAM_COUNT][METRIC_BUCKETS];
+
+static inline uint8_t bucketOf(uint32_t value) {
+  if (value == 0) return 0;
+  return min(32 - __builtin_clz(value), METRIC_BUCKETS - 1);
+}
+
+void metricCount(MetricCounter counter, uint32_t n) {
+  portENTER_CRITICAL(&metricsMux);
+  counters[counter] += n;
+  portEXIT_CRITICAL(&metricsMux);
+}
+
+void metricRecord(MetricHistogram histogram, uint32_t value) {
+  uint8_t b = bucketOf(value);
+  portENTER_CRITICAL(&metricsMux);
+  Histogram& h = histograms[histogram];
+  h.buckets[b]++;
+  h.count++;
+  h.sum += value;
+  if (value > h.max) h.max = value;
+  portEXIT_CRITICAL(&metricsMux);
+}
+
+void metricRequest(int request, bool ok, uint32_t latencyMs) {
+  if (request < 0 || request >= MAX_REQUESTS) return;
+  uint8_t b = bucketOf(latencyMs);
+  portENTER_CRITICAL(&metricsMux);
+  RequestMetrics& r = requestMetrics[request];
+  if (ok) {
+    r.ok++;
+    r.buckets[b]++;
+    if (latencyMs > r.maxMs) r.maxMs = latencyMs;
+  } else {
+    r.failed++;
+    if (request < 16) failedMask |= 1 << request;
+  }
+  portEXIT_CRITICAL(&metricsMux);
+}
+
+void resetMetrics() {
+  portENTER_CRITICAL(&metricsMux);
+  memset(counters, 0, sizeof(counters));
+  memset(histograms, 0, sizeof(histograms));
+  memset(requestMetrics, 0, sizeof(requestMetrics));
+  failedMask = 0;
+  portEXIT_CRITICAL(&metricsMux);
+  // The next diagnostic window starts from zero too
+  memset(diagCounters, 0, sizeof(diagCounters));
+  memset(diagBuckets, 0, sizeof(diagBuckets));
+}
+
+void resetRequestMetrics() {
+  portENTER_CRITICAL(&metricsMux);
+  memset(requestMetrics, 0, sizeof(requestMetrics));
+  failedMask = 0;
+  portEXIT_CRITICAL(&metricsMux);
+}
+
+// Bucket holding the p-th percentile sample, 0 when there are none
+static uint8_t percentileBucket(const uint32_t* buckets, uint32_t count, uint8_t p) {
+  if (count == 0) return 0;
+  uint32_t rank = ((uint64_t)count * p + 99) / 100;
+  uint32_t seen = 0;
+  for (uint8_t b = 0; b < METRIC_BUCKETS; b++) {
+    seen += buckets[b];
+    if (seen >= rank) return b;
+  }
+  return METRIC_BUCKETS - 1;
+}
+
+// Upper edge of a bucket, as printed: "0", "<N" or ">=N"
+static void formatBucket(uint8_t b, char* out, size_t len) {
+  if (b == 0) snprintf(out, len, "0");
+  else if (b == METRIC_BUCKETS - 1) snprintf(out, len, ">=%u", 1u << (b - 1));
+  else snprintf(out, len, "<%u", 1u << b);
+}
+
+void printMetrics() {
+  static uint32_t c[METRIC_COUNTER_COUNT];
+  static Histogram h[METRIC_HISTOGRAM_COUNT];
+  static RequestMetrics r[MAX_REQUESTS];
+  portENTER_CRITICAL(&metricsMux);
+  memcpy(c, counters, sizeof(c));
+  memcpy(h, histograms, sizeof(h));
+  memcpy(r, requestMetrics, sizeof(r));
+  portEXIT_CRITICAL(&metricsMux);
+
+  Serial.printf("Metrics over %lu s:\n", millis() / 1000);
+  for (int i = 0; i < METRIC_COUNTER_COUNT; i++) {
+    Serial.printf("  %-16s %10lu\n", counterNames[i], (unsigned long)c[i]);
+  }
+
+  char p50[16], p95[16], p99[16];
+  Serial.printf("  %-16s %10s %8s %8s %8s %10s %10s\n", "", "count", "p50", "p95", "p99", "mean", "max");
+  for (int i = 0; i < METRIC_HISTOGRAM_COUNT; i++) {
+    if (h[i].count == 0) {
+      Serial.printf("  %-16s %10s\n", histogramNames[i], "-");
+      continue;
+    }
+    formatBucket(percentileBucket(h[i].buckets, h[i].count, 50), p50, sizeof(p50));
+    formatBucket(percentileBucket(h[i].buckets, h[i].count, 95), p95, sizeof(p95));
+    formatBucket(percentileBucket(h[i].buckets, h[i].count, 99), p99, sizeof(p99));
+    Serial.printf("  %-16s %10lu %8s %8s %8s %10.1f %10lu\n", histogramNames[i], (unsigned long)h[i].count, p50, p95,
+                  p99, (double)h[i].sum / h[i].count, (unsigned long)h[i].max);
+  }
+
+  Serial.printf("  %-16s %10u bytes\n", "request table", (unsigned)requestTableBytes());
+  if (requestCount == 0) return;
+  Serial.println("  req  slave            unit  start       ok   failed  p50 ms  p95 ms  max ms");
+  for (int i = 0; i < requestCount; i++) {
+    formatBucket(percentileBucket(r[i].buckets, r[i].ok, 50), p50, sizeof(p50));
+    formatBucket(percentileBucket(r[i].buckets, r[i].ok, 95), p95, sizeof(p95));
+    Serial.printf("  %3d  %-15s  %4u  %5u  %7lu  %7lu  %6s  %6s  %6lu\n", i, requests[i].slaveIP.toString().c_str(),
+                  requests[i].unitID, requests[i].startReg, (unsigned long)r[i].ok, (unsigned long)r[i].failed,
+                  r[i].ok ? p50 : "-", r[i].ok ? p95 : "-", (unsigned long)r[i].maxMs);
+  }
+}
+
+uint8_t buildDiagnosticFrame(uint8_t* out) {
+  static uint32_t c[METRIC_COUNTER_COUNT];
+  static uint32_t buckets[METRIC_HISTOGRAM_COUNT][METRIC_BUCKETS];
+  portENTER_CRITICAL(&metricsMux);
+  memcpy(c, counters, sizeof(c));
+  for (int i = 0; i < METRIC_HISTOGRAM_COUNT; i++) memcpy(buckets[i], histograms[i].buckets, sizeof(buckets[i]));
+  uint16_t failed = failedMask;
+  failedMask = 0;
+  portEXIT_CRITICAL(&metricsMux);
+
+  uint8_t len = 0;
+  uint32_t uptimeMin = millis() / 60000;
+  out[len++] = DIAG_FORMAT_VERSION;
+  out[len++] = (uptimeMin >> 16) & 0xFF;
+  out[len++] = (uptimeMin >> 8) & 0xFF;
+  out[len++] = uptimeMin & 0xFF;
+
+  for (int i = 0; i < METRIC_COUNTER_COUNT; i++) {
+    uint32_t delta = min(c[i] - diagCounters[i], (uint32_t)0xFFFF);
+    out[len++] = highByte(delta);
+    out[len++] = lowByte(delta);
+    diagCounters[i] = c[i];
+  }
+
+  for (int i = 0; i < METRIC_HISTOGRAM_COUNT; i++) {
+    uint32_t window[METRIC_BUCKETS];
+    uint32_t count = 0;
+    for (int b = 0; b < METRIC_BUCKETS; b++) {
+      window[b] = buckets[i][b] - diagBuckets[i][b];
+      count += window[b];
+      diagBuckets[i][b] = buckets[i][b];
+    }
+    out[len++] = (percentileBucket(window, count, 50) << 4) | percentileBucket(window, count, 95);
+  }
+
+  out[len++] = highByte(failed);
+  out[len++] = lowByte(failed);
+  out[len++] = getCurrentSF();
+  out[len++] = min(txQueueDepth(), 255);
+  return len;
+}
+
+// Low priority and never retried or stored: the next window supersedes it
+void checkDiagnosticUplink() {
+  static unsigned long lastDiag = 0;
+  static bool started = false;
+
+  if (LORA_DIAG_INTERVAL == 0) {
+    started = false;
+    return;
+  }
+  unsigned long now = millis();
+  if (!started) {
+    started = true;
+    lastDiag = now;
+    return;
+  }
+  if (now - lastDiag < LORA_DIAG_INTERVAL) return;
+  lastDiag = now;
+
+  uint8_t frame[DIAG_FRAME_LEN];
+  uint8_t len = buildDiagnosticFrame(frame);
+  TxPolicy policy = { 0, LORA_DIAG_INTERVAL, false };
+  if (!txEnqueue(frame, len, DIAG_FPORT, TX_PRIORITY_PERIODIC, policy)) {
+    Serial.println("Diagnostic frame dropped, TX queue full");
+  }
+}
@@ -1,25 +1,26 @@
-#include <SPI.h>
-#include <Ethernet.h>
-#include <ModbusEthernet.h>
 #include "config.h"
-#include "Modbus.h"
-
-ModbusEthernet mb;
+#include "modbus.h"
+#include "planner.h"
+#include "schedule.h"
+#include "slaves.h"
+#include "tasks.h"
+#include "alarms.h"
+#include "fields.h"
+#include "aggregate.h"
+#include "metrics.h"
+#include "hal.h"
 
 bool ethOK;
 unsigned long lastModbusReadTime;
 
+static void onModbusReply(uint8_t result, uint16_t transactionId);
+
+// Runs on the Modbus task, so a slow DHCP never holds up the LoRa join
 void initEthernet() {
     if (!enableEthernet) {
       Serial.println("Ethernet disabled via config — skipping setup");
       return;
     }
-  
-    pinMode(CS_W5500, OUTPUT);
-    digitalWrite(CS_W5500, HIGH);
-    SPI.begin(SCK_PIN, MISO_PIN, MOSI_PIN);
-  
-    Ethernet.init(CS_W5500);
 
      // Show configured IP settings
   Serial.println("Ethernet Config:");
@@ -37,18 +38,17 @@ void initEthernet() {
 
   
     // Check for physical link (W5500 only)
-    if (Ethernet.linkStatus() == LinkOFF) {
+    if (!halNetworkLinkUp()) {
       Serial.println("Ethernet cable is not connected");
       ethOK = false;
     }
   
     if (useDHCP) {
       Serial.println("Attempting DHCP...");
-      if (Ethernet.begin(MAC_ADDR) == 0) {
+      if (!halNetworkBeginDhcp(MAC_ADDR)) {
         Serial.println("DHCP failed — falling back to static IP");
   
-        Ethernet.begin(MAC_ADDR, ETH_IP, ETH_DNS, ETH_GATEWAY, ETH_SUBNET);
-        if (Ethernet.localIP() == IPAddress(0, 0, 0, 0)) {
+        if (!halNetworkBeginStatic(MAC_ADDR, ETH_IP, ETH_DNS, ETH_GATEWAY, ETH_SUBNET)) {
           Serial.println("Static IP config also failed");
           ethOK = false;
         } else {
@@ -60,8 +60,7 @@ void initEthernet() {
         ethOK = true;
       }
     } else {
-      Ethernet.begin(MAC_ADDR, ETH_IP, ETH_DNS, ETH_GATEWAY, ETH_SUBNET);
-      if (Ethernet.localIP() == IPAddress(0, 0, 0, 0)) {
+      if (!halNetworkBeginStatic(MAC_ADDR, ETH_IP, ETH_DNS, ETH_GATEWAY, ETH_SUBNET)) {
         Serial.println("Static IP config failed");
         ethOK = false;
       } else {
@@ -72,7 +71,7 @@ void initEthernet() {
   
     if (ethOK) {
       printIP();
-      mb.client();
+      halModbusBegin(SLAVE_CONNECT_TIMEOUT, onModbusReply);
     } else {
       Serial.println("Ethernet setup failed — continuing without Modbus");
     }
@@ -81,92 +80,163 @@ void initEthernet() {
 
 void printIP() {
   Serial.print("🖧 IP: ");
-  Serial.println(Ethernet.localIP());
+  Serial.println(halNetworkLocalIP());
 }
 
-void pollModbus() {
-    if (!enableEthernet || !ethOK) {
-      Serial.println("Modbus polling skipped — Ethernet is disabled");
-      return;
+// One slot per planned block issued in the current scan. The transaction ID is
+// the one handed out by the Modbus client, so replies can arrive in any order.
+struct ModbusTransaction {
+  uint16_t id;            // 0 = slot not issued this scan
+  unsigned long issuedAt;
+  uint32_t latencyMs;
+  bool done;
+};
+
+static ModbusTransaction transactions[MAX_BLOCKS];
+static int outstanding = 0;
+
+static void completeRequest(int slot, uint8_t event) {
+  ModbusTransaction& t = transactions[slot];
+  if (t.done) return;
+  t.done = true;
+  outstanding--;
+  t.latencyMs = millis() - t.issuedAt;
+  metricRecord(METRIC_READ_MS, t.latencyMs);
+
+  ModbusBlock& blk = blocks[slot];
+  if (event != HAL_MODBUS_OK) {
+    if (event == HAL_MODBUS_CONNECTION_LOST) markSlaveLost(blk.slaveIP);
+    metricCount(event == HAL_MODBUS_TIMEOUT ? METRIC_READ_TIMEOUT : METRIC_READ_ERROR);
+    Serial.printf("Modbus: block %d failed (0x%02X) after %lu ms\n", slot, event, (unsigned long)t.latencyMs);
+    return;
+  }
+
+  metricCount(METRIC_READ_OK);
+  blk.success = true;
+  scatterBlock(slot);
+}
+
+// Completion callback shared by every transaction in the scan
+static void onModbusReply(uint8_t result, uint16_t transactionId) {
+  for (int s = 0; s < blockCount; s++) {
+    if (transactions[s].id == transactionId) {
+      completeRequest(s, result);
+      break;
     }
-  
-    for (int i = 0; i < requestCount; i++) {
-      ModbusRequest& req = requests[i];
-      req.success = false;
-  
-      if (!mb.isConnected(req.slaveIP)) {
-        Serial.print("Modbus: not connected to ");
-        Serial.println(req.slaveIP);
-        mb.connect(req.slaveIP);
-        continue;
-      }
-  
-      Serial.print("Polling slave ");
-      Serial.print(req.slaveIP);
-      Serial.print(" @ unit ");
-      Serial.println(req.unitID);
-  
-      bool ok = false;
-      switch (req.function) {
-        case READ_HREG:
-          ok = mb.readHreg(req.slaveIP, req.startReg, req.result, req.numRegs, nullptr, req.unitID);
-          break;
-        case READ_IREG:
-          ok = mb.readIreg(req.slaveIP, req.startReg, req.result, req.numRegs, nullptr, req.unitID);
-          break;
-        case READ_COILS: {
-          bool bits[16];
-          ok = mb.readCoil(req.slaveIP, req.startReg, bits, req.numRegs, nullptr, req.unitID);
-          if (ok) {
-            for (int j = 0; j < req.numRegs; j++) {
-              req.result[j] = bits[j] ? 1 : 0;
-            }
-          }
-          break;
-        }
-        case READ_DISCRETE_INPUTS: {
-          bool bits[16];
-          ok = mb.readIsts(req.slaveIP, req.startReg, bits, req.numRegs, nullptr, req.unitID);
-          if (ok) {
-            for (int j = 0; j < req.numRegs; j++) {
-              req.result[j] = bits[j] ? 1 : 0;
-            }
-          }
-          break;
-        }
-      }
-  
-      if (ok) {
-        unsigned long start = millis();
-        while (millis() - start < 50) mb.task();
-        req.success = true;
-  
-        // === 🔔 Evaluate Alarms ===
-        for (int a = 0; a < req.alarmCount; a++) {
-          AlarmCondition& alarm = req.alarms[a];
-  
-          if (alarm.index >= req.numRegs) continue;
-  
-          uint16_t value = req.result[alarm.index];
-          bool triggered = false;
-  
-          switch (alarm.op) {
-            case '>': triggered = value > alarm.threshold; break;
-            case '<': triggered = value < alarm.threshold; break;
-            case '=': triggered = value == alarm.threshold; break;
-          }
-  
-          // Edge-trigger: only fire once when condition becomes true
-          if (triggered && !alarm.active) {
-            alarm.active = true;
-            alarm.pending = true;
-            Serial.printf("Alarm triggered: Reg[%d] = %u %c %u\n", alarm.index, value, alarm.op, alarm.threshold);
-            // TODO: mark for immediate uplink
-          } else if (!triggered && alarm.active) {
-            alarm.active = false;  // reset trigger
-          }
-        }
+  }
+}
+
+static uint16_t issueBlock(ModbusBlock& blk) {
+  bool registers = blk.function == READ_HREG || blk.function == READ_IREG;
+  return halModbusRead(blk.slaveIP, blk.unitID, blk.function, blk.startReg, blk.numRegs,
+                       registers ? blockWords(blk) : nullptr, registers ? nullptr : blockBits(blk));
+}
+
+// Called every loop pass so reconnects happen between scans
+void serviceModbusConnections() {
+  if (!enableEthernet || !ethOK) return;
+  halModbusTask();
+  serviceSlaveConnections();
+}
+
+// Reads the listed blocks. Only the requests they serve are marked fresh,
+// everything downstream leaves the others as they were.
+static void pollBlocks(const uint8_t* list, int count) {
+  unsigned long scanStart = millis();
+  outstanding = 0;
+
+  for (int b = 0; b < blockCount; b++) {
+    transactions[b].id = 0;
+    transactions[b].done = true;
+  }
+
+  bool listed[MAX_BLOCKS] = { false };
+  for (int k = 0; k < count; k++) listed[list[k]] = true;
+  int freshCount = 0;
+  for (int i = 0; i < requestCount; i++) {
+    requests[i].fresh = listed[requestBlock[i]];
+    if (requests[i].fresh) {
+      requests[i].success = false;
+      freshCount++;
+    }
+  }
+
+  // === Issue every due block up front ===
+  for (int k = 0; k < count; k++) {
+    int b = list[k];
+    ModbusBlock& blk = blocks[b];
+    ModbusTransaction& t = transactions[b];
+    blk.success = false;
+    t.latencyMs = 0;  // no stale figure from an earlier scan if this one is never issued
+
+    if (blk.numRegs == 0) continue;  // rejected by the planner
+
+    // Connecting is left to serviceSlaveConnections(), never done mid-scan
+    if (!slaveReady(blk.slaveIP)) {
+      metricCount(METRIC_READ_SKIPPED);
+      continue;
+    }
+
+    Serial.print("Polling slave ");
+    Serial.print(blk.slaveIP);
+    Serial.printf(" @ unit %u, regs %u..%u\n", blk.unitID, blk.startReg, blk.startReg + blk.numRegs - 1);
+
+    // The callback may only fire from halModbusTask(), so the slot is armed first
+    t.done = false;
+    t.issuedAt = millis();
+    outstanding++;
+    t.id = issueBlock(blk);
+    if (t.id == 0) {
+      Serial.printf("Modbus: block %d could not be queued\n", b);
+      metricCount(METRIC_READ_SKIPPED);
+      t.done = true;
+      outstanding--;
+    }
+  }
+
+  // === Collect replies until the last one arrives or times out ===
+  bool timedOut = false;
+  while (outstanding > 0) {
+    halModbusTask();
+    unsigned long now = millis();
+    for (int s = 0; s < blockCount; s++) {
+      if (!transactions[s].done && now - transactions[s].issuedAt >= MODBUS_REQUEST_TIMEOUT) {
+        completeRequest(s, HAL_MODBUS_TIMEOUT);
+        timedOut = true;
       }
     }
+    yield();
+  }
+
+  // Stop late replies from landing in result buffers after the scan is over
+  if (timedOut) halModbusDropTransactions();
+
+  // Rules may span several blocks, so they wait for the whole scan
+  decodeFields();
+  evaluateAlarmRules();
+  accumulateScan();
+
+  int okCount = 0;
+  for (int i = 0; i < requestCount; i++) {
+    if (!requests[i].fresh) continue;
+    if (requests[i].success) okCount++;
+    metricRequest(i, requests[i].success, transactions[requestBlock[i]].latencyMs);
   }
-  
\ No newline at end of file
+  unsigned long scanMs = millis() - scanStart;
+  metricCount(METRIC_SCANS);
+  metricRecord(METRIC_SCAN_MS, scanMs);
+  Serial.printf("Modbus scan: %d/%d requests OK (%d reads) in %lu ms\n", okCount, freshCount, count, scanMs);
+}
+
+bool pollDueModbus() {
+  if (!enableEthernet || !ethOK) return false;
+
+  uint8_t due[MAX_BLOCKS];
+  unsigned long lateMs;
+  int count = takeDueBlocks(millis(), due, lateMs);
+  if (count == 0) return false;
+
+  metricRecord(METRIC_SCAN_LATE_MS, lateMs);
+  pollBlocks(due, count);
+  return true;
+}
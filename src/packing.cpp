@@ -0,0 +1,52 @@
+#include "packing.h"
+
+// A plan stays valid until the MTU (data rate) or any block size changes
+bool packingPlanValid(const PackingPlan& plan, const uint16_t* sizes, uint8_t count, uint16_t capacity) {
+  if (plan.capacity != capacity || plan.itemCount != count) return false;
+  return memcmp(plan.sizes, sizes, count * sizeof(uint16_t)) == 0;
+}
+
+// First-fit-decreasing: place the largest blocks first, each into the first
+// frame with room left. Never uses more than 11/9 OPT + 1 frames.
+void planPacking(PackingPlan& plan, const uint16_t* sizes, uint8_t count, uint16_t capacity) {
+  uint8_t order[MAX_PACK_ITEMS];
+  uint16_t used[MAX_PACK_ITEMS];
+
+  plan.capacity = capacity;
+  plan.itemCount = count;
+  plan.frameCount = 0;
+  memcpy(plan.sizes, sizes, count * sizeof(uint16_t));
+
+  for (int i = 0; i < count; i++) order[i] = i;
+  for (int i = 1; i < count; i++) {
+    uint8_t cur = order[i];
+    int j = i - 1;
+    while (j >= 0 && sizes[order[j]] < sizes[cur]) {
+      order[j + 1] = order[j];
+      j--;
+    }
+    order[j + 1] = cur;
+  }
+
+  for (int k = 0; k < count; k++) {
+    uint8_t item = order[k];
+    if (sizes[item] == 0) {
+      plan.frameOf[item] = 0;  // nothing to send, any frame will do
+      continue;
+    }
+    if (sizes[item] > capacity) {
+      Serial.printf("Packing: %u byte block exceeds the %u byte frame, not sent\n", sizes[item], capacity);
+      plan.frameOf[item] = PACK_REJECTED;
+      continue;
+    }
+
+    int f = 0;
+    while (f < plan.frameCount && used[f] + sizes[item] > capacity) f++;
+    if (f == plan.frameCount) used[plan.frameCount++] = 0;
+    used[f] += sizes[item];
+    plan.frameOf[item] = f;
+  }
+
+  if (plan.frameCount == 0) plan.frameCount = 1;
+  Serial.printf("Packing: %u blocks into %u frame(s) of %u bytes\n", count, plan.frameCount, capacity);
+}
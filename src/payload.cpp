@@ -0,0 +1,367 @@
+#include "payload.h"
+#include "config.h"
+#include "inputs.h"
+#include "lora.h"
+#include "packing.h"
+#include "fields.h"
+#include "aggregate.h"
+
+static uint16_t announcedSchema = 0;
+static bool schemaAnnounced = false;
+static uint16_t announcingSchema = 0;
+static int announceFrames = 0;  // announcement frames still in the TX queue
+static bool announceFailed = false;
+
+// 0xFF marker, input count, counter count, the level of every input as a
+// bitmap (input 0 in bit 0 of the first byte), then per counter its input
+// index and 32-bit pulse count since the last uplink
+uint8_t buildInputSection(uint8_t* inputSection) {
+  // Counters are read and cleared in one step so no pulse slips in between
+  InputSnapshot inputs;
+  snapshotInputs(inputs, true);
+
+  uint8_t inputLen = 0;
+  inputSection[inputLen++] = 0xFF;
+  inputSection[inputLen++] = inputs.count;
+  inputSection[inputLen++] = inputs.counterCount;
+  for (int b = 0; b < (inputs.count + 7) / 8; b++) {
+    inputSection[inputLen++] = (inputs.levels >> (8 * b)) & 0xFF;
+  }
+  for (int c = 0; c < inputs.counterCount; c++) {
+    uint32_t count = inputs.counterValue[c];
+    inputSection[inputLen++] = inputs.counterIndex[c];
+    inputSection[inputLen++] = count >> 24;
+    inputSection[inputLen++] = (count >> 16) & 0xFF;
+    inputSection[inputLen++] = (count >> 8) & 0xFF;
+    inputSection[inputLen++] = count & 0xFF;
+  }
+  return inputLen;
+}
+
+// Coil/discrete requests are bit-packed, register requests are big-endian words
+static uint16_t lastValuesLength(const ModbusRequest& req) {
+  if (!(req.stats & STAT_LAST)) return 0;
+  return (req.function <= 2) ? (req.numRegs + 7) / 8 : req.numRegs * 2;
+}
+
+static uint16_t encodeLastValues(const ModbusRequest& req, const uint16_t* values, uint8_t* out) {
+  uint16_t len = 0;
+  if (!(req.stats & STAT_LAST)) return 0;
+  if (req.function <= 2) {
+    // The store packs bits LSB first too, so the bytes come straight out of it
+    const uint16_t* packed = values + req.valueOffset;
+    for (int b = 0; b < (req.numRegs + 7) / 8; b++) {
+      uint8_t bits = packed[b / 2] >> (8 * (b % 2));
+      if (b == req.numRegs / 8) bits &= (1 << (req.numRegs % 8)) - 1;
+      out[len++] = bits;
+    }
+  } else {
+    for (int r = 0; r < req.numRegs; r++) {
+      uint16_t value = requestValue(values, req, r);
+      out[len++] = highByte(value);
+      out[len++] = lowByte(value);
+    }
+  }
+  return len;
+}
+
+// Last values (when selected) followed by the window statistics
+uint16_t requestValuesLength(const ModbusRequest& req) {
+  return lastValuesLength(req) + statsLength(req);
+}
+
+uint16_t encodeRequestValues(const RegisterSnapshot& snap, int i, uint8_t* out) {
+  const ModbusRequest& req = snap.requests[i];
+  uint16_t len = encodeLastValues(req, snap.values, out);
+  return len + encodeRequestStats(req, i, &out[len]);
+}
+
+// Requests with window statistics carry their STAT_* mask above the function code
+static uint8_t functionByte(const ModbusRequest& req) {
+  uint8_t function = static_cast<uint8_t>(req.function);
+  return req.stats == STAT_LAST ? function : function | (req.stats << 3);
+}
+
+static uint8_t encodeSchemaEntry(const ModbusRequest& req, uint8_t* out) {
+  uint8_t len = 0;
+  for (int j = 0; j < 4; j++) out[len++] = req.slaveIP[j];
+  out[len++] = req.unitID;
+  out[len++] = highByte(req.startReg);
+  out[len++] = lowByte(req.startReg);
+  out[len++] = req.numRegs;
+  out[len++] = functionByte(req);
+  return len;
+}
+
+// Big-endian IEEE 754 single
+static uint8_t encodeFloat(float value, uint8_t* out) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  for (int b = 0; b < 4; b++) out[b] = bits >> (24 - 8 * b);
+  return 4;
+}
+
+// [request][index][type | flags << 4][uplink][scale][offset]
+static uint8_t encodeFieldEntry(const FieldDesc& f, uint8_t* out) {
+  uint8_t len = 0;
+  out[len++] = f.request;
+  out[len++] = f.index;
+  out[len++] = f.type | (f.flags << 4);
+  out[len++] = f.uplink;
+  len += encodeFloat(f.scale, &out[len]);
+  len += encodeFloat(f.offset, &out[len]);
+  return len;
+}
+
+static uint16_t crcUpdate(uint16_t crc, const uint8_t* data, uint8_t len) {
+  for (int b = 0; b < len; b++) {
+    crc ^= (uint16_t)data[b] << 8;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+// CRC-16/CCITT-FALSE over the schema entries of every request, then every field
+uint16_t computeSchemaId(const RegisterSnapshot& snap) {
+  uint16_t crc = 0xFFFF;
+  for (int i = 0; i < snap.count; i++) {
+    uint8_t entry[SCHEMA_ENTRY_LEN];
+    crc = crcUpdate(crc, entry, encodeSchemaEntry(snap.requests[i], entry));
+  }
+  for (int f = 0; f < snap.fieldCount; f++) {
+    uint8_t entry[FIELD_ENTRY_LEN];
+    crc = crcUpdate(crc, entry, encodeFieldEntry(snap.fields[f], entry));
+  }
+  return crc;
+}
+
+// Schema data frames send narrowed fields in place of their register words
+static uint16_t schemaValuesLength(const RegisterSnapshot& snap, int i) {
+  const ModbusRequest& req = snap.requests[i];
+  if (req.function <= 2 || !(req.stats & STAT_LAST)) return requestValuesLength(req);
+
+  uint16_t len = statsLength(req);
+  for (int r = 0; r < req.numRegs;) {
+    int f = findField(snap.fields, snap.fieldCount, i, r);
+    if (f >= 0 && snap.fields[f].uplink != FIELD_UPLINK_RAW) {
+      len += fieldUplinkLength(snap.fields[f]);
+      r += fieldWords(snap.fields[f].type);
+    } else {
+      len += 2;
+      r++;
+    }
+  }
+  return len;
+}
+
+static uint16_t encodeSchemaValues(const RegisterSnapshot& snap, int i, uint8_t* out) {
+  const ModbusRequest& req = snap.requests[i];
+  if (req.function <= 2 || !(req.stats & STAT_LAST)) return encodeRequestValues(snap, i, out);
+
+  uint16_t len = 0;
+  for (int r = 0; r < req.numRegs;) {
+    int f = findField(snap.fields, snap.fieldCount, i, r);
+    if (f >= 0 && snap.fields[f].uplink != FIELD_UPLINK_RAW) {
+      len += encodeFieldUplink(snap.fields[f], snap.fieldValues[f], &out[len]);
+      r += fieldWords(snap.fields[f].type);
+    } else {
+      uint16_t value = requestValue(snap.values, req, r);
+      out[len++] = highByte(value);
+      out[len++] = lowByte(value);
+      r++;
+    }
+  }
+  return len + encodeRequestStats(req, i, &out[len]);
+}
+
+uint16_t legacyBlockLength(const ModbusRequest& req) {
+  return LEGACY_HEADER_LEN + requestValuesLength(req);
+}
+
+static uint16_t encodeLegacyBlock(const RegisterSnapshot& snap, int requestIndex, uint8_t* reqBuf) {
+  const ModbusRequest& req = snap.requests[requestIndex];
+  uint16_t reqLen = 0;
+
+  reqBuf[reqLen++] = req.slaveIP[0];
+  reqBuf[reqLen++] = req.slaveIP[1];
+  reqBuf[reqLen++] = req.slaveIP[2];
+  reqBuf[reqLen++] = req.slaveIP[3];
+  reqBuf[reqLen++] = req.unitID;
+  reqBuf[reqLen++] = highByte(req.startReg);
+  reqBuf[reqLen++] = lowByte(req.startReg);
+  reqBuf[reqLen++] = req.numRegs;
+  bool success = requestReportable(req, requestIndex);
+  reqBuf[reqLen++] = success ? 1 : 0;
+  reqBuf[reqLen++] = functionByte(req);
+
+  if (!success) {
+    uint16_t filler = requestValuesLength(req);
+    memset(&reqBuf[reqLen], 0, filler);
+    reqLen += filler;
+  } else {
+    reqLen += encodeRequestValues(snap, requestIndex, &reqBuf[reqLen]);
+  }
+  return reqLen;
+}
+
+void sendLegacyUplink(const RegisterSnapshot& snap, const uint8_t* inputSection, uint8_t inputLen, uint16_t mtu) {
+  static PackingPlan plan;
+  uint16_t sizes[MAX_PACK_ITEMS];
+
+  // Blocks are self-describing, so any block may go in any frame. Their size
+  // does not depend on the values, so they are encoded straight into the frame.
+  for (int i = 0; i < snap.count; i++) {
+    sizes[i] = legacyBlockLength(snap.requests[i]);
+    if (sizes[i] > mtu) {
+      Serial.printf("Request %d: %u byte block exceeds the %u byte frame, not sent\n", i, sizes[i], mtu);
+      sizes[i] = 0;
+    }
+  }
+  sizes[snap.count] = inputLen;
+
+  if (!packingPlanValid(plan, sizes, snap.count + 1, mtu)) {
+    planPacking(plan, sizes, snap.count + 1, mtu);
+  }
+
+  uint8_t buffer[256];  // working chunk
+  for (int f = 0; f < plan.frameCount; f++) {
+    uint16_t index = 0;
+    for (int i = 0; i <= snap.count; i++) {
+      if (plan.frameOf[i] != f || sizes[i] == 0) continue;
+      if (i < snap.count) {
+        index += encodeLegacyBlock(snap, i, &buffer[index]);
+      } else {
+        memcpy(&buffer[index], inputSection, inputLen);
+        index += inputLen;
+      }
+    }
+    if (index > 0) sendLoRaPayloadChunk(buffer, index, LEGACY_FPORT);
+  }
+}
+
+static void onAnnounceFrameDone(uint32_t tag, bool acked) {
+  if (tag != announcingSchema || announceFrames == 0) return;
+  if (!acked) announceFailed = true;
+  if (--announceFrames > 0) return;
+
+  schemaAnnounced = !announceFailed;
+  announcedSchema = announcingSchema;
+  Serial.printf("Schema %04X %s\n", announcingSchema, schemaAnnounced ? "acknowledged" : "not acked, will repeat");
+}
+
+// Queues the request table once per schema. Returns true when the decoder is
+// known to hold the current schema.
+bool announceSchema(const RegisterSnapshot& snap, uint16_t mtu) {
+  uint16_t schemaId = computeSchemaId(snap);
+  if (schemaAnnounced && schemaId == announcedSchema) return true;
+  if (announceFrames > 0 && schemaId == announcingSchema) return false;  // still on its way
+
+  announcingSchema = schemaId;
+  announceFrames = 0;
+  announceFailed = false;
+  schemaAnnounced = false;
+
+  uint8_t frame[256];
+  int first = 0;
+  do {
+    uint8_t len = 0;
+    frame[len++] = highByte(schemaId);
+    frame[len++] = lowByte(schemaId);
+    frame[len++] = first;
+    frame[len++] = snap.count;
+
+    int i = first;
+    while (i < snap.count && len + SCHEMA_ENTRY_LEN <= mtu) {
+      len += encodeSchemaEntry(snap.requests[i++], &frame[len]);
+    }
+
+    announceFrames++;
+    txEnqueue(frame, len, SCHEMA_ANNOUNCE_FPORT, TX_PRIORITY_CONTROL, SCHEMA_TX_POLICY, onAnnounceFrameDone, schemaId);
+    first = i;
+  } while (first < snap.count);
+
+  // Field descriptors follow in frames of their own, flagged in the firstReq byte
+  first = 0;
+  while (first < snap.fieldCount) {
+    uint8_t len = 0;
+    frame[len++] = highByte(schemaId);
+    frame[len++] = lowByte(schemaId);
+    frame[len++] = SCHEMA_FIELD_FLAG | first;
+    frame[len++] = snap.fieldCount;
+
+    int f = first;
+    while (f < snap.fieldCount && len + FIELD_ENTRY_LEN <= mtu) {
+      len += encodeFieldEntry(snap.fields[f++], &frame[len]);
+    }
+
+    announceFrames++;
+    txEnqueue(frame, len, SCHEMA_ANNOUNCE_FPORT, TX_PRIORITY_CONTROL, SCHEMA_TX_POLICY, onAnnounceFrameDone, schemaId);
+    first = f;
+  }
+
+  Serial.printf("Schema %04X queued (%d requests, %d fields)\n", schemaId, snap.count, snap.fieldCount);
+  return false;
+}
+
+// The input section is one packing item and is never split, so it has to
+// fit the smallest frame next to a full table's bitmaps
+#define SCHEMA_DATA_OVERHEAD_MAX (2 + 2 * ((MAX_REQUESTS + 7) / 8))
+static_assert(SCHEMA_DATA_OVERHEAD_MAX + INPUT_SECTION_MAX <= LORA_MIN_MTU,
+              "MAX_COUNTER_INPUTS too large for a schema frame at SF12");
+
+void sendSchemaUplink(const RegisterSnapshot& snap, const uint8_t* inputSection, uint8_t inputLen, uint16_t mtu) {
+  static PackingPlan plan;
+  uint16_t schemaId = computeSchemaId(snap);
+  uint8_t mapLen = (snap.count + 7) / 8;
+  uint16_t overhead = 2 + 2 * mapLen;
+
+  // Planned on the success-case sizes so a failing slave never reshuffles frames
+  uint16_t sizes[MAX_PACK_ITEMS];
+  bool fits[MAX_REQUESTS];
+  for (int i = 0; i < snap.count; i++) {
+    sizes[i] = schemaValuesLength(snap, i);
+    fits[i] = sizes[i] <= mtu - overhead;
+    if (!fits[i]) {
+      // Left out of every frame, so the decoder keeps its last values
+      Serial.printf("Request %d: %u bytes of values exceed the %u byte frame, not sent\n", i, sizes[i], mtu);
+      sizes[i] = 0;
+    }
+  }
+  sizes[snap.count] = inputLen;
+
+  if (!packingPlanValid(plan, sizes, snap.count + 1, mtu - overhead)) {
+    planPacking(plan, sizes, snap.count + 1, mtu - overhead);
+  }
+
+  uint8_t frame[256];
+  for (int f = 0; f < plan.frameCount; f++) {
+    frame[0] = highByte(schemaId);
+    frame[1] = lowByte(schemaId);
+    uint8_t* includedMap = &frame[2];
+    uint8_t* successMap = includedMap + mapLen;
+    memset(includedMap, 0, 2 * mapLen);
+
+    uint16_t pos = overhead;
+    bool hasData = false;
+    for (int i = 0; i < snap.count; i++) {
+      if (plan.frameOf[i] != f || !fits[i]) continue;
+      const ModbusRequest& req = snap.requests[i];
+      includedMap[i / 8] |= 1 << (i % 8);
+      hasData = true;
+      if (!requestReportable(req, i)) continue;
+      successMap[i / 8] |= 1 << (i % 8);
+      pos += encodeSchemaValues(snap, i, &frame[pos]);
+    }
+
+    // Whatever follows the last included request is the input section
+    if (plan.frameOf[snap.count] == f) {
+      memcpy(&frame[pos], inputSection, inputLen);
+      pos += inputLen;
+      hasData = true;
+    }
+
+    if (hasData) sendLoRaPayloadChunk(frame, pos, SCHEMA_DATA_FPORT);
+  }
+}
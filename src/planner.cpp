@@ -0,0 +1,125 @@
+#include "planner.h"
+#include "slaves.h"
+#include "schedule.h"
+
+ModbusBlock blocks[MAX_BLOCKS];
+int blockCount = 0;
+uint8_t requestBlock[MAX_REQUESTS];
+
+static uint16_t* wordPool = nullptr;
+static bool* bitPool = nullptr;
+static uint16_t wordsUsed = 0;
+static uint16_t bitsUsed = 0;
+
+// Ordering used to bring mergeable requests next to each other
+static bool sortsBefore(const ModbusRequest& a, const ModbusRequest& b) {
+  if ((uint32_t)a.slaveIP != (uint32_t)b.slaveIP) return (uint32_t)a.slaveIP < (uint32_t)b.slaveIP;
+  if (a.unitID != b.unitID) return a.unitID < b.unitID;
+  if (a.function != b.function) return a.function < b.function;
+  if (a.intervalMs != b.intervalMs) return a.intervalMs < b.intervalMs;
+  if (a.phaseMs != b.phaseMs) return a.phaseMs < b.phaseMs;
+  return a.startReg < b.startReg;
+}
+
+void planModbusBlocks() {
+  uint8_t order[MAX_REQUESTS];
+  for (int i = 0; i < requestCount; i++) order[i] = i;
+
+  // Insertion sort, the table never holds more than MAX_REQUESTS entries
+  for (int i = 1; i < requestCount; i++) {
+    uint8_t cur = order[i];
+    int j = i - 1;
+    while (j >= 0 && sortsBefore(requests[cur], requests[order[j]])) {
+      order[j + 1] = order[j];
+      j--;
+    }
+    order[j + 1] = cur;
+  }
+
+  blockCount = 0;
+  wordsUsed = 0;
+  bitsUsed = 0;
+
+  for (int k = 0; k < requestCount; k++) {
+    const ModbusRequest& req = requests[order[k]];
+    uint32_t reqEnd = (uint32_t)req.startReg + req.numRegs;
+
+    if (blockCount > 0) {
+      ModbusBlock& blk = blocks[blockCount - 1];
+      uint32_t blkEnd = (uint32_t)blk.startReg + blk.numRegs;
+      uint16_t limit = isBitFunction(blk.function) ? MAX_PDU_BITS : MAX_PDU_REGS;
+      uint32_t newEnd = max(blkEnd, reqEnd);
+
+      if (blk.slaveIP == req.slaveIP && blk.unitID == req.unitID && blk.function == req.function &&
+          blk.intervalMs == req.intervalMs && blk.phaseMs == req.phaseMs &&
+          req.startReg <= blkEnd + MODBUS_MAX_GAP && newEnd - blk.startReg <= limit) {
+        blk.numRegs = newEnd - blk.startReg;
+        requestBlock[order[k]] = blockCount - 1;
+        continue;
+      }
+    }
+
+    ModbusBlock& blk = blocks[blockCount];
+    blk.slaveIP = req.slaveIP;
+    blk.unitID = req.unitID;
+    blk.function = req.function;
+    blk.startReg = req.startReg;
+    blk.numRegs = req.numRegs;
+    blk.intervalMs = req.intervalMs;
+    blk.phaseMs = req.phaseMs;
+    blk.success = false;
+    requestBlock[order[k]] = blockCount++;
+  }
+
+  // Hand out pool space now that block sizes are final
+  for (int b = 0; b < blockCount; b++) {
+    ModbusBlock& blk = blocks[b];
+    uint16_t& used = isBitFunction(blk.function) ? bitsUsed : wordsUsed;
+    blk.poolOffset = used;
+    used += blk.numRegs;
+  }
+
+  buildSlaveTable();
+
+  Serial.printf("Planner: %d requests coalesced into %d reads (max gap %u)\n",
+                requestCount, blockCount, MODBUS_MAX_GAP);
+  planSchedule();
+}
+
+size_t blockPoolArenaBytes() {
+  return arenaSize(wordsUsed * sizeof(uint16_t)) + arenaSize(bitsUsed * sizeof(bool));
+}
+
+void bindBlockPools(Arena& arena) {
+  wordPool = arenaArray<uint16_t>(arena, wordsUsed);
+  bitPool = arenaArray<bool>(arena, bitsUsed);
+}
+
+uint16_t* blockWords(const ModbusBlock& blk) {
+  return &wordPool[blk.poolOffset];
+}
+
+bool* blockBits(const ModbusBlock& blk) {
+  return &bitPool[blk.poolOffset];
+}
+
+// Copy a completed block back into the live values of every request it serves
+void scatterBlock(int blockIndex) {
+  const ModbusBlock& blk = blocks[blockIndex];
+
+  for (int i = 0; i < requestCount; i++) {
+    if (requestBlock[i] != blockIndex) continue;
+    ModbusRequest& req = requests[i];
+    req.success = blk.success;
+    if (!blk.success) continue;
+
+    uint16_t offset = req.startReg - blk.startReg;
+    for (int j = 0; j < req.numRegs; j++) {
+      if (isBitFunction(blk.function)) {
+        setRequestValue(requestValues, req, j, blockBits(blk)[offset + j]);
+      } else {
+        setRequestValue(requestValues, req, j, blockWords(blk)[offset + j]);
+      }
+    }
+  }
+}
@@ -0,0 +1,179 @@
+#include "schedule.h"
+
+#define WHEEL_REBASE_TICKS (1UL << 24)  // ~9.7 days, well inside millis() wrap-around
+
+static int8_t slotHead[WHEEL_SLOTS];    // -1 = empty
+static int8_t nextInSlot[MAX_BLOCKS];
+static uint32_t dueTick[MAX_BLOCKS];
+static uint32_t periodTicks[MAX_BLOCKS];
+static uint32_t cursor = 0;             // first tick not walked yet
+static unsigned long epoch = 0;         // millis() at tick 0
+
+static uint32_t toTicks(unsigned long ms) {
+  return max<uint32_t>(1, (ms + WHEEL_TICK_MS - 1) / WHEEL_TICK_MS);
+}
+
+static void insertBlock(int b) {
+  uint8_t slot = dueTick[b] % WHEEL_SLOTS;
+  nextInSlot[b] = slotHead[slot];
+  slotHead[slot] = b;
+}
+
+static uint32_t gcd32(uint32_t a, uint32_t b) {
+  while (b) {
+    uint32_t r = a % b;
+    a = b;
+    b = r;
+  }
+  return a;
+}
+
+// What a placed block costs a phase of the block being placed: it shares a
+// tick with it whenever the two phases agree modulo the gcd of the periods,
+// and then once per lcm of the periods, i.e. for gcd / its period of the new
+// block's reads (in 1/65536ths)
+struct PhaseTerm {
+  uint32_t gcd;
+  uint32_t residue;
+  uint32_t share;
+};
+
+static uint32_t phaseLoad(const PhaseTerm* terms, int count, uint32_t phase) {
+  uint32_t sum = 0;
+  for (int k = 0; k < count; k++) {
+    if (phase % terms[k].gcd == terms[k].residue) sum += terms[k].share;
+  }
+  return sum;
+}
+
+// Least loaded phase; among equally loaded ones, the middle of the longest
+// run of them, so consecutive blocks land as far apart as they can. The load
+// repeats every lcm of the gcds, a divisor of the period, so no phase past
+// that is worth trying. Nothing is folded onto the wheel: a block's every
+// read over its whole period counts.
+static uint32_t pickPhase(const uint8_t* placed, int placedCount, uint32_t period) {
+  PhaseTerm terms[MAX_BLOCKS];
+  uint32_t candidates = placedCount ? 1 : period;
+  for (int k = 0; k < placedCount; k++) {
+    int a = placed[k];
+    uint32_t g = gcd32(period, periodTicks[a]);
+    terms[k] = { g, dueTick[a] % g, (uint32_t)(((uint64_t)g << 16) / periodTicks[a]) };
+    candidates = candidates / gcd32(candidates, g) * g;
+  }
+
+  uint32_t least = UINT32_MAX;
+  for (uint32_t p = 0; p < candidates; p++) least = min(least, phaseLoad(terms, placedCount, p));
+
+  uint32_t bestStart = 0, bestLen = 0, runStart = 0, runLen = 0;
+  for (uint32_t p = 0; p < candidates; p++) {
+    if (phaseLoad(terms, placedCount, p) != least) {
+      runLen = 0;
+      continue;
+    }
+    if (runLen++ == 0) runStart = p;
+    if (runLen > bestLen) {
+      bestStart = runStart;
+      bestLen = runLen;
+    }
+  }
+  return bestStart + bestLen / 2;
+}
+
+void planSchedule() {
+  epoch = millis();
+  cursor = 0;
+  memset(slotHead, -1, sizeof(slotHead));
+
+  uint8_t placed[MAX_BLOCKS];
+  uint8_t floating[MAX_BLOCKS];
+  int placedCount = 0, floatingCount = 0;
+
+  // Fixed phases first, the others fit in around them
+  for (int b = 0; b < blockCount; b++) {
+    const ModbusBlock& blk = blocks[b];
+    periodTicks[b] = toTicks(blk.intervalMs ? blk.intervalMs : MODBUS_SCAN_INTERVAL);
+    if (blk.phaseMs < 0) {
+      floating[floatingCount++] = b;
+      continue;
+    }
+    dueTick[b] = (blk.phaseMs / WHEEL_TICK_MS) % periodTicks[b];
+    placed[placedCount++] = b;
+    insertBlock(b);
+  }
+
+  // Shortest periods first, they take the most ticks
+  for (int i = 1; i < floatingCount; i++) {
+    uint8_t cur = floating[i];
+    int j = i - 1;
+    while (j >= 0 && periodTicks[floating[j]] > periodTicks[cur]) {
+      floating[j + 1] = floating[j];
+      j--;
+    }
+    floating[j + 1] = cur;
+  }
+
+  for (int k = 0; k < floatingCount; k++) {
+    int b = floating[k];
+    dueTick[b] = pickPhase(placed, placedCount, periodTicks[b]);
+    placed[placedCount++] = b;
+    insertBlock(b);
+  }
+
+  // Every read that can share a tick with a block is counted against it, so
+  // this bounds the reads any one tick can start
+  uint16_t peak = 0;
+  for (int b = 0; b < blockCount; b++) {
+    uint16_t sharing = 0;
+    for (int a = 0; a < blockCount; a++) {
+      uint32_t g = gcd32(periodTicks[a], periodTicks[b]);
+      if (dueTick[a] % g == dueTick[b] % g) sharing++;
+    }
+    peak = max(peak, sharing);
+  }
+  Serial.printf("Schedule: %d reads on a %u ms wheel, at most %u in one %u ms tick\n", blockCount,
+                WHEEL_SLOTS * WHEEL_TICK_MS, peak, WHEEL_TICK_MS);
+}
+
+int takeDueBlocks(unsigned long now, uint8_t* due, unsigned long& lateMs) {
+  lateMs = 0;
+  if (cursor >= WHEEL_REBASE_TICKS) {
+    uint32_t shift = cursor - cursor % WHEEL_SLOTS;  // whole turns keep every block in its slot
+    epoch += shift * WHEEL_TICK_MS;
+    cursor -= shift;
+    for (int b = 0; b < blockCount; b++) dueTick[b] -= shift;
+  }
+
+  uint32_t nowTick = (now - epoch) / WHEEL_TICK_MS;
+  if (nowTick < cursor) return 0;
+
+  // Every slot passed since the last call, at most one full turn
+  uint32_t steps = min<uint32_t>(nowTick - cursor + 1, WHEEL_SLOTS);
+  uint32_t earliest = nowTick;
+  int count = 0;
+  for (uint32_t k = 0; k < steps; k++) {
+    int8_t* link = &slotHead[(cursor + k) % WHEEL_SLOTS];
+    while (*link >= 0) {
+      int b = *link;
+      if (dueTick[b] > nowTick) {
+        link = &nextInSlot[b];  // a later turn
+        continue;
+      }
+      *link = nextInSlot[b];
+      due[count++] = b;
+      earliest = min(earliest, dueTick[b]);
+    }
+  }
+  cursor = nowTick + 1;
+
+  // Requeued after the walk so a short period cannot fire twice in one call.
+  // Periods missed entirely are skipped rather than caught up.
+  for (int k = 0; k < count; k++) {
+    int b = due[k];
+    dueTick[b] += periodTicks[b];
+    if (dueTick[b] <= nowTick) dueTick[b] += ((nowTick - dueTick[b]) / periodTicks[b] + 1) * periodTicks[b];
+    insertBlock(b);
+  }
+
+  if (count > 0) lateMs = (now - epoch) - earliest * WHEEL_TICK_MS;
+  return count;
+}
@@ -1,6 +1,14 @@
 #include <LittleFS.h>
 #include <flashfs.h>
 #include <serial_editor.h>
+#include <slaves.h>
+#include <tasks.h>
+#include <delta.h>
+#include <txqueue.h>
+#include <airtime.h>
+#include <store.h>
+#include <bootprof.h>
+#include <metrics.h>
 #include <vector>
 
 extern bool shellMode;
@@ -79,6 +87,48 @@ void executeCommand(const String& input) {
     return;
   }
 
+  if (cmd == "slaves") {
+    printSlaveStatus();
+    return;
+  }
+
+  if (cmd == "airtime") {
+    printAirtimeStatus();
+    return;
+  }
+
+  if (cmd == "txq") {
+    printTxQueue();
+    return;
+  }
+
+  if (cmd == "boot") {
+    printBootProfile();
+    return;
+  }
+
+  if (cmd == "store") {
+    printStoreStatus();
+    return;
+  }
+
+  if (cmd == "stats") {
+    printMetrics();
+    return;
+  }
+
+  if (cmd == "stats reset") {
+    resetMetrics();
+    Serial.println("Metrics cleared.");
+    return;
+  }
+
+  if (cmd == "keyframe") {
+    requestKeyframe();
+    Serial.println("Next delta uplink will be a keyframe.");
+    return;
+  }
+
   if (cmd == "shell") {
     shellMode = true;
     Serial.println("🖥️ Entering config shell. Type 'exit' to leave.");
@@ -102,6 +152,13 @@ void executeCommand(const String& input) {
     Serial.println("  resetfs             - Format and regenerate config files");
     Serial.println("  reboot              - Reboot device");
     Serial.println("  reload              - Reload the filesystem");
+    Serial.println("  slaves              - Show Modbus slave connection state");
+    Serial.println("  keyframe            - Force a full keyframe on the next delta uplink");
+    Serial.println("  txq                 - Show the LoRa transmit queue");
+    Serial.println("  airtime             - Show airtime budget usage");
+    Serial.println("  store               - Show the store-and-forward queue");
+    Serial.println("  boot                - Show the boot phase profile");
+    Serial.println("  stats [reset]       - Show (or clear) scan, radio and loop metrics");
     Serial.println("  shell               - Enable shell");
     Serial.println("  monitor             - Return to monitoring mode");
     Serial.println("  help                - Show this help");
@@ -128,8 +185,7 @@ void executeCommand(const String& input) {
 
   if (cmd == "reload") {
   Serial.println("🔁 Reloading configuration...");
-  loadModbusConfigFromFlash();   // Reapplies Modbus, Ethernet, LoRa
-  loadInputsConfig();   // Reapplies digital/counter input config
+  requestConfigReload();   // Applied by the Modbus task between scans
   Serial.println("Configuration reloaded.");
   return;
 }
@@ -311,6 +367,8 @@ void handleSerialCommand() {
           input += c;
           Serial.print(c);  // echo typed char
         }
+      } else {
+        delay(1);  // let the other tasks on this core run
       }
     }
     return input;
@@ -373,7 +431,7 @@ void handleSerialCommand() {
             "count": 4,
             "function": 3,
             "alarms": [
-              { "index": 0, "op": ">", "threshold": 1000 },
+              { "index": 0, "op": ">", "threshold": 1000, "hysteresis": 20, "debounce": 2000 },
               { "index": 2, "op": "=", "threshold": 123 }
             ]
           }
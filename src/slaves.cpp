@@ -0,0 +1,129 @@
+#include "slaves.h"
+#include "planner.h"
+#include "hal.h"
+
+SlaveConnection slaves[MAX_SLAVES];
+int slaveCount = 0;
+
+static SlaveConnection* findSlave(IPAddress ip) {
+  for (int s = 0; s < slaveCount; s++) {
+    if (slaves[s].ip == ip) return &slaves[s];
+  }
+  return nullptr;
+}
+
+static void scheduleReconnect(SlaveConnection& slave, unsigned long now) {
+  slave.state = SLAVE_BACKOFF;
+  slave.nextAttempt = now + slave.backoffMs;
+  slave.backoffMs = min(slave.backoffMs * 2, (unsigned long)SLAVE_BACKOFF_MAX);
+}
+
+// Derive the slave list from the current block plan. Slaves that survive a
+// config reload keep their socket and counters.
+void buildSlaveTable() {
+  SlaveConnection previous[MAX_SLAVES];
+  int previousCount = slaveCount;
+  for (int p = 0; p < previousCount; p++) previous[p] = slaves[p];  // not memcpy: IPAddress carries a vtable
+
+  slaveCount = 0;
+  for (int b = 0; b < blockCount; b++) {
+    SlaveConnection* slave = findSlave(blocks[b].slaveIP);
+    if (!slave) {
+      if (slaveCount >= MAX_SLAVES) break;
+      slave = &slaves[slaveCount++];
+      *slave = SlaveConnection();  // not memset: IPAddress is Printable and carries a vtable
+      slave->ip = blocks[b].slaveIP;
+      slave->state = SLAVE_DISCONNECTED;
+      slave->backoffMs = SLAVE_BACKOFF_MIN;
+
+      for (int p = 0; p < previousCount; p++) {
+        if (previous[p].ip == slave->ip) {
+          *slave = previous[p];
+          slave->unitCount = 0;
+          break;
+        }
+      }
+    }
+
+    bool seenUnit = false;
+    for (int o = 0; o < b; o++) {
+      if (blocks[o].slaveIP == blocks[b].slaveIP && blocks[o].unitID == blocks[b].unitID) seenUnit = true;
+    }
+    if (!seenUnit) slave->unitCount++;
+  }
+
+  // Close sockets to slaves that are no longer referenced
+  for (int p = 0; p < previousCount; p++) {
+    if (!findSlave(previous[p].ip) && previous[p].state == SLAVE_CONNECTED) {
+      halModbusDisconnect(previous[p].ip);
+    }
+  }
+}
+
+// Runs between scans: at most one connect attempt per call, so a dead slave
+// costs one bounded connect per backoff period instead of one per scan.
+void serviceSlaveConnections() {
+  unsigned long now = millis();
+
+  for (int s = 0; s < slaveCount; s++) {
+    SlaveConnection& slave = slaves[s];
+    if (slave.state == SLAVE_CONNECTED) continue;
+    if (slave.state == SLAVE_BACKOFF && (long)(now - slave.nextAttempt) < 0) continue;
+
+    if (halModbusConnected(slave.ip) || halModbusConnect(slave.ip)) {
+      slave.state = SLAVE_CONNECTED;
+      slave.failures = 0;
+      slave.backoffMs = SLAVE_BACKOFF_MIN;
+      slave.connectedSince = now;
+      slave.reconnects++;
+      Serial.print("Modbus: connected to ");
+      Serial.println(slave.ip);
+    } else {
+      slave.failures++;
+      scheduleReconnect(slave, millis());
+      Serial.print("Modbus: connect to ");
+      Serial.print(slave.ip);
+      Serial.printf(" failed (%u), retry in %lu ms\n", slave.failures, slave.nextAttempt - millis());
+    }
+    return;
+  }
+}
+
+bool slaveReady(IPAddress ip) {
+  SlaveConnection* slave = findSlave(ip);
+  if (!slave || slave->state != SLAVE_CONNECTED) return false;
+  if (!halModbusConnected(ip)) {
+    markSlaveLost(ip);
+    return false;
+  }
+  return true;
+}
+
+void markSlaveLost(IPAddress ip) {
+  SlaveConnection* slave = findSlave(ip);
+  if (!slave || slave->state != SLAVE_CONNECTED) return;
+  Serial.print("Modbus: lost connection to ");
+  Serial.println(ip);
+  // First retry is immediate; only repeated failures back off
+  slave->state = SLAVE_DISCONNECTED;
+  slave->backoffMs = SLAVE_BACKOFF_MIN;
+}
+
+void printSlaveStatus() {
+  static const char* stateNames[] = { "disconnected", "connected", "backoff" };
+  unsigned long now = millis();
+
+  Serial.printf("Modbus slaves (%d):\n", slaveCount);
+  for (int s = 0; s < slaveCount; s++) {
+    SlaveConnection& slave = slaves[s];
+    Serial.print("  ");
+    Serial.print(slave.ip);
+    Serial.printf("  units=%u  %s", slave.unitCount, stateNames[slave.state]);
+    if (slave.state == SLAVE_CONNECTED) {
+      Serial.printf(" for %lu s", (now - slave.connectedSince) / 1000);
+    } else if (slave.state == SLAVE_BACKOFF) {
+      Serial.printf(", retry in %ld ms", (long)(slave.nextAttempt - now));
+    }
+    Serial.printf("  failures=%u  connects=%lu\n", slave.failures, (unsigned long)slave.reconnects);
+  }
+}
@@ -0,0 +1,67 @@
+#include <atomic>
+#include "snapshot.h"
+
+static RegisterSnapshot shared;
+static std::atomic<uint32_t> sequence(0);
+static uint16_t* sharedValues = nullptr;
+static uint16_t* readerValues = nullptr;
+static uint16_t slotCount = 0;
+
+size_t snapshotArenaBytes(uint16_t valueSlots) {
+  return 2 * arenaSize(valueSlots * sizeof(uint16_t));
+}
+
+// Nothing is published for the new table until its first scan
+void bindSnapshot(Arena& arena, uint16_t valueSlots) {
+  sequence.fetch_add(1, std::memory_order_acq_rel);
+  sharedValues = arenaArray<uint16_t>(arena, valueSlots);
+  readerValues = arenaArray<uint16_t>(arena, valueSlots);
+  slotCount = valueSlots;
+  shared.count = 0;
+  shared.values = sharedValues;
+  shared.fieldCount = 0;
+  sequence.fetch_add(1, std::memory_order_release);
+}
+
+// Seqlock: the single writer (Modbus task) makes the sequence odd while it
+// copies, readers retry until they see the same even value on both sides.
+void publishSnapshot() {
+  sequence.fetch_add(1, std::memory_order_acq_rel);
+  std::atomic_thread_fence(std::memory_order_release);
+
+  for (int i = 0; i < requestCount; i++) shared.requests[i] = requests[i];
+  shared.count = requestCount;
+  if (slotCount > 0) memcpy(sharedValues, requestValues, slotCount * sizeof(uint16_t));
+  for (int i = 0; i < fieldCount; i++) {
+    shared.fields[i] = fields[i];
+    shared.fieldValues[i] = fieldValues[i];
+  }
+  shared.fieldCount = fieldCount;
+  shared.takenAt = millis();
+
+  sequence.fetch_add(1, std::memory_order_release);
+}
+
+void readSnapshot(RegisterSnapshot& out) {
+  for (;;) {
+    uint32_t before = sequence.load(std::memory_order_acquire);
+    if (before & 1) {
+      taskYIELD();
+      continue;
+    }
+
+    out.count = shared.count;
+    out.takenAt = shared.takenAt;
+    for (int i = 0; i < out.count && i < MAX_REQUESTS; i++) out.requests[i] = shared.requests[i];
+    if (slotCount > 0) memcpy(readerValues, sharedValues, slotCount * sizeof(uint16_t));
+    out.values = readerValues;
+    out.fieldCount = shared.fieldCount;
+    for (int i = 0; i < out.fieldCount && i < MAX_FIELDS; i++) {
+      out.fields[i] = shared.fields[i];
+      out.fieldValues[i] = shared.fieldValues[i];
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (sequence.load(std::memory_order_relaxed) == before) return;
+  }
+}
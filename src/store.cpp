@@ -0,0 +1,313 @@
+#include <LittleFS.h>
+#include "store.h"
+#include "lora.h"
+#include "airtime.h"
+
+#define RECORD_MAGIC 0xA5
+#define RECORD_HEADER_LEN 5
+
+enum StoreOpType : uint8_t { STORE_APPEND, STORE_CONSUMED, STORE_RETRY };
+
+struct StoreOp {
+  StoreOpType type;
+  StoredFrame frame;
+};
+
+struct Segment {
+  uint32_t number;
+  uint16_t records;  // valid records in the file
+  uint16_t acked;    // leading records already replayed
+};
+
+// Everything below is owned by the store task, except the queues and counters
+static QueueHandle_t opQueue;
+static QueueHandle_t replayQueue;  // holds at most the one record on offer
+
+static Segment segments[STORE_MAX_SEGMENTS + 1];  // oldest first
+static int segmentCount = 0;
+static bool writeOpen = false;     // last segment still takes appends
+static uint32_t writeSize = 0;
+static uint32_t nextSegment = 0;
+static uint32_t readOffset = 0;    // byte offset of the next record in segments[0]
+static bool recovered = false;
+
+static bool offered = false;
+static uint32_t offeredId = 0;
+static uint8_t offeredLen = 0;
+static unsigned long retryAt = 0;
+
+static volatile uint32_t pendingRecords = 0;
+static volatile uint32_t storedTotal = 0;
+static volatile uint32_t replayedTotal = 0;
+static volatile uint32_t evictedTotal = 0;
+static volatile uint32_t lostTotal = 0;
+
+static uint16_t crc16(uint8_t port, uint8_t len, const uint8_t* data) {
+  uint16_t crc = 0xFFFF;
+  uint8_t head[2] = { port, len };
+  for (int i = 0; i < 2 + len; i++) {
+    crc ^= (uint16_t)(i < 2 ? head[i] : data[i - 2]) << 8;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+static String segmentPath(uint32_t number, const char* ext) {
+  char path[32];
+  snprintf(path, sizeof(path), STORE_DIR "/%08lx.%s", (unsigned long)number, ext);
+  return String(path);
+}
+
+// Reads the record at offset; false at the end of the file or on a torn or
+// corrupt record, which ends the segment either way
+static bool readRecord(File& file, uint32_t offset, StoredFrame& out) {
+  uint8_t header[RECORD_HEADER_LEN];
+  if (!file.seek(offset) || file.read(header, RECORD_HEADER_LEN) != RECORD_HEADER_LEN) return false;
+  if (header[0] != RECORD_MAGIC || header[2] > TX_MAX_PAYLOAD) return false;
+
+  out.port = header[1];
+  out.len = header[2];
+  if (file.read(out.data, out.len) != out.len) return false;
+  return crc16(out.port, out.len, out.data) == ((header[3] << 8) | header[4]);
+}
+
+// Byte offset of record `index`, counting valid records only
+static uint32_t recordOffset(uint32_t number, uint16_t index) {
+  File file = LittleFS.open(segmentPath(number, "seg").c_str(), "r");
+  if (!file) return 0;
+  static StoredFrame scratch;
+  uint32_t offset = 0;
+  for (uint16_t i = 0; i < index && readRecord(file, offset, scratch); i++) {
+    offset += RECORD_HEADER_LEN + scratch.len;
+  }
+  file.close();
+  return offset;
+}
+
+static void deleteSegment(int i) {
+  LittleFS.remove(segmentPath(segments[i].number, "seg").c_str());
+  LittleFS.remove(segmentPath(segments[i].number, "ack").c_str());
+  pendingRecords -= segments[i].records - segments[i].acked;
+
+  for (int k = i; k < segmentCount - 1; k++) segments[k] = segments[k + 1];
+  segmentCount--;
+  if (segmentCount == 0) writeOpen = false;
+  if (i == 0 && segmentCount > 0) readOffset = recordOffset(segments[0].number, segments[0].acked);
+}
+
+// Rebuilds the segment table from the files left by the previous boot.
+// Appends always go to a fresh segment, never after a record that may be torn.
+static void recoverSegments() {
+  recovered = true;
+  if (!LittleFS.exists(STORE_DIR)) LittleFS.mkdir(STORE_DIR);
+
+  File dir = LittleFS.open(STORE_DIR);
+  File entry = dir.openNextFile();
+  while (entry) {
+    String name = entry.name();
+    name = name.substring(name.lastIndexOf('/') + 1);
+    entry.close();
+
+    if (name.endsWith(".seg") && segmentCount < STORE_MAX_SEGMENTS) {
+      uint32_t number = strtoul(name.c_str(), nullptr, 16);
+      int k = segmentCount++;
+      while (k > 0 && segments[k - 1].number > number) {
+        segments[k] = segments[k - 1];
+        k--;
+      }
+      segments[k] = { number, 0, 0 };
+      nextSegment = max(nextSegment, number + 1);
+    }
+    entry = dir.openNextFile();
+  }
+  dir.close();
+
+  static StoredFrame scratch;
+  for (int i = 0; i < segmentCount; i++) {
+    Segment& seg = segments[i];
+    File file = LittleFS.open(segmentPath(seg.number, "seg").c_str(), "r");
+    uint32_t offset = 0;
+    while (file && readRecord(file, offset, scratch)) {
+      offset += RECORD_HEADER_LEN + scratch.len;
+      seg.records++;
+    }
+    if (file) file.close();
+
+    File ack = LittleFS.open(segmentPath(seg.number, "ack").c_str(), "r");
+    seg.acked = ack ? min<uint32_t>(ack.size(), seg.records) : 0;
+    if (ack) ack.close();
+    pendingRecords += seg.records - seg.acked;
+  }
+
+  for (int i = segmentCount - 1; i >= 0; i--) {
+    if (segments[i].acked >= segments[i].records) deleteSegment(i);
+  }
+  if (segmentCount > 0) readOffset = recordOffset(segments[0].number, segments[0].acked);
+
+  Serial.printf("Store: %d segment(s), %lu frame(s) waiting for replay\n", segmentCount, (unsigned long)pendingRecords);
+}
+
+static void appendRecord(const StoredFrame& frame) {
+  uint32_t recordLen = RECORD_HEADER_LEN + frame.len;
+
+  if (!writeOpen || writeSize + recordLen > STORE_SEGMENT_SIZE) {
+    if (segmentCount == STORE_MAX_SEGMENTS) {
+      evictedTotal += segments[0].records - segments[0].acked;
+      Serial.printf("Store: full, evicting %u frame(s)\n", segments[0].records - segments[0].acked);
+      deleteSegment(0);
+      offered = false;  // a record on offer from it is now orphaned
+    }
+    segments[segmentCount++] = { nextSegment++, 0, 0 };
+    writeOpen = true;
+    writeSize = 0;
+    if (segmentCount == 1) readOffset = 0;
+  }
+
+  Segment& seg = segments[segmentCount - 1];
+  uint16_t crc = crc16(frame.port, frame.len, frame.data);
+  uint8_t header[RECORD_HEADER_LEN] = { RECORD_MAGIC, frame.port, frame.len, highByte(crc), lowByte(crc) };
+
+  File file = LittleFS.open(segmentPath(seg.number, "seg").c_str(), "a");
+  if (!file) {
+    Serial.println("Store: segment open failed — frame lost");
+    lostTotal++;
+    writeOpen = false;
+    return;
+  }
+  bool ok = file.write(header, RECORD_HEADER_LEN) == RECORD_HEADER_LEN &&
+            file.write(frame.data, frame.len) == frame.len;
+  file.close();
+  if (!ok) {
+    // The tail is torn; recovery stops there, and so does this segment
+    Serial.println("Store: write failed — frame lost");
+    lostTotal++;
+    writeOpen = false;
+    return;
+  }
+
+  writeSize += recordLen;
+  seg.records++;
+  pendingRecords++;
+  storedTotal++;
+}
+
+static void consumeOffered() {
+  Segment& seg = segments[0];
+  File ack = LittleFS.open(segmentPath(seg.number, "ack").c_str(), "a");
+  if (ack) {
+    ack.write((uint8_t)1);
+    ack.close();
+  }
+  seg.acked++;
+  readOffset += RECORD_HEADER_LEN + offeredLen;
+  pendingRecords--;
+  replayedTotal++;
+
+  bool writing = writeOpen && segmentCount == 1;
+  if (seg.acked >= seg.records && !writing) deleteSegment(0);
+}
+
+static void offerNext() {
+  if (offered || segmentCount == 0) return;
+  if (retryAt && (long)(millis() - retryAt) < 0) return;
+  retryAt = 0;
+
+  Segment& seg = segments[0];
+  bool writing = writeOpen && segmentCount == 1;
+  if (seg.acked >= seg.records) {
+    if (!writing) deleteSegment(0);
+    return;
+  }
+
+  static StoredFrame frame;
+  File file = LittleFS.open(segmentPath(seg.number, "seg").c_str(), "r");
+  bool ok = file && readRecord(file, readOffset, frame);
+  if (file) file.close();
+  if (!ok) {
+    Serial.printf("Store: segment %08lx corrupt after record %u, dropping the rest\n", (unsigned long)seg.number, seg.acked);
+    pendingRecords -= seg.records - seg.acked;
+    seg.records = seg.acked;
+    if (writing) writeOpen = false;
+    deleteSegment(0);
+    return;
+  }
+
+  frame.id = ++offeredId;
+  if (xQueueSend(replayQueue, &frame, 0) != pdTRUE) return;  // an orphan is still on offer
+  offeredLen = frame.len;
+  offered = true;
+}
+
+void initStore() {
+  opQueue = xQueueCreate(STORE_QUEUE_LEN, sizeof(StoreOp));
+  replayQueue = xQueueCreate(1, sizeof(StoredFrame));
+}
+
+void serviceStore(uint32_t waitMs) {
+  if (!recovered) recoverSegments();
+
+  static StoreOp op;
+  if (xQueueReceive(opQueue, &op, pdMS_TO_TICKS(waitMs)) == pdTRUE) {
+    switch (op.type) {
+      case STORE_APPEND:
+        appendRecord(op.frame);
+        break;
+      case STORE_CONSUMED:
+        if (offered && op.frame.id == offeredId) {
+          offered = false;
+          consumeOffered();
+        }
+        break;
+      case STORE_RETRY:
+        if (offered && op.frame.id == offeredId) {
+          offered = false;
+          retryAt = millis() + STORE_RETRY_MS;
+        }
+        break;
+    }
+  }
+  offerNext();
+}
+
+// Called by the TX queue for a frame that left unconfirmed
+void storeFrame(uint8_t port, const uint8_t* data, uint8_t len) {
+  static StoreOp op;  // radio task only
+  op.type = STORE_APPEND;
+  op.frame.port = port;
+  op.frame.len = len;
+  memcpy(op.frame.data, data, len);
+  if (xQueueSend(opQueue, &op, 0) != pdTRUE) {
+    Serial.println("Store: write queue full — frame lost");
+    lostTotal++;
+  }
+}
+
+static void onReplayDone(uint32_t id, bool acked) {
+  static StoreOp op;  // radio task only
+  op.type = acked ? STORE_CONSUMED : STORE_RETRY;
+  op.frame.id = id;
+  op.frame.len = 0;
+  xQueueSend(opQueue, &op, 0);  // if lost, the record is simply offered again after a reboot
+}
+
+// Stored frames only go out while no live traffic is waiting
+void serviceReplay() {
+  if (txQueueDepth() > 0 || uxQueueMessagesWaiting(replayQueue) == 0) return;
+
+  static StoredFrame frame;
+  if (xQueuePeek(replayQueue, &frame, 0) != pdTRUE) return;
+  if (frame.len > getMaxMTU(getCurrentSF())) return;  // wait for a faster data rate
+  if (!airtimeAllows(TX_PRIORITY_PERIODIC, frame.len)) return;
+
+  xQueueReceive(replayQueue, &frame, 0);
+  txEnqueue(frame.data, frame.len, STORE_REPLAY_FPORT_BASE + frame.port, TX_PRIORITY_PERIODIC,
+            STORE_REPLAY_POLICY, onReplayDone, frame.id);
+}
+
+void printStoreStatus() {
+  Serial.printf("Store: %lu frame(s) waiting in %d segment(s)\n", (unsigned long)pendingRecords, segmentCount);
+  Serial.printf("  stored %lu, replayed %lu, evicted %lu, lost %lu\n", (unsigned long)storedTotal,
+                (unsigned long)replayedTotal, (unsigned long)evictedTotal, (unsigned long)lostTotal);
+}
@@ -0,0 +1,189 @@
+#include <new>
+#include "table.h"
+#include "arena.h"
+#include "alarms.h"
+#include "planner.h"
+#include "snapshot.h"
+#include "aggregate.h"
+#include "delta.h"
+#include "fields.h"
+#include "payload.h"
+#include "lora.h"
+#include "tasks.h"
+
+static Arena tableArena;
+static ModbusRequest* scratchRequests = nullptr;
+static bool built = false;
+
+void beginRequestTable() {
+  if (!scratchRequests) scratchRequests = new ModbusRequest[MAX_REQUESTS];
+  requests = scratchRequests;
+  requestCount = 0;
+  clearAlarmRules();
+}
+
+// Every encoding falls back to legacy blocks, so a request has to fit one
+// on its own; delta frames carry its raw piece on top of that
+static bool fitsSmallestFrame(const ModbusRequest& req) {
+  uint16_t mtu = getMaxMTU(12);
+  if (legacyBlockLength(req) > mtu) return false;
+  return LORA_ENCODING != ENCODING_DELTA || deltaFrameLength(req) <= mtu;
+}
+
+// Fields and alarm terms of requests after 'after' move by 'by' entries
+static void shiftRequestRefs(int after, int by) {
+  for (int f = 0; f < fieldCount; f++) {
+    if (fields[f].request > after) fields[f].request += by;
+  }
+  for (int t = 0; t < alarmTermCount; t++) {
+    if (alarmTerms[t].request > after) alarmTerms[t].request += by;
+  }
+}
+
+static bool splitsField(int request, int reg) {
+  for (int f = 0; f < fieldCount; f++) {
+    const FieldDesc& fd = fields[f];
+    if (fd.request == request && fd.index < reg && reg < fd.index + fieldWords(fd.type)) return true;
+  }
+  return false;
+}
+
+// Drops a request whose pieces do not fit the table, with its fields and
+// alarm rules
+static void rejectRequest(int i) {
+  int kept = 0;
+  for (int f = 0; f < fieldCount; f++) {
+    if (fields[f].request != i) fields[kept++] = fields[f];
+  }
+  fieldCount = kept;
+  for (int r = 0; r < alarmRuleCount; r++) {
+    AlarmRule& rule = alarmRules[r];
+    for (int k = 0; k < rule.termCount; k++) {
+      if (alarmTerms[rule.firstTerm + k].request == i) rule.termCount = 0;
+    }
+  }
+  for (int k = i; k + 1 < requestCount; k++) requests[k] = requests[k + 1];
+  requestCount--;
+  shiftRequestRefs(i, -1);
+}
+
+// A request too large for the smallest frame becomes several adjacent
+// requests that each fit. The planner reads them back as one block, so the
+// wire traffic stays the same; fields and alarm terms move with their
+// registers, and no cut falls inside a field.
+static void splitOversizeRequests(int capacity) {
+  for (int i = 0; i < requestCount; i++) {
+    ModbusRequest whole = requests[i];
+    if (fitsSmallestFrame(whole)) continue;
+
+    uint8_t start[MAX_REQUEST_REGS];
+    uint8_t length[MAX_REQUEST_REGS];
+    int pieces = 0;
+    for (int at = 0; at < whole.numRegs;) {
+      ModbusRequest piece = whole;
+      piece.numRegs = whole.numRegs - at;
+      while (piece.numRegs > 1 && (!fitsSmallestFrame(piece) || splitsField(i, at + piece.numRegs))) piece.numRegs--;
+      start[pieces] = at;
+      length[pieces++] = piece.numRegs;
+      at += piece.numRegs;
+    }
+
+    if (requestCount + pieces - 1 > capacity) {
+      Serial.printf("Request %d: %u registers need %d uplink pieces, more than the table has room for; dropped\n", i,
+                    whole.numRegs, pieces);
+      rejectRequest(i--);
+      continue;
+    }
+
+    for (int k = requestCount - 1; k > i; k--) requests[k + pieces - 1] = requests[k];
+    requestCount += pieces - 1;
+    shiftRequestRefs(i, pieces - 1);
+    for (int p = 0; p < pieces; p++) {
+      requests[i + p] = whole;
+      requests[i + p].startReg = whole.startReg + start[p];
+      requests[i + p].numRegs = length[p];
+    }
+    for (int f = 0; f < fieldCount; f++) {
+      if (fields[f].request != i) continue;
+      int p = pieces - 1;
+      while (start[p] > fields[f].index) p--;
+      fields[f].request = i + p;
+      fields[f].index -= start[p];
+    }
+    for (int t = 0; t < alarmTermCount; t++) {
+      if (alarmTerms[t].request != i) continue;
+      int p = pieces - 1;
+      while (start[p] > alarmTerms[t].index) p--;
+      alarmTerms[t].request = i + p;
+      alarmTerms[t].index -= start[p];
+    }
+    Serial.printf("Request %d: %u registers split into %d requests that each fit a %u byte frame\n", i, whole.numRegs,
+                  pieces, getMaxMTU(12));
+    i += pieces - 1;
+  }
+}
+
+bool buildRequestTable() {
+  // Only the loaders' scratch table has room for extra entries
+  splitOversizeRequests(requests == scratchRequests ? MAX_REQUESTS : requestCount);
+
+  // Values go back to back in table order, bit requests packed
+  uint16_t slots = 0;
+  for (int i = 0; i < requestCount; i++) {
+    requests[i].valueOffset = slots;
+    slots += requestValueSlots(requests[i]);
+  }
+  planModbusBlocks();  // pool offsets only, the pools are carved below
+
+  size_t bytes = arenaSize(requestCount * sizeof(ModbusRequest)) + arenaSize(slots * sizeof(uint16_t)) +
+                 alarmArenaBytes() + blockPoolArenaBytes() + snapshotArenaBytes(slots) +
+                 aggregateArenaBytes() + deltaArenaBytes(slots);
+
+  // The new table is carved beside the old one, which the radio task may be
+  // encoding from, and only swapped in under the table lock
+  Arena next = {};
+  bool ok = arenaReset(next, bytes);
+  lockRequestTable();
+  if (!ok) {
+    arenaReset(tableArena, 0);  // perhaps there is room once the old table is gone
+    ok = arenaReset(next, bytes);
+  }
+  if (!ok) {
+    Serial.printf("Request table: %u bytes not available, table left empty\n", (unsigned)bytes);
+    requestCount = 0;
+    slots = 0;
+    alarmRuleCount = 0;
+    alarmTermCount = 0;
+    planModbusBlocks();
+  }
+
+  ModbusRequest* table = arenaArray<ModbusRequest>(next, requestCount);
+  for (int i = 0; i < requestCount; i++) new (&table[i]) ModbusRequest(requests[i]);
+  requests = table;
+  requestValues = arenaArray<uint16_t>(next, slots);
+
+  bindAlarmRules(next);
+  bindBlockPools(next);
+  bindSnapshot(next, slots);
+  bindAggregates(next);
+  bindDelta(next, slots);
+
+  arenaReset(tableArena, 0);
+  tableArena = next;
+  unlockRequestTable();
+
+  delete[] scratchRequests;
+  scratchRequests = nullptr;
+  built = true;
+
+  Serial.printf("Request table: %d requests, %u value slots, %u bytes\n", requestCount, slots, (unsigned)tableArena.used);
+  return ok;
+}
+
+bool requestTableBuilt() {
+  return built;
+}
+
+size_t requestTableBytes() {
+  return tableArena.used;
+}
@@ -0,0 +1,172 @@
+#include "tasks.h"
+#include "flashfs.h"
+#include "modbus.h"
+#include "lora.h"
+#include "inputs.h"
+#include "serial_editor.h"
+#include "snapshot.h"
+#include "airtime.h"
+#include "store.h"
+#include "fcnt.h"
+#include "configimage.h"
+#include "bootprof.h"
+#include "metrics.h"
+#include "hal.h"
+
+extern bool shellMode;
+
+static QueueHandle_t alarmQueue;
+static volatile bool reloadRequested = false;
+
+// Held by the radio task while it builds uplinks and by buildRequestTable()
+// for the arena swap only, never across a reload's parse or flash writes
+static SemaphoreHandle_t tableLock = nullptr;
+
+bool postAlarm(const AlarmEvent& ev) {
+  if (xQueueSend(alarmQueue, &ev, 0) != pdTRUE) {
+    Serial.println("Alarm queue full — event dropped");
+    return false;
+  }
+  return true;
+}
+
+bool nextAlarm(AlarmEvent& ev) {
+  return xQueueReceive(alarmQueue, &ev, 0) == pdTRUE;
+}
+
+int pendingAlarmCount() {
+  return uxQueueMessagesWaiting(alarmQueue);
+}
+
+void lockRequestTable() {
+  if (tableLock) xSemaphoreTake(tableLock, portMAX_DELAY);
+}
+
+void unlockRequestTable() {
+  if (tableLock) xSemaphoreGive(tableLock);
+}
+
+// Config is only swapped between scans, on the task that owns the table
+void requestConfigReload() {
+  reloadRequested = true;
+  while (reloadRequested) delay(10);
+}
+
+static void modbusTask(void*) {
+  initEthernet();  // DHCP may take a while; the join is already under way
+  bootMark("ethernet");
+
+  for (;;) {
+    if (reloadRequested) {
+      loadConfig(false);  // Reparses every JSON file and recompiles the image
+      publishSnapshot();
+      resetRequestMetrics();
+      reloadRequested = false;
+    }
+
+    if (!shellMode && joined) {
+      serviceModbusConnections();
+
+      if (pollDueModbus()) {
+        lastModbusPoll = millis();
+        publishSnapshot();
+        bootMark("first poll");
+      }
+    }
+    vTaskDelay(pdMS_TO_TICKS(10));
+  }
+}
+
+// Sole owner of LMIC: every LMIC call happens on this task. Nothing here
+// waits for a frame to go out, the TX queue is serviced between passes.
+static void radioTask(void*) {
+  unsigned long lastPass = millis();
+  for (;;) {
+    unsigned long passStart = millis();
+    metricRecord(METRIC_RADIO_GAP_MS, passStart - lastPass);
+    lastPass = passStart;
+
+    // LMIC and the TX queue keep running while a reload parses
+    halRadioRunOnce();
+    if (joined) serviceTxQueue();
+    if (JOIN_MODE_ABP) serviceFrameCounter();
+
+    if (joined && !shellMode) {
+      serviceReplay();
+
+      lockRequestTable();
+      checkAlarmUplink();
+      checkDiagnosticUplink();
+
+      unsigned long now = millis();
+      if (now - lastUplink >= effectiveUplinkInterval()) {
+        Serial.printf("Lora interval %lu ms\n", now - lastUplink);
+        lastUplink = now;
+        Serial.printf("Uplink triggered at: %lu ms\n", millis());
+        sendLoRaUplink();
+        Serial.printf("Uplink complete at: %lu ms\n", millis());
+      }
+      unlockRequestTable();
+    }
+    vTaskDelay(1);
+  }
+}
+
+static void inputsTask(void*) {
+  TickType_t lastWake = xTaskGetTickCount();
+  unsigned long lastSample = millis();
+  for (;;) {
+    unsigned long now = millis();
+    if (now - lastSample > INPUT_SAMPLE_MS) metricRecord(METRIC_INPUT_LATE_MS, now - lastSample - INPUT_SAMPLE_MS);
+    lastSample = now;
+    handleDigitalInputs();
+    vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(INPUT_SAMPLE_MS));
+  }
+}
+
+// All store-and-forward flash I/O happens here, off the polling and radio paths
+static void storeTask(void*) {
+  for (;;) {
+    serviceStore(1000);
+  }
+}
+
+static void shellTask(void*) {
+  for (;;) {
+    handleSerialCommand();  // Always parse input (only acts when shellMode=true)
+    vTaskDelay(pdMS_TO_TICKS(10));
+  }
+}
+
+static SemaphoreHandle_t hardwareReady;
+
+// SPI, W5500 and SX127x bring-up, overlapping the config load in setup()
+static void hardwareInitTask(void*) {
+  halNetworkInit();  // claims the shared SPI pins before the radio does
+  halRadioInit();
+  bootMark("hardware");
+  xSemaphoreGive(hardwareReady);
+  vTaskDelete(NULL);
+}
+
+void startHardwareInit() {
+  hardwareReady = xSemaphoreCreateBinary();
+  xTaskCreatePinnedToCore(hardwareInitTask, "hwinit", 4096, nullptr, 2, nullptr, MODBUS_TASK_CORE);
+}
+
+void waitHardwareInit() {
+  xSemaphoreTake(hardwareReady, portMAX_DELAY);
+}
+
+void startTasks() {
+  alarmQueue = xQueueCreate(ALARM_QUEUE_LEN, sizeof(AlarmEvent));
+  tableLock = xSemaphoreCreateMutex();
+  initStore();
+  publishSnapshot();
+
+  xTaskCreatePinnedToCore(radioTask,  "radio",  8192,  nullptr, 3, nullptr, RADIO_TASK_CORE);
+  xTaskCreatePinnedToCore(inputsTask, "inputs", 4096,  nullptr, 4, nullptr, INPUTS_TASK_CORE);
+  xTaskCreatePinnedToCore(modbusTask, "modbus", 12288, nullptr, 2, nullptr, MODBUS_TASK_CORE);
+  xTaskCreatePinnedToCore(shellTask,  "shell",  12288, nullptr, 1, nullptr, SHELL_TASK_CORE);
+  xTaskCreatePinnedToCore(storeTask,  "store",  6144,  nullptr, 1, nullptr, STORE_TASK_CORE);
+}
@@ -0,0 +1,208 @@
+#include "txqueue.h"
+#include "airtime.h"
+#include "store.h"
+#include "hal.h"
+
+struct TxEntry {
+  bool used;
+  uint8_t priority;
+  uint8_t port;
+  uint8_t len;
+  uint8_t retriesLeft;
+  bool persist;
+  unsigned long enqueuedAt;
+  unsigned long ttlMs;
+  uint32_t order;        // FIFO within one priority
+  TxDoneCallback onDone;
+  uint32_t tag;
+  uint8_t data[TX_MAX_PAYLOAD];
+};
+
+// Only ever changed from the radio task (enqueue, service and radio events).
+// The shell and diagnostics read it from other tasks, so entry headers,
+// inFlight and dropped change under txMux, and outside readers copy under it.
+static TxEntry queue[TX_QUEUE_LEN];
+static int inFlight = -1;
+static unsigned long inFlightSince = 0;
+static uint32_t nextOrder = 0;
+static uint32_t dropped = 0;
+static portMUX_TYPE txMux = portMUX_INITIALIZER_UNLOCKED;
+
+static void finish(int slot, bool acked) {
+  TxEntry& e = queue[slot];
+  portENTER_CRITICAL(&txMux);
+  e.used = false;
+  portEXIT_CRITICAL(&txMux);
+  if (!acked && e.persist) storeFrame(e.port, e.data, e.len);
+  if (e.onDone) e.onDone(e.tag, acked);
+}
+
+bool txEnqueue(const uint8_t* data, uint8_t len, uint8_t port, TxPriority priority, TxPolicy policy,
+               TxDoneCallback onDone, uint32_t tag) {
+  if (len > TX_MAX_PAYLOAD) {
+    Serial.printf("TX queue: %u byte frame too large\n", len);
+    if (onDone) onDone(tag, false);
+    return false;
+  }
+
+  int slot = -1;
+  for (int i = 0; i < TX_QUEUE_LEN; i++) {
+    if (!queue[i].used) { slot = i; break; }
+  }
+
+  // Full: an alarm may evict the newest lower-priority entry that is not on air
+  if (slot < 0) {
+    for (int i = 0; i < TX_QUEUE_LEN; i++) {
+      if (i == inFlight || queue[i].priority <= priority) continue;
+      if (slot < 0 || queue[i].order > queue[slot].order) slot = i;
+    }
+    if (slot < 0) {
+      Serial.println("TX queue full — frame dropped");
+      portENTER_CRITICAL(&txMux);
+      dropped++;
+      portEXIT_CRITICAL(&txMux);
+      if (policy.persist) storeFrame(port, data, len);
+      if (onDone) onDone(tag, false);
+      return false;
+    }
+    Serial.printf("TX queue full — evicting port %u frame\n", queue[slot].port);
+    portENTER_CRITICAL(&txMux);
+    dropped++;
+    portEXIT_CRITICAL(&txMux);
+    finish(slot, false);
+  }
+
+  TxEntry& e = queue[slot];
+  memcpy(e.data, data, len);  // the payload is only ever read by the radio task
+  portENTER_CRITICAL(&txMux);
+  e.used = true;
+  e.priority = priority;
+  e.port = port;
+  e.len = len;
+  e.retriesLeft = policy.retries;
+  e.persist = policy.persist;
+  e.enqueuedAt = millis();
+  e.ttlMs = policy.ttlMs;
+  e.order = nextOrder++;
+  e.onDone = onDone;
+  e.tag = tag;
+  portEXIT_CRITICAL(&txMux);
+  return true;
+}
+
+// Radio task, every pass: start the best waiting frame when the radio is idle
+void serviceTxQueue() {
+  unsigned long now = millis();
+
+  if (inFlight >= 0) {
+    if (now - inFlightSince < TX_WATCHDOG_MS) return;
+    Serial.println("TX timeout — no confirmation from the radio");
+    halRadioCancel();
+    txOnComplete(false);
+  }
+  if (halRadioBusy()) return;
+
+  int best = -1;
+  for (int i = 0; i < TX_QUEUE_LEN; i++) {
+    TxEntry& e = queue[i];
+    if (!e.used) continue;
+    if (e.ttlMs && now - e.enqueuedAt >= e.ttlMs) {
+      Serial.printf("TX queue: port %u frame expired\n", e.port);
+      portENTER_CRITICAL(&txMux);
+      dropped++;
+      portEXIT_CRITICAL(&txMux);
+      finish(i, false);
+      continue;
+    }
+    if (best < 0 || e.priority < queue[best].priority ||
+        (e.priority == queue[best].priority && e.order < queue[best].order)) {
+      best = i;
+    }
+  }
+  if (best < 0) return;
+
+  // Out of budget: hold it; periodic frames expire before the next interval
+  TxEntry& e = queue[best];
+  if (!airtimeAllows((TxPriority)e.priority, e.len)) return;
+
+  if (!halRadioSend(e.port, e.data, e.len, true)) return;  // radio busy, try next pass
+  portENTER_CRITICAL(&txMux);
+  inFlight = best;
+  portEXIT_CRITICAL(&txMux);
+  inFlightSince = now;
+}
+
+// From onRadioTxComplete()
+void txOnComplete(bool acked) {
+  if (inFlight < 0) return;
+  int slot = inFlight;
+  TxEntry& e = queue[slot];
+  bool retry = !acked && e.retriesLeft > 0;
+  portENTER_CRITICAL(&txMux);
+  inFlight = -1;
+  if (retry) e.retriesLeft--;
+  portEXIT_CRITICAL(&txMux);
+
+  if (retry) {
+    Serial.printf("TX queue: port %u not acked, %u retries left\n", e.port, e.retriesLeft);
+    return;  // stays queued at its original position
+  }
+  finish(slot, acked);
+}
+
+int txQueueDepth() {
+  int depth = 0;
+  portENTER_CRITICAL(&txMux);
+  for (int i = 0; i < TX_QUEUE_LEN; i++) {
+    if (queue[i].used) depth++;
+  }
+  portEXIT_CRITICAL(&txMux);
+  return depth;
+}
+
+int txQueuedCount(TxPriority priority) {
+  int count = 0;
+  portENTER_CRITICAL(&txMux);
+  for (int i = 0; i < TX_QUEUE_LEN; i++) {
+    if (queue[i].used && queue[i].priority == priority) count++;
+  }
+  portEXIT_CRITICAL(&txMux);
+  return count;
+}
+
+bool txInFlight() {
+  return inFlight >= 0;
+}
+
+uint8_t txInFlightLength() {
+  return inFlight >= 0 ? queue[inFlight].len : 0;
+}
+
+// Shell task: the headers are copied out first, printing happens unlocked
+void printTxQueue() {
+  static const char* priorityNames[] = { "alarm", "control", "periodic" };
+  struct EntryView {
+    uint8_t priority, port, len, retriesLeft;
+    unsigned long enqueuedAt;
+    bool onAir;
+  };
+  EntryView view[TX_QUEUE_LEN];
+  int count = 0;
+
+  portENTER_CRITICAL(&txMux);
+  for (int i = 0; i < TX_QUEUE_LEN; i++) {
+    const TxEntry& e = queue[i];
+    if (e.used) view[count++] = { e.priority, e.port, e.len, e.retriesLeft, e.enqueuedAt, i == inFlight };
+  }
+  uint32_t droppedTotal = dropped;
+  portEXIT_CRITICAL(&txMux);
+
+  unsigned long now = millis();
+  Serial.printf("TX queue: %d/%d used, %lu dropped\n", count, TX_QUEUE_LEN, (unsigned long)droppedTotal);
+  for (int k = 0; k < count; k++) {
+    const EntryView& e = view[k];
+    Serial.printf("  %-8s port %u, %3u bytes, queued %lu ms, %u retries left%s\n",
+                  priorityNames[e.priority], e.port, e.len, now - e.enqueuedAt, e.retriesLeft,
+                  e.onAir ? "  [on air]" : "");
+  }
+}
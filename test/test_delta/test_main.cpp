@@ -0,0 +1,256 @@
+// Delta uplinks: keyframes, zigzag varint deltas at their length boundaries,
+// and frames split at the smallest MTU. Frames go out through the TX queue
+// to the native radio loopback, which acknowledges each one, and are
+// decoded here the way a network-side decoder would.
+//   pio test -e native_test -f test_delta
+#include <unity.h>
+#include <vector>
+#include "hal_native.h"
+#include "table.h"
+#include "snapshot.h"
+#include "delta.h"
+#include "lora.h"
+#include "txqueue.h"
+
+#define REQUESTS 3
+static const uint8_t REQUEST_REGS[REQUESTS] = { 16, 4, 16 };
+
+struct Frame {
+  uint8_t port;
+  std::vector<uint8_t> data;
+};
+
+static std::vector<Frame> frames;
+static uint16_t decoded[REQUESTS][16];
+static bool decodedRaw[REQUESTS];
+static uint8_t varintLen[REQUESTS][16];  // bytes per changed register in the last delta
+
+static void onUplink(uint8_t port, const uint8_t* data, uint8_t len, bool confirmed) {
+  frames.push_back({ port, std::vector<uint8_t>(data, data + len) });
+}
+
+static uint16_t& value(int request, int reg) {
+  return requestValues[requests[request].valueOffset + reg];
+}
+
+// One uplink interval: publish the live values, encode, and let the radio
+// acknowledge every frame
+static void sendInterval(uint16_t mtu) {
+  static RegisterSnapshot snap;
+  publishSnapshot();
+  readSnapshot(snap);
+  frames.clear();
+  sendDeltaUplink(snap, nullptr, 0, mtu);
+  for (int i = 0; i < 100 && (txQueueDepth() > 0 || txInFlight()); i++) {
+    serviceTxQueue();
+    halRadioRunOnce();
+    halNativeAdvance(10);
+  }
+}
+
+static int32_t unzigzag(uint32_t zz) {
+  return (int32_t)(zz >> 1) ^ -(int32_t)(zz & 1);
+}
+
+// Applies one delta frame to decoded[]; returns the bytes it consumed
+static size_t decodeFrame(const Frame& frame) {
+  const uint8_t* d = frame.data.data();
+  uint8_t first = d[2];
+  uint8_t count = d[3] & 0x7F;
+  uint8_t mapLen = (count + 7) / 8;
+  const uint8_t* successMap = &d[4];
+  const uint8_t* rawMap = successMap + mapLen;
+  size_t pos = 4 + 2 * mapLen;
+
+  for (int k = 0; k < count; k++) {
+    int i = first + k;
+    uint8_t n = REQUEST_REGS[i];
+    if (!(successMap[k / 8] & (1 << (k % 8)))) continue;
+
+    decodedRaw[i] = rawMap[k / 8] & (1 << (k % 8));
+    if (decodedRaw[i]) {
+      for (int r = 0; r < n; r++) decoded[i][r] = (d[pos + 2 * r] << 8) | d[pos + 2 * r + 1];
+      pos += 2 * n;
+      continue;
+    }
+
+    const uint8_t* changed = &d[pos];
+    pos += (n + 7) / 8;
+    for (int r = 0; r < n; r++) {
+      varintLen[i][r] = 0;
+      if (!(changed[r / 8] & (1 << (r % 8)))) continue;
+      uint32_t zz = 0;
+      int shift = 0;
+      do {
+        zz |= (uint32_t)(d[pos] & 0x7F) << shift;
+        shift += 7;
+        varintLen[i][r]++;
+      } while (d[pos++] & 0x80);
+      decoded[i][r] += unzigzag(zz);
+    }
+  }
+  return pos;
+}
+
+static void decodeInterval() {
+  for (const Frame& frame : frames) {
+    TEST_ASSERT_EQUAL(DELTA_FPORT, frame.port);
+    TEST_ASSERT_EQUAL(frame.data.size(), decodeFrame(frame));
+  }
+}
+
+static void assertDecodedMatches() {
+  for (int i = 0; i < REQUESTS; i++) {
+    for (int r = 0; r < REQUEST_REGS[i]; r++) TEST_ASSERT_EQUAL(value(i, r), decoded[i][r]);
+  }
+}
+
+static bool isKeyframe(const Frame& frame) {
+  return frame.data[0] == frame.data[1];
+}
+
+void setUp() {
+  LORA_ENCODING = ENCODING_DELTA;
+  LORA_KEYFRAME_EVERY = 0xFFFF;
+
+  // A rebuilt table starts without a base
+  beginRequestTable();
+  for (int i = 0; i < REQUESTS; i++) {
+    requests[requestCount++] = ModbusRequest(IPAddress(10, 0, 0, 2), 1, i * 100, REQUEST_REGS[i], READ_HREG);
+  }
+  buildRequestTable();
+  for (int i = 0; i < REQUESTS; i++) {
+    requests[i].success = true;
+    for (int r = 0; r < REQUEST_REGS[i]; r++) value(i, r) = 1000 * i + r;
+  }
+  memset(decoded, 0, sizeof(decoded));
+}
+
+void tearDown() {}
+
+static void test_first_interval_is_keyframe() {
+  sendInterval(TX_MAX_PAYLOAD);
+  TEST_ASSERT_EQUAL(1, frames.size());
+  TEST_ASSERT_TRUE(isKeyframe(frames[0]));
+  TEST_ASSERT_EQUAL(0x80 | REQUESTS, frames[0].data[3]);
+
+  decodeInterval();
+  for (int i = 0; i < REQUESTS; i++) TEST_ASSERT_TRUE(decodedRaw[i]);
+  assertDecodedMatches();
+}
+
+static void test_delta_against_acknowledged_base() {
+  sendInterval(TX_MAX_PAYLOAD);
+  decodeInterval();
+  uint8_t keySeq = frames[0].data[0];
+
+  value(0, 3) += 1;
+  value(2, 15) -= 1;
+  sendInterval(TX_MAX_PAYLOAD);
+  TEST_ASSERT_EQUAL(1, frames.size());
+  TEST_ASSERT_FALSE(isKeyframe(frames[0]));
+  TEST_ASSERT_EQUAL(keySeq, frames[0].data[1]);
+
+  decodeInterval();
+  for (int i = 0; i < REQUESTS; i++) TEST_ASSERT_FALSE(decodedRaw[i]);
+  TEST_ASSERT_EQUAL(1, varintLen[0][3]);
+  TEST_ASSERT_EQUAL(1, varintLen[2][15]);
+  assertDecodedMatches();
+
+  // Unchanged values cost only the changed-register bitmaps
+  TEST_ASSERT_EQUAL(4 + 2 + (2 + 1) + 1 + (2 + 1), frames[0].data.size());
+}
+
+static void test_zigzag_varint_boundaries() {
+  // Differences at each varint length boundary, with the bytes each takes
+  static const int32_t diffs[] = { 1, -1, 63, -64, 64, -65, 8191, -8192, 8192, -8193, 65535, -65535 };
+  static const uint8_t lengths[] = { 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3 };
+  const int count = sizeof(diffs) / sizeof(diffs[0]);
+
+  for (int r = 0; r < count; r++) value(0, r) = diffs[r] > 0 ? 0 : -diffs[r];
+  sendInterval(TX_MAX_PAYLOAD);
+  decodeInterval();
+
+  for (int r = 0; r < count; r++) value(0, r) += diffs[r];
+  sendInterval(TX_MAX_PAYLOAD);
+  decodeInterval();
+
+  TEST_ASSERT_FALSE(decodedRaw[0]);
+  for (int r = 0; r < count; r++) TEST_ASSERT_EQUAL(lengths[r], varintLen[0][r]);
+  assertDecodedMatches();
+}
+
+static void test_raw_when_delta_is_not_smaller() {
+  sendInterval(TX_MAX_PAYLOAD);
+  decodeInterval();
+
+  // Four 3-byte deltas plus the bitmap would outgrow 8 raw bytes
+  for (int r = 0; r < 4; r++) value(1, r) += 30000;
+  sendInterval(TX_MAX_PAYLOAD);
+  decodeInterval();
+
+  TEST_ASSERT_FALSE(isKeyframe(frames[0]));
+  TEST_ASSERT_TRUE(decodedRaw[1]);
+  TEST_ASSERT_FALSE(decodedRaw[0]);
+  assertDecodedMatches();
+}
+
+static void test_requested_keyframe() {
+  sendInterval(TX_MAX_PAYLOAD);
+  decodeInterval();
+  sendInterval(TX_MAX_PAYLOAD);
+  TEST_ASSERT_FALSE(isKeyframe(frames[0]));
+
+  requestKeyframe();
+  sendInterval(TX_MAX_PAYLOAD);
+  TEST_ASSERT_TRUE(isKeyframe(frames[0]));
+  decodeInterval();
+  for (int i = 0; i < REQUESTS; i++) TEST_ASSERT_TRUE(decodedRaw[i]);
+
+  // Once that keyframe is acknowledged, deltas resume
+  sendInterval(TX_MAX_PAYLOAD);
+  TEST_ASSERT_FALSE(isKeyframe(frames[0]));
+}
+
+static void test_failed_request_keeps_decoder_values() {
+  sendInterval(TX_MAX_PAYLOAD);
+  decodeInterval();
+
+  uint16_t before = value(1, 0);
+  requests[1].success = false;
+  value(1, 0) += 5;
+  sendInterval(TX_MAX_PAYLOAD);
+  TEST_ASSERT_EQUAL(0, frames[0].data[4] & 0x02);
+  decodeInterval();
+  TEST_ASSERT_EQUAL(before, decoded[1][0]);
+}
+
+static void test_keyframe_split_at_smallest_mtu() {
+  sendInterval(LORA_MIN_MTU);
+  TEST_ASSERT_EQUAL(2, frames.size());
+  TEST_ASSERT_EQUAL(2, frames[0].data[3]);          // not final
+  TEST_ASSERT_EQUAL(0x80 | 1, frames[1].data[3]);   // final
+  TEST_ASSERT_EQUAL(2, frames[1].data[2]);          // first request
+  for (const Frame& frame : frames) {
+    TEST_ASSERT_LESS_OR_EQUAL(LORA_MIN_MTU, frame.data.size());
+    TEST_ASSERT_TRUE(isKeyframe(frame));
+  }
+  decodeInterval();
+  assertDecodedMatches();
+}
+
+int main(int argc, char** argv) {
+  halNativeUseVirtualClock(true);
+  halNativeOnUplink(onUplink);
+  Serial.setQuiet(true);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_first_interval_is_keyframe);
+  RUN_TEST(test_delta_against_acknowledged_base);
+  RUN_TEST(test_zigzag_varint_boundaries);
+  RUN_TEST(test_raw_when_delta_is_not_smaller);
+  RUN_TEST(test_requested_keyframe);
+  RUN_TEST(test_failed_request_keeps_decoder_values);
+  RUN_TEST(test_keyframe_split_at_smallest_mtu);
+  return UNITY_END();
+}
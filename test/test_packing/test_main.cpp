@@ -0,0 +1,123 @@
+// Frame packing at the edges of the frame capacity.
+//   pio test -e native_test -f test_packing
+#include <unity.h>
+#include "packing.h"
+#include "lora.h"
+
+#define CAPACITY LORA_MIN_MTU  // SF12
+
+static PackingPlan plan;
+
+// Every placed item has a frame of the plan and no frame overflows
+static bool framesWithinCapacity(const uint16_t* sizes, uint8_t count) {
+  uint16_t used[MAX_PACK_ITEMS] = {};
+  for (int i = 0; i < count; i++) {
+    if (plan.frameOf[i] == PACK_REJECTED) continue;
+    if (plan.frameOf[i] >= plan.frameCount) return false;
+    used[plan.frameOf[i]] += sizes[i];
+  }
+  for (int f = 0; f < plan.frameCount; f++) {
+    if (used[f] > plan.capacity) return false;
+  }
+  return true;
+}
+
+void setUp() {
+  memset(&plan, 0, sizeof(plan));
+}
+
+void tearDown() {}
+
+static void test_empty_set_still_makes_one_frame() {
+  planPacking(plan, nullptr, 0, CAPACITY);
+  TEST_ASSERT_EQUAL(1, plan.frameCount);
+  TEST_ASSERT_EQUAL(0, plan.itemCount);
+}
+
+static void test_item_of_exactly_capacity() {
+  uint16_t sizes[] = { CAPACITY };
+  planPacking(plan, sizes, 1, CAPACITY);
+  TEST_ASSERT_EQUAL(1, plan.frameCount);
+  TEST_ASSERT_EQUAL(0, plan.frameOf[0]);
+}
+
+static void test_one_byte_over_capacity_needs_two_frames() {
+  uint16_t sizes[] = { CAPACITY - 1, 1 };
+  planPacking(plan, sizes, 2, CAPACITY);
+  TEST_ASSERT_EQUAL(1, plan.frameCount);
+
+  uint16_t over[] = { CAPACITY - 1, 2 };
+  planPacking(plan, over, 2, CAPACITY);
+  TEST_ASSERT_EQUAL(2, plan.frameCount);
+  TEST_ASSERT_NOT_EQUAL(plan.frameOf[0], plan.frameOf[1]);
+  TEST_ASSERT_TRUE(framesWithinCapacity(over, 2));
+}
+
+static void test_oversize_item_is_rejected() {
+  uint16_t sizes[] = { 10, CAPACITY + 1, 20 };
+  planPacking(plan, sizes, 3, CAPACITY);
+  TEST_ASSERT_EQUAL(PACK_REJECTED, plan.frameOf[1]);
+  TEST_ASSERT_EQUAL(1, plan.frameCount);
+  TEST_ASSERT_EQUAL(0, plan.frameOf[0]);
+  TEST_ASSERT_EQUAL(0, plan.frameOf[2]);
+}
+
+static void test_only_oversize_items() {
+  uint16_t sizes[] = { CAPACITY + 1, 300 };
+  planPacking(plan, sizes, 2, CAPACITY);
+  TEST_ASSERT_EQUAL(PACK_REJECTED, plan.frameOf[0]);
+  TEST_ASSERT_EQUAL(PACK_REJECTED, plan.frameOf[1]);
+  TEST_ASSERT_EQUAL(1, plan.frameCount);
+}
+
+static void test_zero_sizes_take_no_frame() {
+  uint16_t sizes[] = { 0, CAPACITY, 0 };
+  planPacking(plan, sizes, 3, CAPACITY);
+  TEST_ASSERT_EQUAL(1, plan.frameCount);
+  TEST_ASSERT_EQUAL(0, plan.frameOf[0]);
+  TEST_ASSERT_EQUAL(0, plan.frameOf[2]);
+}
+
+static void test_first_fit_decreasing_fills_gaps() {
+  // 30 + 21 and 26 + 25 each fill a frame exactly
+  uint16_t sizes[] = { 21, 26, 30, 25 };
+  planPacking(plan, sizes, 4, CAPACITY);
+  TEST_ASSERT_EQUAL(2, plan.frameCount);
+  TEST_ASSERT_EQUAL(plan.frameOf[2], plan.frameOf[0]);
+  TEST_ASSERT_EQUAL(plan.frameOf[1], plan.frameOf[3]);
+  TEST_ASSERT_TRUE(framesWithinCapacity(sizes, 4));
+}
+
+static void test_full_table_stays_within_capacity() {
+  uint16_t sizes[MAX_PACK_ITEMS];
+  for (int i = 0; i < MAX_PACK_ITEMS; i++) sizes[i] = 1 + (i * 17) % CAPACITY;
+  planPacking(plan, sizes, MAX_PACK_ITEMS, CAPACITY);
+  TEST_ASSERT_TRUE(framesWithinCapacity(sizes, MAX_PACK_ITEMS));
+}
+
+static void test_plan_invalidated_by_size_or_capacity() {
+  uint16_t sizes[] = { 10, 20, 30 };
+  planPacking(plan, sizes, 3, CAPACITY);
+  TEST_ASSERT_TRUE(packingPlanValid(plan, sizes, 3, CAPACITY));
+  TEST_ASSERT_FALSE(packingPlanValid(plan, sizes, 3, CAPACITY + 1));
+  TEST_ASSERT_FALSE(packingPlanValid(plan, sizes, 2, CAPACITY));
+
+  sizes[1]++;
+  TEST_ASSERT_FALSE(packingPlanValid(plan, sizes, 3, CAPACITY));
+}
+
+int main(int argc, char** argv) {
+  Serial.setQuiet(true);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_empty_set_still_makes_one_frame);
+  RUN_TEST(test_item_of_exactly_capacity);
+  RUN_TEST(test_one_byte_over_capacity_needs_two_frames);
+  RUN_TEST(test_oversize_item_is_rejected);
+  RUN_TEST(test_only_oversize_items);
+  RUN_TEST(test_zero_sizes_take_no_frame);
+  RUN_TEST(test_first_fit_decreasing_fills_gaps);
+  RUN_TEST(test_full_table_stays_within_capacity);
+  RUN_TEST(test_plan_invalidated_by_size_or_capacity);
+  return UNITY_END();
+}
@@ -0,0 +1,153 @@
+// Coalescing of requests into Modbus reads: the gap a block may read through,
+// the PDU limits, and what keeps two requests apart.
+//   pio test -e native_test -f test_planner
+#include <unity.h>
+#include "hal_native.h"
+#include "table.h"
+#include "planner.h"
+
+static const IPAddress SLAVE(10, 0, 0, 2);
+
+static void addRequest(uint16_t start, uint8_t count, ModbusFunction function = READ_HREG) {
+  requests[requestCount++] = ModbusRequest(SLAVE, 1, start, count, function);
+}
+
+void setUp() {
+  beginRequestTable();
+  MODBUS_MAX_GAP = 10;
+}
+
+void tearDown() {}
+
+static void test_gap_of_max_gap_merges() {
+  addRequest(0, 10);
+  addRequest(20, 5);  // 10 registers after the first one ends
+  planModbusBlocks();
+
+  TEST_ASSERT_EQUAL(1, blockCount);
+  TEST_ASSERT_EQUAL(0, blocks[0].startReg);
+  TEST_ASSERT_EQUAL(25, blocks[0].numRegs);
+  TEST_ASSERT_EQUAL(0, requestBlock[0]);
+  TEST_ASSERT_EQUAL(0, requestBlock[1]);
+}
+
+static void test_gap_past_max_gap_splits() {
+  addRequest(0, 10);
+  addRequest(21, 5);
+  planModbusBlocks();
+
+  TEST_ASSERT_EQUAL(2, blockCount);
+  TEST_ASSERT_EQUAL(10, blocks[0].numRegs);
+  TEST_ASSERT_EQUAL(21, blocks[1].startReg);
+  TEST_ASSERT_EQUAL(1, requestBlock[1]);
+}
+
+static void test_zero_gap_merges_only_touching() {
+  MODBUS_MAX_GAP = 0;
+  addRequest(0, 10);
+  addRequest(10, 5);  // touching
+  addRequest(16, 5);  // one register apart
+  planModbusBlocks();
+
+  TEST_ASSERT_EQUAL(2, blockCount);
+  TEST_ASSERT_EQUAL(15, blocks[0].numRegs);
+  TEST_ASSERT_EQUAL(16, blocks[1].startReg);
+}
+
+static void test_overlap_and_table_order() {
+  addRequest(50, 10);
+  addRequest(0, 40);
+  addRequest(30, 30);  // inside the span of the other two
+  planModbusBlocks();
+
+  TEST_ASSERT_EQUAL(1, blockCount);
+  TEST_ASSERT_EQUAL(0, blocks[0].startReg);
+  TEST_ASSERT_EQUAL(60, blocks[0].numRegs);
+}
+
+static void test_register_limit() {
+  addRequest(0, 100);
+  addRequest(100, 25);  // exactly MAX_PDU_REGS together
+  addRequest(125, 1);
+  planModbusBlocks();
+
+  TEST_ASSERT_EQUAL(2, blockCount);
+  TEST_ASSERT_EQUAL(MAX_PDU_REGS, blocks[0].numRegs);
+  TEST_ASSERT_EQUAL(125, blocks[1].startReg);
+  TEST_ASSERT_EQUAL(1, requestBlock[2]);
+}
+
+static void test_gap_counts_towards_register_limit() {
+  addRequest(0, 100);
+  addRequest(106, 20);  // within the gap, but 126 registers in one read
+  planModbusBlocks();
+
+  TEST_ASSERT_EQUAL(2, blockCount);
+}
+
+static void test_bit_limit() {
+  MODBUS_MAX_GAP = 200;
+  for (int i = 0; i < 16; i++) addRequest(i * 125, 125, READ_COILS);  // exactly MAX_PDU_BITS
+  planModbusBlocks();
+  TEST_ASSERT_EQUAL(1, blockCount);
+  TEST_ASSERT_EQUAL(MAX_PDU_BITS, blocks[0].numRegs);
+
+  requests[15].startReg = 1876;  // one bit past the limit
+  planModbusBlocks();
+  TEST_ASSERT_EQUAL(2, blockCount);
+  TEST_ASSERT_EQUAL(1876, blocks[1].startReg);
+}
+
+static void test_differences_keep_requests_apart() {
+  addRequest(0, 4);
+  addRequest(4, 4, READ_IREG);
+  addRequest(8, 4);
+  requests[2].unitID = 2;
+  addRequest(12, 4);
+  requests[3].slaveIP = IPAddress(10, 0, 0, 3);
+  addRequest(16, 4);
+  requests[4].intervalMs = 5000;
+  addRequest(20, 4);
+  requests[5].phaseMs = 100;
+  planModbusBlocks();
+
+  TEST_ASSERT_EQUAL(6, blockCount);
+  for (int i = 0; i < requestCount; i++) {
+    for (int k = 0; k < i; k++) TEST_ASSERT_NOT_EQUAL(requestBlock[k], requestBlock[i]);
+  }
+}
+
+static void test_pool_offsets_are_disjoint() {
+  MODBUS_MAX_GAP = 0;
+  addRequest(0, 8);
+  addRequest(100, 8);
+  addRequest(0, 16, READ_COILS);
+  addRequest(200, 4);
+  planModbusBlocks();
+
+  uint16_t words = 0, bits = 0;
+  for (int b = 0; b < blockCount; b++) {
+    uint16_t& used = isBitFunction(blocks[b].function) ? bits : words;
+    TEST_ASSERT_EQUAL(used, blocks[b].poolOffset);
+    used += blocks[b].numRegs;
+  }
+  TEST_ASSERT_EQUAL(20, words);
+  TEST_ASSERT_EQUAL(16, bits);
+}
+
+int main(int argc, char** argv) {
+  halNativeUseVirtualClock(true);
+  Serial.setQuiet(true);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_gap_of_max_gap_merges);
+  RUN_TEST(test_gap_past_max_gap_splits);
+  RUN_TEST(test_zero_gap_merges_only_touching);
+  RUN_TEST(test_overlap_and_table_order);
+  RUN_TEST(test_register_limit);
+  RUN_TEST(test_gap_counts_towards_register_limit);
+  RUN_TEST(test_bit_limit);
+  RUN_TEST(test_differences_keep_requests_apart);
+  RUN_TEST(test_pool_offsets_are_disjoint);
+  return UNITY_END();
+}
@@ -0,0 +1,138 @@
+// Timing wheel: periods missed while the Modbus task was busy, blocks due
+// more than a turn out, and the rebase that keeps ticks small.
+//   pio test -e native_test -f test_schedule
+#include <unity.h>
+#include "hal_native.h"
+#include "schedule.h"
+
+#define REBASE_TICKS (1UL << 24)  // WHEEL_REBASE_TICKS in schedule.cpp
+
+static uint8_t due[MAX_BLOCKS];
+static unsigned long lateMs;
+
+static void addBlock(uint32_t intervalMs, int32_t phaseMs) {
+  ModbusBlock& blk = blocks[blockCount++];
+  blk = ModbusBlock();
+  blk.intervalMs = intervalMs;
+  blk.phaseMs = phaseMs;
+}
+
+static int take() {
+  return takeDueBlocks(millis(), due, lateMs);
+}
+
+void setUp() {
+  blockCount = 0;
+}
+
+void tearDown() {}
+
+static void test_due_on_phase_then_every_period() {
+  addBlock(1000, 200);
+  planSchedule();
+
+  for (int tick = 0; tick < 100; tick++) {
+    int n = take();
+    bool expected = tick % 20 == 4;
+    TEST_ASSERT_EQUAL(expected ? 1 : 0, n);
+    if (n) TEST_ASSERT_EQUAL(0, lateMs);
+    halNativeAdvance(WHEEL_TICK_MS);
+  }
+}
+
+static void test_missed_periods_are_skipped() {
+  addBlock(1000, 0);
+  planSchedule();
+  TEST_ASSERT_EQUAL(1, take());
+
+  // Five periods go by without a call: one read, reported late, not five
+  halNativeAdvance(5500);
+  TEST_ASSERT_EQUAL(1, take());
+  TEST_ASSERT_EQUAL(0, due[0]);
+  TEST_ASSERT_EQUAL(4500, lateMs);
+  TEST_ASSERT_EQUAL(0, take());
+
+  // Back on the original phase, not 1000 ms after the late read
+  halNativeAdvance(450);
+  TEST_ASSERT_EQUAL(0, take());
+  halNativeAdvance(50);
+  TEST_ASSERT_EQUAL(1, take());
+  TEST_ASSERT_EQUAL(0, lateMs);
+}
+
+static void test_late_reports_earliest_block() {
+  addBlock(1000, 0);
+  addBlock(1000, 300);
+  planSchedule();
+  TEST_ASSERT_EQUAL(1, take());
+
+  halNativeAdvance(700);
+  TEST_ASSERT_EQUAL(1, take());
+  TEST_ASSERT_EQUAL(1, due[0]);
+  TEST_ASSERT_EQUAL(400, lateMs);
+}
+
+static void test_period_longer_than_a_turn_waits() {
+  addBlock(WHEEL_SLOTS * WHEEL_TICK_MS * 3, 0);
+  planSchedule();
+  TEST_ASSERT_EQUAL(1, take());
+
+  // Its slot comes round twice before it is due
+  for (int tick = 1; tick < WHEEL_SLOTS * 3; tick++) {
+    halNativeAdvance(WHEEL_TICK_MS);
+    TEST_ASSERT_EQUAL(0, take());
+  }
+  halNativeAdvance(WHEEL_TICK_MS);
+  TEST_ASSERT_EQUAL(1, take());
+}
+
+static void test_each_block_once_per_call() {
+  addBlock(WHEEL_TICK_MS, 0);  // due every tick
+  planSchedule();
+
+  // A full turn late, the block still comes back only once
+  halNativeAdvance(WHEEL_SLOTS * WHEEL_TICK_MS * 2);
+  TEST_ASSERT_EQUAL(1, take());
+  TEST_ASSERT_EQUAL(0, take());
+  halNativeAdvance(WHEEL_TICK_MS);
+  TEST_ASSERT_EQUAL(1, take());
+}
+
+static void test_periods_hold_across_rebase() {
+  addBlock(1000, 0);
+  addBlock(3000, 250);
+  planSchedule();
+
+  // Jump to just before the rebase; the late reads catch up once
+  halNativeAdvance((REBASE_TICKS - 100) * WHEEL_TICK_MS);
+  TEST_ASSERT_EQUAL(2, take());
+
+  unsigned long lastRead[2] = { 0, 0 };
+  int reads[2] = { 0, 0 };
+  for (int tick = 0; tick < 400; tick++) {
+    halNativeAdvance(WHEEL_TICK_MS);
+    int n = take();
+    for (int k = 0; k < n; k++) {
+      int b = due[k];
+      TEST_ASSERT_EQUAL(0, lateMs);
+      if (reads[b]++ > 0) TEST_ASSERT_EQUAL(blocks[b].intervalMs, millis() - lastRead[b]);
+      lastRead[b] = millis();
+    }
+  }
+  TEST_ASSERT_EQUAL(20, reads[0]);
+  TEST_ASSERT_GREATER_OR_EQUAL(6, reads[1]);
+}
+
+int main(int argc, char** argv) {
+  halNativeUseVirtualClock(true);
+  Serial.setQuiet(true);
+
+  UNITY_BEGIN();
+  RUN_TEST(test_due_on_phase_then_every_period);
+  RUN_TEST(test_missed_periods_are_skipped);
+  RUN_TEST(test_late_reports_earliest_block);
+  RUN_TEST(test_period_longer_than_a_turn_waits);
+  RUN_TEST(test_each_block_once_per_call);
+  RUN_TEST(test_periods_hold_across_rebase);
+  return UNITY_END();
+}
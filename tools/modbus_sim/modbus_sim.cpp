@@ -0,0 +1,421 @@
+// Modbus TCP slave simulator for load testing the poll engine on a Linux host.
+// Each virtual slave listens on its own loopback address (127.0.0.<base+i>),
+// so the gateway's per-IP connection handling is exercised as on a plant
+// network. Every slave answers any unit ID up to --units; other units get
+// exception 0x0B (gateway target failed to respond).
+//
+//   pio run -e modbus_sim && .pio/build/modbus_sim/program --slaves 16 --latency 5 --jitter 3
+//
+// Options (times in ms, rates in percent):
+//   --port N             TCP port on every address (default 1502)
+//   --slaves N           number of slaves (default 8, max 200)
+//   --base N             last octet of the first slave (default 10)
+//   --units N            unit IDs 1..N answer (default 4)
+//   --latency MS         response delay (default 2)
+//   --jitter MS          uniform extra delay 0..MS (default 0)
+//   --drop PCT           requests silently ignored (default 0)
+//   --exception PCT:CODE requests answered with an exception (default 0:4)
+//   --registers KIND     ramp | random | sine | const=N (default ramp)
+//   --slave I:K=V,...    per-slave override of latency, jitter, drop or
+//                        exception (e.g. --slave 3:latency=400,drop=10);
+//                        "down" leaves slave I without a listener
+//   --seed N             random seed (default 1)
+// Stats are printed every 5 s and on Ctrl-C.
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <chrono>
+#include <random>
+#include <string>
+#include <vector>
+
+#define MAX_SIM_SLAVES 200
+
+enum RegisterKind { REGS_RAMP, REGS_RANDOM, REGS_SINE, REGS_CONST };
+
+struct SlaveProfile {
+  uint32_t latencyMs = 2;
+  uint32_t jitterMs = 0;
+  uint32_t dropPct = 0;
+  uint32_t exceptionPct = 0;
+  uint8_t exceptionCode = 0x04;
+  bool down = false;
+};
+
+struct SimSlave {
+  SlaveProfile profile;
+  int listenFd = -1;
+  uint8_t octet;
+  uint64_t requests = 0;
+  uint64_t dropped = 0;
+  uint64_t exceptions = 0;
+};
+
+struct SimClient {
+  int fd;
+  int slave;
+  std::vector<uint8_t> rx;
+};
+
+// A response waiting for its simulated latency to pass
+struct PendingReply {
+  uint64_t dueUs;
+  int fd;
+  std::vector<uint8_t> adu;
+};
+
+static SimSlave slaves[MAX_SIM_SLAVES];
+static int slaveCount = 8;
+static uint16_t port = 1502;
+static int baseOctet = 10;
+static int unitCount = 4;
+static RegisterKind registerKind = REGS_RAMP;
+static uint16_t registerConst = 0;
+static std::vector<SimClient> clients;
+static std::vector<PendingReply> pending;
+static std::mt19937 rng(1);
+static volatile sig_atomic_t stopping = 0;
+
+static uint64_t nowUs() {
+  using namespace std::chrono;
+  return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+static uint32_t randomBelow(uint32_t n) {
+  return n ? rng() % n : 0;
+}
+
+// ----- Register contents -----
+
+static uint16_t registerValue(int slave, uint8_t unit, uint16_t address) {
+  switch (registerKind) {
+    case REGS_RANDOM:
+      return rng();
+    case REGS_SINE: {
+      double t = nowUs() / 1e6;
+      return (uint16_t)(1000 + 1000 * sin(t + address * 0.1 + slave));
+    }
+    case REGS_CONST:
+      return registerConst;
+    case REGS_RAMP:
+    default:
+      // Distinct per slave and unit, and moving once a second
+      return (uint16_t)(slave * 1000 + unit * 100 + address + nowUs() / 1000000);
+  }
+}
+
+// ----- Protocol -----
+
+static std::vector<uint8_t> exceptionReply(const uint8_t* mbap, uint8_t function, uint8_t code) {
+  return { mbap[0], mbap[1], 0, 0, 0, 3, mbap[6], (uint8_t)(function | 0x80), code };
+}
+
+// Builds the reply to one request ADU; empty when the request is dropped
+static std::vector<uint8_t> handleRequest(int s, const uint8_t* adu, size_t len) {
+  SimSlave& slave = slaves[s];
+  slave.requests++;
+
+  if (randomBelow(100) < slave.profile.dropPct) {
+    slave.dropped++;
+    return {};
+  }
+
+  uint8_t unit = adu[6];
+  uint8_t function = adu[7];
+  if (unit < 1 || unit > unitCount) {
+    slave.exceptions++;
+    return exceptionReply(adu, function, 0x0B);
+  }
+  if (randomBelow(100) < slave.profile.exceptionPct) {
+    slave.exceptions++;
+    return exceptionReply(adu, function, slave.profile.exceptionCode);
+  }
+  if (len < 12 || function < 1 || function > 4) {
+    slave.exceptions++;
+    return exceptionReply(adu, function, 0x01);
+  }
+
+  uint16_t start = (adu[8] << 8) | adu[9];
+  uint16_t count = (adu[10] << 8) | adu[11];
+  bool registers = function == 3 || function == 4;
+  if (count == 0 || count > (registers ? 125 : 2000)) {
+    slave.exceptions++;
+    return exceptionReply(adu, function, 0x03);
+  }
+
+  std::vector<uint8_t> reply = { adu[0], adu[1], 0, 0, 0, 0, unit, function, 0 };
+  if (registers) {
+    for (uint16_t r = 0; r < count; r++) {
+      uint16_t v = registerValue(s, unit, start + r);
+      reply.push_back(v >> 8);
+      reply.push_back(v & 0xFF);
+    }
+  } else {
+    reply.resize(9 + (count + 7) / 8, 0);
+    for (uint16_t b = 0; b < count; b++) {
+      if (registerValue(s, unit, start + b) & 1) reply[9 + b / 8] |= 1 << (b % 8);
+    }
+  }
+  reply[8] = reply.size() - 9;
+  uint16_t length = reply.size() - 6;
+  reply[4] = length >> 8;
+  reply[5] = length & 0xFF;
+  return reply;
+}
+
+static void closeClient(size_t c) {
+  int fd = clients[c].fd;
+  close(fd);
+  for (size_t p = 0; p < pending.size();) {
+    if (pending[p].fd == fd) {
+      pending.erase(pending.begin() + p);
+    } else {
+      p++;
+    }
+  }
+  clients.erase(clients.begin() + c);
+}
+
+// Returns false once the peer has gone
+static bool readClient(SimClient& client) {
+  uint8_t buf[1024];
+  ssize_t n;
+  while ((n = recv(client.fd, buf, sizeof(buf), 0)) > 0) client.rx.insert(client.rx.end(), buf, buf + n);
+  if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) return false;
+
+  while (client.rx.size() >= 8) {
+    size_t total = 6 + ((client.rx[4] << 8) | client.rx[5]);
+    if (total < 8 || total > 260) return false;  // not Modbus TCP
+    if (client.rx.size() < total) break;
+
+    std::vector<uint8_t> reply = handleRequest(client.slave, client.rx.data(), total);
+    if (!reply.empty()) {
+      const SlaveProfile& profile = slaves[client.slave].profile;
+      uint64_t delayUs = (uint64_t)(profile.latencyMs + randomBelow(profile.jitterMs + 1)) * 1000;
+      pending.push_back({ nowUs() + delayUs, client.fd, reply });
+    }
+    client.rx.erase(client.rx.begin(), client.rx.begin() + total);
+  }
+  return true;
+}
+
+static void sendDueReplies() {
+  uint64_t now = nowUs();
+  for (size_t p = 0; p < pending.size();) {
+    if (pending[p].dueUs <= now) {
+      send(pending[p].fd, pending[p].adu.data(), pending[p].adu.size(), MSG_NOSIGNAL);
+      pending.erase(pending.begin() + p);
+    } else {
+      p++;
+    }
+  }
+}
+
+static int nextDueMs() {
+  if (pending.empty()) return 100;
+  uint64_t now = nowUs();
+  uint64_t next = pending[0].dueUs;
+  for (auto& p : pending) next = std::min(next, p.dueUs);
+  return next <= now ? 0 : (int)std::min<uint64_t>((next - now + 999) / 1000, 100);
+}
+
+// ----- Setup -----
+
+static bool openListener(SimSlave& slave) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd < 0) return false;
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_port = htons(port);
+  addr.sin_addr.s_addr = htonl((127u << 24) | slave.octet);
+  if (bind(fd, (sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 4) < 0) {
+    fprintf(stderr, "127.0.0.%u:%u: %s\n", slave.octet, port, strerror(errno));
+    close(fd);
+    return false;
+  }
+  fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+  slave.listenFd = fd;
+  return true;
+}
+
+static void acceptClients(int s) {
+  int fd;
+  while ((fd = accept(slaves[s].listenFd, nullptr, nullptr)) >= 0) {
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    clients.push_back({ fd, s, {} });
+  }
+}
+
+static void printStats() {
+  uint64_t requests = 0, dropped = 0, exceptions = 0;
+  for (int s = 0; s < slaveCount; s++) {
+    requests += slaves[s].requests;
+    dropped += slaves[s].dropped;
+    exceptions += slaves[s].exceptions;
+  }
+  printf("sim: %d slaves, %zu connections, %llu requests, %llu dropped, %llu exceptions\n", slaveCount,
+         clients.size(), (unsigned long long)requests, (unsigned long long)dropped, (unsigned long long)exceptions);
+  fflush(stdout);
+}
+
+static bool parseProfileKey(SlaveProfile& profile, const char* key, const char* value) {
+  if (!strcmp(key, "latency")) {
+    profile.latencyMs = atoi(value);
+  } else if (!strcmp(key, "jitter")) {
+    profile.jitterMs = atoi(value);
+  } else if (!strcmp(key, "drop")) {
+    profile.dropPct = atoi(value);
+  } else if (!strcmp(key, "exception")) {
+    profile.exceptionPct = atoi(value);
+    const char* code = strchr(value, ':');
+    if (code) profile.exceptionCode = strtol(code + 1, nullptr, 0);
+  } else if (!strcmp(key, "down")) {
+    profile.down = true;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// "3:latency=400,drop=10"
+static bool parseSlaveOverride(const char* arg, std::vector<std::pair<int, std::string>>& overrides) {
+  const char* colon = strchr(arg, ':');
+  if (!colon) return false;
+  overrides.push_back({ atoi(arg), colon + 1 });
+  return true;
+}
+
+static bool applyOverride(SlaveProfile& profile, std::string spec) {
+  size_t at = 0;
+  while (at <= spec.size()) {
+    size_t comma = spec.find(',', at);
+    std::string item = spec.substr(at, comma == std::string::npos ? std::string::npos : comma - at);
+    size_t eq = item.find('=');
+    std::string key = item.substr(0, eq);
+    std::string value = eq == std::string::npos ? "" : item.substr(eq + 1);
+    if (!parseProfileKey(profile, key.c_str(), value.c_str())) return false;
+    if (comma == std::string::npos) break;
+    at = comma + 1;
+  }
+  return true;
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: modbus_sim [--port N] [--slaves N] [--base N] [--units N] [--latency MS] [--jitter MS]\n"
+          "                  [--drop PCT] [--exception PCT:CODE] [--registers ramp|random|sine|const=N]\n"
+          "                  [--slave I:key=value,...] [--seed N]\n");
+  exit(2);
+}
+
+static void onSignal(int) {
+  stopping = 1;
+}
+
+int main(int argc, char** argv) {
+  SlaveProfile defaults;
+  std::vector<std::pair<int, std::string>> overrides;
+
+  for (int i = 1; i < argc; i++) {
+    const char* opt = argv[i];
+    if (i + 1 >= argc) usage();
+    const char* value = argv[++i];
+    if (!strcmp(opt, "--port")) {
+      port = atoi(value);
+    } else if (!strcmp(opt, "--slaves")) {
+      slaveCount = std::max(1, std::min(atoi(value), MAX_SIM_SLAVES));
+    } else if (!strcmp(opt, "--base")) {
+      baseOctet = atoi(value);
+    } else if (!strcmp(opt, "--units")) {
+      unitCount = std::max(1, std::min(atoi(value), 247));
+    } else if (!strcmp(opt, "--registers")) {
+      if (!strcmp(value, "ramp")) registerKind = REGS_RAMP;
+      else if (!strcmp(value, "random")) registerKind = REGS_RANDOM;
+      else if (!strcmp(value, "sine")) registerKind = REGS_SINE;
+      else if (!strncmp(value, "const=", 6)) {
+        registerKind = REGS_CONST;
+        registerConst = atoi(value + 6);
+      } else usage();
+    } else if (!strcmp(opt, "--slave")) {
+      if (!parseSlaveOverride(value, overrides)) usage();
+    } else if (!strcmp(opt, "--seed")) {
+      rng.seed(atoi(value));
+    } else if (strncmp(opt, "--", 2) || !parseProfileKey(defaults, opt + 2, value)) {
+      usage();
+    }
+  }
+  if (baseOctet < 1 || baseOctet + slaveCount > 255) {
+    fprintf(stderr, "slaves 127.0.0.%d.. do not fit in 127.0.0.0/24\n", baseOctet);
+    return 2;
+  }
+
+  for (int s = 0; s < slaveCount; s++) {
+    slaves[s].profile = defaults;
+    slaves[s].octet = baseOctet + s;
+  }
+  for (auto& o : overrides) {
+    if (o.first < 0 || o.first >= slaveCount || !applyOverride(slaves[o.first].profile, o.second)) usage();
+  }
+
+  int listening = 0;
+  for (int s = 0; s < slaveCount; s++) {
+    if (!slaves[s].profile.down && openListener(slaves[s])) listening++;
+  }
+  if (listening == 0) return 1;
+  printf("sim: %d slaves on 127.0.0.%d-%d:%u, units 1-%d, latency %u+%u ms, drop %u%%, exception %u%%\n",
+         listening, baseOctet, baseOctet + slaveCount - 1, port, unitCount, defaults.latencyMs, defaults.jitterMs,
+         defaults.dropPct, defaults.exceptionPct);
+  fflush(stdout);
+
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+
+  uint64_t lastStats = nowUs();
+  std::vector<pollfd> fds;
+  while (!stopping) {
+    fds.clear();
+    for (int s = 0; s < slaveCount; s++) {
+      if (slaves[s].listenFd >= 0) fds.push_back({ slaves[s].listenFd, POLLIN, 0 });
+    }
+    size_t firstClient = fds.size();
+    for (auto& c : clients) fds.push_back({ c.fd, POLLIN, 0 });
+
+    if (poll(fds.data(), fds.size(), nextDueMs()) < 0 && errno != EINTR) break;
+
+    for (int s = 0; s < slaveCount; s++) {
+      if (slaves[s].listenFd >= 0) acceptClients(s);
+    }
+    for (size_t f = firstClient, c = 0; f < fds.size(); f++) {
+      if (fds[f].revents && !readClient(clients[c])) {
+        closeClient(c);
+      } else {
+        c++;
+      }
+    }
+    sendDueReplies();
+
+    if (nowUs() - lastStats >= 5000000) {
+      printStats();
+      lastStats = nowUs();
+    }
+  }
+
+  printStats();
+  return 0;
+}